@@ -10,6 +10,15 @@
 #include "gps.h"
 #include "nexstar.h"
 #include "bluetooth.h"
+#include "events.h"
+#include "scheduler.h"
+#include "power.h"
+#include "leds.h"
+#include "commport.h"
+#include "profiler.h"
+#include "diagnostics.h"
+#include "serial_capture.h"
+#include "settings.h"
 #include <TimeLib.h>
 
 #define BT_POWER_PIN PB1
@@ -17,100 +26,226 @@
 #define NEXSTAR_LED_PIN PA7
 #define GPS_LED_PIN PA6
 
-#define LEDS_INTERVAL 200
-#define LEDS_PATTERN_SIZE 12
-#define LEDS_PWM 5
-
+#define DEBUG_INTERVAL 1000
+// Bytes of tokenized log records written on each loop iteration
+#define LOG_DRAIN_BYTES 128
+// Bytes of serial capture records written on each loop iteration
+#define CAPTURE_DRAIN_BYTES 256
+
+#if defined(SERIAL_CAPTURE) && !defined(DISABLE_LOGGING)
+#error "SERIAL_CAPTURE streams to USB Serial: logging must be disabled"
+#endif
+
+
+Settings settings;
+EventBus events;
+Scheduler scheduler;
+PowerManager power(scheduler);
+Leds leds(Timer4, GPS_LED_PIN, NEXSTAR_LED_PIN);
+RTCProvider rtcProvider(events);
+GPS gps(GPSSerial, Timer2, events);
+Nexstar nexstar{NexstarSerial, gps, rtcProvider, events, settings};
+Diagnostics diagnostics(gps, nexstar, rtcProvider, scheduler, power, settings);
+Bluetooth bluetooth(BluetoothSerial, BT_POWER_PIN, BT_AT_MODE_PIN, settings);
+
+bool isUSBConnected() {
+#ifdef SERIAL_CAPTURE
+  // USB Serial carries the capture: clients can only use Bluetooth
+  return false;
+#else
+  return USBSerial;
+#endif
+}
 
-RTCProvider rtcProvider;
-GPS gps(GPSSerial);
-Nexstar nexstar{NexstarSerial, gps, rtcProvider};
-Bluetooth bluetooth(BluetoothSerial, BT_POWER_PIN, BT_AT_MODE_PIN);
+CommPortSelector commPort(USBSerial, isUSBConnected, BluetoothSerial, bluetooth, nexstar, events, settings);
 
 // Green: Nexstar; Blue: GPS
 
-int GPSStatusLeds[][LEDS_PATTERN_SIZE] = {
-    {1,0,0,0,0,0,0,0,0,0,0,0}, // NoFix, 1 blink
-    {1,0,1,0,0,0,0,0,0,0,0,0}, // Time Fix, 2 blinks
-    {1,0,1,0,1,0,0,0,0,0,0,0}, // Fix, 3 blinks
+const uint16_t GPSStatusLeds[] = {
+    LedPattern::OneBlink, // NoFix
+    LedPattern::TwoBlinks, // Time Fix
+    LedPattern::ThreeBlinks, // Fix
 };
 
-int NexstarStatusLeds[][LEDS_PATTERN_SIZE] = {
-    {0,0,0,0,0,0,0,0,0,0,0,0}, // NotConnected, 0 blink
-    {1,0,0,0,0,0,0,0,0,0,0,0}, // Connected, 1 blinks
-    {1,0,1,0,0,0,0,0,0,0,0,0}, // Time sync, 2 blinks
-    {1,0,1,0,1,0,0,0,0,0,0,0}, // Location sync, 3 blinks
+const uint16_t NexstarStatusLeds[] = {
+    LedPattern::Off, // NotConnected
+    LedPattern::OneBlink, // Connected
+    LedPattern::TwoBlinks, // Time sync
+    LedPattern::ThreeBlinks, // Location sync
 };
 
+// Set by the event handlers, checked by the gps_power task: the handlers run nested in
+// the publishers, the GPS is suspended from the main loop instead
+bool gpsPowerCheckPending = false;
 
-void setupLeds() {
-    pinMode(GPS_LED_PIN, OUTPUT);
-    pinMode(NEXSTAR_LED_PIN, OUTPUT);
-    digitalWrite(NEXSTAR_LED_PIN, 1);
-    digitalWrite(GPS_LED_PIN, 1);
-    delay(500);
-    digitalWrite(NEXSTAR_LED_PIN, 0);
-    digitalWrite(GPS_LED_PIN, 0);
+// Nothing left to do for the GPS once both RTC and telescope are synced.
+// It stays in backup mode until the next power cycle: the hand control is not synced again.
+void suspendGPSWhenSynced() {
+  if(!gpsPowerCheckPending) {
+    return;
+  }
+  gpsPowerCheckPending = false;
+#ifdef GPS_BACKUP_AFTER_SYNC
+  if(!gps.isSuspended() && rtcProvider.is_disciplined() && nexstar.status() == Nexstar::LocationSync) {
+    gps.sleep();
+    leds.set_gps(LedPattern::Off);
+  }
+#endif
 }
 
-void setup() {
-  setupLeds();
-  USBSerial.begin(9600);
-  Log.begin(LOG_LEVEL_VERBOSE, &LoggingPort);
-  bluetooth.setup();
-
-  TRACE("Initialising...");
-  gps.begin();
-  rtcProvider.setup();
+void onEvent(void *, EventBus::Event event, int value) {
+  switch(event) {
+    case EventBus::GPSTimeAcquired:
+      rtcProvider.discipline(gps.utc());
+      leds.set_gps(GPSStatusLeds[gps.status()]);
+      break;
+    case EventBus::GPSFixAcquired:
+    case EventBus::GPSFixLost:
+    case EventBus::GPSDataResumed:
+      leds.set_gps(GPSStatusLeds[gps.status()]);
+      break;
+    case EventBus::GPSNoData:
+      leds.set_gps(LedPattern::Error);
+      break;
+    case EventBus::NexstarStatusChanged:
+      leds.set_nexstar(NexstarStatusLeds[value]);
+      gpsPowerCheckPending = true;
+      break;
+    case EventBus::NexstarSyncStarted:
+      leds.set_nexstar(LedPattern::FastBlink);
+      break;
+    case EventBus::NexstarSyncFailed:
+      leds.set_nexstar(LedPattern::Error);
+      break;
+    case EventBus::RTCDisciplined:
+      gpsPowerCheckPending = true;
+      break;
+    default:
+      break;
+  }
 }
 
-int last_debug_print = 0;
-bool rtcUpdatedFromGPS = false;
+uint32_t lastDebugIterations = 0;
 
-void processRTC() {
-  if(gps.hasDateTime() && ! rtcUpdatedFromGPS) {
-    auto date = gps.date();
-    auto time = gps.time();
-    rtcProvider.set_time(date.year(), date.month(), date.day(), time.hour(), time.minute(), time.second());
-    rtcUpdatedFromGPS = true;
-  }
-  if(millis() - last_debug_print > 1000) {
-    last_debug_print = millis();
-    VERBOSE_F("[RTC] Time from RTC: valid=%T, %d", rtcProvider.is_valid(), rtcProvider.utc());
-    VERBOSE_F("[RTC] Time from TimeLib: %d", now());
+void debugPrint() {
+  VERBOSE_F("[RTC] Time from RTC: valid=%T, %d", rtcProvider.is_valid(), rtcProvider.utc());
+  VERBOSE_F("[RTC] Time from TimeLib: %d", now());
+  VERBOSE_F("[Loop] %d iterations", scheduler.iterations() - lastDebugIterations);
+  lastDebugIterations = scheduler.iterations();
+  for(uint8_t i = 0; i < scheduler.tasks_count(); i++) {
+    const Scheduler::Task &task = scheduler.task(i);
+    VERBOSE_F("[Loop] task %s: runs=%d, avg=%dus, max=%dus, missed=%d", task.name, task.runs, task.avg_runtime(), task.max_runtime, task.missed_deadlines);
   }
+  VERBOSE_F("[CommPort] %d switches, %d ms spent switching", commPort.switches(), commPort.switching_time());
+  VERBOSE_F("[Power] asleep %F%% of the time (%d sleeps)", power.sleep_fraction() * 100, power.sleeps());
+  gps.debug();
+#ifdef PROFILING
+  profiler.dump();
+#endif
+#ifdef LOG_TOKENIZED
+  VERBOSE_F("[Log] %d bytes pending, %d records dropped", logBuffer.pending(), logBuffer.dropped());
+#endif
 }
 
-int lastLedsWrite = 0;
-int lastLedsStatus = 0;
+#ifdef SERIAL_CAPTURE
+void drainCapture() {
+  serialCapture.drain(USBSerial, USBSerial, CAPTURE_DRAIN_BYTES);
+}
+#endif
 
+#ifdef LOG_TOKENIZED
+void drainLog() {
+  logBuffer.drain(LoggingPort, LOG_DRAIN_BYTES);
+}
+#endif
 
+void processGPS() {
+  gps.process();
+}
 
-void writeLeds() {
-  if(millis() - lastLedsWrite > LEDS_INTERVAL) {
-    lastLedsWrite = millis();
-    int currentIndex = lastLedsStatus++ % LEDS_PATTERN_SIZE;
-    analogWrite(GPS_LED_PIN, LEDS_PWM* GPSStatusLeds[gps.status()][currentIndex]); 
-    analogWrite(NEXSTAR_LED_PIN, LEDS_PWM* NexstarStatusLeds[nexstar.status()][currentIndex]); 
-  }
+void processNexstar() {
+  nexstar.process();
 }
 
-void check_commport() {
-  if(USBSerial) {
-    bluetooth.power_off();
-    nexstar.set_comm_port(&USBSerial);
-  } else {
-    bluetooth.power_on();
-    nexstar.set_comm_port(&BluetoothSerial);
+void processBluetooth() {
+  bluetooth.process();
+}
+
+void processCommPort() {
+  commPort.process();
+}
+
+struct TaskEntry {
+  const char *name;
+  Scheduler::TaskFunction function;
+  uint32_t period;
+  uint8_t priority;
+};
+
+// Higher priority first: passthrough latency matters the most
+const TaskEntry tasks[] = {
+  {"nexstar", processNexstar, 0, 4},
+  {"gps", processGPS, 0, 3},
+  {"commport", processCommPort, 0, 2},
+  {"bluetooth", processBluetooth, 0, 1},
+  {"gps_power", suspendGPSWhenSynced, 0, 1},
+#ifndef DISABLE_LOGGING
+  {"debug", debugPrint, DEBUG_INTERVAL, 0},
+#ifdef LOG_TOKENIZED
+  // Lowest priority: only uses what's left of the loop iteration
+  {"log", drainLog, 0, 0},
+#endif
+#endif
+#ifdef SERIAL_CAPTURE
+  {"capture", drainCapture, 0, 0},
+#endif
+};
+// Scheduler::add() would leave the extra tasks out
+static_assert(sizeof(tasks) / sizeof(tasks[0]) <= SCHEDULER_MAX_TASKS, "Too many tasks for SCHEDULER_MAX_TASKS");
+
+void setup() {
+  settings.load();
+  events.subscribe(
+    EventBus::mask(EventBus::GPSTimeAcquired) | EventBus::mask(EventBus::GPSFixAcquired) | EventBus::mask(EventBus::GPSFixLost) | EventBus::mask(EventBus::GPSNoData) | EventBus::mask(EventBus::GPSDataResumed) |
+    EventBus::mask(EventBus::NexstarStatusChanged) | EventBus::mask(EventBus::NexstarSyncStarted) | EventBus::mask(EventBus::NexstarSyncFailed) |
+    EventBus::mask(EventBus::RTCDisciplined),
+    onEvent
+  );
+  profiler.begin();
+#ifdef SERIAL_CAPTURE
+  serialCapture.set_port(SerialCapture::GPSPort, GPSSerial);
+  serialCapture.set_port(SerialCapture::NexstarPort, NexstarSerial);
+  serialCapture.set_port(SerialCapture::USBPort, USBSerial);
+  serialCapture.set_port(SerialCapture::BluetoothPort, BluetoothSerial);
+#endif
+  leds.setup();
+  leds.set_gps(GPSStatusLeds[GPS::NoFix]);
+  leds.set_nexstar(NexstarStatusLeds[Nexstar::NotConnected]);
+  USBSerial.begin(9600);
+  Log.begin(settings.values().log_level, &LoggingPort);
+#ifdef LOG_TOKENIZED
+  logBuffer.set_level(settings.values().log_level);
+#endif
+  bluetooth.setup();
+
+  TRACE("Initialising...");
+  gps.begin();
+  rtcProvider.setup();
+
+  for(const TaskEntry &task : tasks) {
+    scheduler.add(task.name, task.function, task.period, task.priority);
   }
+
+  power.add_wake_source(&GPSSerial);
+  power.add_wake_source(&NexstarSerial);
+  power.add_wake_source(&USBSerial);
+  power.add_wake_source(&BluetoothSerial);
+  power.reset_stats();
 }
 
 void loop() {
-  check_commport();
-  processRTC();
-  gps.process();
-  nexstar.process();
-  writeLeds();
+  scheduler.run();
+  power.idle();
 }
 
 // vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
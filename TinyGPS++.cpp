@@ -34,6 +34,13 @@ Added Neo-M8N support by Andreas Spiess
 #define _GPGGAterm   "GPGGA"
 #define _GNRMCterm   "GNRMC"
 #define _GNGGAterm   "GNGGA"
+#define _GSAterm     "GSA"
+#define _GSVterm     "GSV"
+#define _ZDAterm     "ZDA"
+
+#define ZDA_TIME_TERMS (1 << 1)
+#define ZDA_DATE_TERMS ((1 << 2) | (1 << 3) | (1 << 4))
+#define ZDA_ZONE_TERMS ((1 << 5) | (1 << 6))
 
 TinyGPSPlus::TinyGPSPlus()
   :  parity(0)
@@ -41,14 +48,27 @@ TinyGPSPlus::TinyGPSPlus()
   ,  curSentenceType(GPS_SENTENCE_OTHER)
   ,  curTermNumber(0)
   ,  curTermOffset(0)
+  ,  sentenceSize(0)
+  ,  discardSentence(true)
   ,  sentenceHasFix(false)
+  ,  curTalker(GPS_CONSTELLATION_UNKNOWN)
+  ,  curSystemId(0)
+  ,  curDateTimeTerms(0)
+  ,  sentenceArrivalTime(0)
   ,  customElts(0)
   ,  customCandidates(0)
+  ,  customFieldsHandler(0)
+  ,  customFieldsContext(0)
+  ,  curSentenceHash(0)
+  ,  customFieldsSentence(false)
   ,  encodedCharCount(0)
   ,  sentencesWithFixCount(0)
   ,  failedChecksumCount(0)
   ,  passedChecksumCount(0)
 {
+#ifdef TINYGPS_LAZY_DECODE
+  term = sentence;
+#endif
   term[0] = '\0';
 }
 
@@ -57,9 +77,42 @@ TinyGPSPlus::TinyGPSPlus()
 //
 
 bool TinyGPSPlus::encode(char c)
+{
+  return encode(c, c == '$' ? millis() : sentenceArrivalTime);
+}
+
+// Work per character is bounded: malformed sentences (too long, too many terms,
+// overlong terms, control characters) are dropped as soon as detected, and
+// everything up to the next '$' is then skipped in constant time.
+bool TinyGPSPlus::encode(char c, uint32_t arrivalTime)
 {
   ++encodedCharCount;
 
+  if (c == '$') // sentence begin
+  {
+    curTermNumber = curTermOffset = 0;
+    parity = 0;
+    curSentenceType = GPS_SENTENCE_OTHER;
+    isChecksumTerm = false;
+    sentenceHasFix = false;
+    sentenceArrivalTime = arrivalTime;
+    sentenceSize = 1;
+    discardSentence = false;
+#ifdef TINYGPS_LAZY_DECODE
+    term = sentence;
+#endif
+    return false;
+  }
+
+  if (discardSentence)
+    return false;
+
+  if (++sentenceSize > _GPS_MAX_SENTENCE_SIZE)
+  {
+    discardSentence = true;
+    return false;
+  }
+
   switch(c)
   {
   case ',': // term terminators
@@ -68,49 +121,99 @@ bool TinyGPSPlus::encode(char c)
   case '\n':
   case '*':
     {
-      bool isValidSentence = false;
-      if (curTermOffset < sizeof(term))
+      term[curTermOffset] = 0;
+      bool isValidSentence = endOfTermHandler();
+      if (isValidSentence || isChecksumTerm || curTermNumber >= _GPS_MAX_TERMS)
       {
-        term[curTermOffset] = 0;
-        isValidSentence = endOfTermHandler();
+        // Nothing more to parse in this sentence
+        discardSentence = true;
+        return isValidSentence;
       }
       ++curTermNumber;
+#ifdef TINYGPS_LAZY_DECODE
+      // Sentences are never longer than the buffer: it holds the previous terms too
+      term += curTermOffset + 1;
+#endif
       curTermOffset = 0;
       isChecksumTerm = c == '*';
-      return isValidSentence;
+      return false;
     }
-    break;
-
-  case '$': // sentence begin
-    curTermNumber = curTermOffset = 0;
-    parity = 0;
-    curSentenceType = GPS_SENTENCE_OTHER;
-    isChecksumTerm = false;
-    sentenceHasFix = false;
-    return false;
 
   default: // ordinary characters
-    if (curTermOffset < sizeof(term) - 1)
-      term[curTermOffset++] = c;
+    if (curTermOffset >= _GPS_MAX_FIELD_SIZE - 1 || c < ' ' || c > '~')
+    {
+      discardSentence = true;
+      return false;
+    }
+    term[curTermOffset++] = c;
     if (!isChecksumTerm)
       parity ^= c;
     return false;
   }
-
-  return false;
 }
 
 //
 // internal utilities
 //
+// -1 if not an hex digit
 int TinyGPSPlus::fromHex(char a)
 {
   if (a >= 'A' && a <= 'F')
     return a - 'A' + 10;
   else if (a >= 'a' && a <= 'f')
     return a - 'a' + 10;
-  else
+  else if (a >= '0' && a <= '9')
     return a - '0';
+  else
+    return -1;
+}
+
+// static
+// Constellation from the two letters talker ID of a sentence name
+uint8_t TinyGPSPlus::talkerConstellation(const char *talker)
+{
+  switch(talker[0])
+  {
+  case 'G':
+    switch(talker[1])
+    {
+    case 'P': return GPS_CONSTELLATION_GPS;
+    case 'L': return GPS_CONSTELLATION_GLONASS;
+    case 'A': return GPS_CONSTELLATION_GALILEO;
+    case 'B': return GPS_CONSTELLATION_BEIDOU;
+    case 'Q': return GPS_CONSTELLATION_QZSS;
+    case 'N': return GPS_CONSTELLATION_MIXED;
+    }
+    break;
+  case 'B':
+    if (talker[1] == 'D') return GPS_CONSTELLATION_BEIDOU;
+    break;
+  case 'Q':
+    if (talker[1] == 'Z') return GPS_CONSTELLATION_QZSS;
+    break;
+  }
+  return GPS_CONSTELLATION_UNKNOWN;
+}
+
+// Unsigned number of up to maxDigits digits, further digits are skipped (up to the field size)
+static uint32_t parseDigits(const char *&term, uint8_t maxDigits)
+{
+  const char *end = term + _GPS_MAX_FIELD_SIZE;
+  uint32_t value = 0;
+  for (uint8_t digits = 0; term < end && isdigit(*term); ++term)
+    if (digits++ < maxDigits)
+      value = value * 10 + (*term - '0');
+  return value;
+}
+
+// static
+// Parse a (potentially negative) integer, without overflows (atol is undefined on them)
+int32_t TinyGPSPlus::parseInteger(const char *term)
+{
+  bool negative = *term == '-';
+  if (negative) ++term;
+  int32_t ret = (int32_t)parseDigits(term, 9);
+  return negative ? -ret : ret;
 }
 
 // static
@@ -119,8 +222,7 @@ int32_t TinyGPSPlus::parseDecimal(const char *term)
 {
   bool negative = *term == '-';
   if (negative) ++term;
-  int32_t ret = 100 * (int32_t)atol(term);
-  while (isdigit(*term)) ++term;
+  int32_t ret = 100 * (int32_t)parseDigits(term, 7);
   if (*term == '.' && isdigit(term[1]))
   {
     ret += 10 * (term[1] - '0');
@@ -134,18 +236,16 @@ int32_t TinyGPSPlus::parseDecimal(const char *term)
 // Parse degrees in that funny NMEA format DDMM.MMMM
 void TinyGPSPlus::parseDegrees(const char *term, RawDegrees &deg)
 {
-  uint32_t leftOfDecimal = (uint32_t)atol(term);
+  uint32_t leftOfDecimal = parseDigits(term, 9);
   uint16_t minutes = (uint16_t)(leftOfDecimal % 100);
   uint32_t multiplier = 10000000UL;
   uint32_t tenMillionthsOfMinutes = minutes * multiplier;
 
   deg.deg = (int16_t)(leftOfDecimal / 100);
 
-  while (isdigit(*term))
-    ++term;
-
+  // Digits past the ten millionths don't add anything
   if (*term == '.')
-    while (isdigit(*++term))
+    for (uint8_t digits = 0; digits < 7 && isdigit(*++term); ++digits)
     {
       multiplier /= 10;
       tenMillionthsOfMinutes += (*term - '0') * multiplier;
@@ -164,8 +264,9 @@ bool TinyGPSPlus::endOfTermHandler()
   // If it's the checksum term, and the checksum checks out, commit
   if (isChecksumTerm)
   {
-    byte checksum = 16 * fromHex(term[0]) + fromHex(term[1]);
-    if (checksum == parity)
+    int high = fromHex(term[0]);
+    int low = high >= 0 ? fromHex(term[1]) : -1;
+    if (low >= 0 && term[2] == 0 && 16 * high + low == parity)
     {
       passedChecksumCount++;
       if (sentenceHasFix)
@@ -176,6 +277,7 @@ bool TinyGPSPlus::endOfTermHandler()
       case GPS_SENTENCE_GPRMC:
         date.commit();
         time.commit();
+        time.arrivalTime = sentenceArrivalTime;
         if (sentenceHasFix)
         {
            location.commit();
@@ -185,6 +287,7 @@ bool TinyGPSPlus::endOfTermHandler()
         break;
       case GPS_SENTENCE_GPGGA:
         time.commit();
+        time.arrivalTime = sentenceArrivalTime;
         if (sentenceHasFix)
         {
           location.commit();
@@ -193,11 +296,34 @@ bool TinyGPSPlus::endOfTermHandler()
         satellites.commit();
         hdop.commit();
         break;
+      case GPS_SENTENCE_GSA:
+        fixType.commit();
+        pdop.commit();
+        vdop.commit();
+        satelliteTable.commitUsed(curTalker, curSystemId);
+        break;
+      case GPS_SENTENCE_GSV:
+        satelliteTable.commitInView(curTalker, curTermNumber - 1);
+        break;
+      case GPS_SENTENCE_ZDA:
+        // Receivers send empty ZDA terms until they know the time
+        if (curDateTimeTerms & ZDA_TIME_TERMS)
+        {
+          time.commit();
+          time.arrivalTime = sentenceArrivalTime;
+        }
+        if ((curDateTimeTerms & ZDA_DATE_TERMS) == ZDA_DATE_TERMS)
+          date.commit();
+        if (curDateTimeTerms & ZDA_ZONE_TERMS)
+          localZone.commit();
+        break;
       }
 
       // Commit all custom listeners of this sentence type
       for (TinyGPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0; p = p->next)
          p->commit();
+      if (customFieldsSentence)
+         customFieldsHandler(customFieldsContext, curSentenceHash, curTermNumber, NULL);
       return true;
     }
 
@@ -216,14 +342,46 @@ bool TinyGPSPlus::endOfTermHandler()
       curSentenceType = GPS_SENTENCE_GPRMC;
     else if (!(strcmp(term, _GPGGAterm) && strcmp(term, _GNGGAterm)))
       curSentenceType = GPS_SENTENCE_GPGGA;
+    else if (term[0] && term[1] && !strcmp(term + 2, _GSAterm))
+      curSentenceType = GPS_SENTENCE_GSA;
+    else if (term[0] && term[1] && !strcmp(term + 2, _GSVterm))
+      curSentenceType = GPS_SENTENCE_GSV;
+    else if (term[0] && term[1] && !strcmp(term + 2, _ZDAterm))
+      curSentenceType = GPS_SENTENCE_ZDA;
     else
       curSentenceType = GPS_SENTENCE_OTHER;
 
+    if (curSentenceType == GPS_SENTENCE_GSA || curSentenceType == GPS_SENTENCE_GSV)
+    {
+      curTalker = talkerConstellation(term);
+      curSystemId = 0;
+      satelliteTable.beginSentence();
+    }
+    curDateTimeTerms = 0;
+#ifdef TINYGPS_LAZY_DECODE
+    location.beginSentence();
+    speed.beginSentence();
+    course.beginSentence();
+    altitude.beginSentence();
+    satellites.beginSentence();
+    hdop.beginSentence();
+    fixType.beginSentence();
+    pdop.beginSentence();
+    vdop.beginSentence();
+#endif
+
     // Any custom candidates of this sentence type?
     for (customCandidates = customElts; customCandidates != NULL && strcmp(customCandidates->sentenceName, term) < 0; customCandidates = customCandidates->next);
     if (customCandidates != NULL && strcmp(customCandidates->sentenceName, term) > 0)
        customCandidates = NULL;
 
+    customFieldsSentence = false;
+    if (customFieldsHandler)
+    {
+      curSentenceHash = sentenceHash(term);
+      customFieldsSentence = customFieldsHandler(customFieldsContext, curSentenceHash, 0, term);
+    }
+
     return false;
   }
 
@@ -274,12 +432,56 @@ bool TinyGPSPlus::endOfTermHandler()
     case COMBINE(GPS_SENTENCE_GPGGA, 9): // Altitude (GPGGA)
       altitude.set(term);
       break;
+    case COMBINE(GPS_SENTENCE_GSA, 2): // Fix type (GSA)
+      fixType.set(term);
+      break;
+    case COMBINE(GPS_SENTENCE_GSA, 15): // PDOP (GSA)
+      pdop.set(term);
+      break;
+    case COMBINE(GPS_SENTENCE_GSA, 17): // VDOP (GSA)
+      vdop.set(term);
+      break;
+    case COMBINE(GPS_SENTENCE_GSA, 18): // System ID (GSA, NMEA 4.1+)
+      curSystemId = (uint8_t)parseInteger(term);
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 1): // Time (ZDA)
+      time.setTime(term);
+      curDateTimeTerms |= ZDA_TIME_TERMS;
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 2): // Day (ZDA)
+      date.setDay(term);
+      curDateTimeTerms |= 1 << 2;
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 3): // Month (ZDA)
+      date.setMonth(term);
+      curDateTimeTerms |= 1 << 3;
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 4): // Year (ZDA)
+      date.setYear(term);
+      curDateTimeTerms |= 1 << 4;
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 5): // Local zone hours (ZDA)
+      localZone.setHours(term);
+      curDateTimeTerms |= 1 << 5;
+      break;
+    case COMBINE(GPS_SENTENCE_ZDA, 6): // Local zone minutes (ZDA)
+      localZone.setMinutes(term);
+      curDateTimeTerms |= 1 << 6;
+      break;
+    default:
+      if (curSentenceType == GPS_SENTENCE_GSA && curTermNumber >= 3 && curTermNumber <= 14) // PRNs used in fix
+        satelliteTable.setUsedTerm(curTermNumber, term);
+      else if (curSentenceType == GPS_SENTENCE_GSV && curTermNumber >= 4) // PRN, elevation, azimuth, SNR
+        satelliteTable.setSatelliteTerm(curTermNumber, term);
+      break;
   }
 
   // Set custom values as needed
   for (TinyGPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0 && p->termNumber <= curTermNumber; p = p->next)
     if (p->termNumber == curTermNumber)
          p->set(term);
+  if (customFieldsSentence)
+    customFieldsHandler(customFieldsContext, curSentenceHash, curTermNumber, term);
 
   return false;
 }
@@ -337,6 +539,42 @@ const char *TinyGPSPlus::cardinal(double course)
   return directions[direction % 16];
 }
 
+#ifdef TINYGPS_LAZY_DECODE
+// Terms are at most _GPS_MAX_FIELD_SIZE - 1 characters long
+void TinyGPSLocation::commit()
+{
+   if (newLatTerm)
+      strcpy(latTerm, newLatTerm);
+   if (newLngTerm)
+      strcpy(lngTerm, newLngTerm);
+   rawLatData.negative = rawNewLatData.negative;
+   rawLngData.negative = rawNewLngData.negative;
+   decoded = false;
+   lastCommitTime = millis();
+   valid = updated = true;
+}
+
+void TinyGPSLocation::setLatitude(const char *term)
+{
+   newLatTerm = term;
+}
+
+void TinyGPSLocation::setLongitude(const char *term)
+{
+   newLngTerm = term;
+}
+
+void TinyGPSLocation::decode()
+{
+   // The hemispheres are set with the other terms
+   bool latNegative = rawLatData.negative, lngNegative = rawLngData.negative;
+   TinyGPSPlus::parseDegrees(latTerm, rawLatData);
+   TinyGPSPlus::parseDegrees(lngTerm, rawLngData);
+   rawLatData.negative = latNegative;
+   rawLngData.negative = lngNegative;
+   decoded = true;
+}
+#else
 void TinyGPSLocation::commit()
 {
    rawLatData = rawNewLatData;
@@ -354,10 +592,14 @@ void TinyGPSLocation::setLongitude(const char *term)
 {
    TinyGPSPlus::parseDegrees(term, rawNewLngData);
 }
+#endif
 
 double TinyGPSLocation::lat()
 {
    updated = false;
+#ifdef TINYGPS_LAZY_DECODE
+   if (!decoded) decode();
+#endif
    double ret = rawLatData.deg + rawLatData.billionths / 1000000000.0;
    return rawLatData.negative ? -ret : ret;
 }
@@ -365,6 +607,9 @@ double TinyGPSLocation::lat()
 double TinyGPSLocation::lng()
 {
    updated = false;
+#ifdef TINYGPS_LAZY_DECODE
+   if (!decoded) decode();
+#endif
    double ret = rawLngData.deg + rawLngData.billionths / 1000000000.0;
    return rawLngData.negative ? -ret : ret;
 }
@@ -390,7 +635,41 @@ void TinyGPSTime::setTime(const char *term)
 
 void TinyGPSDate::setDate(const char *term)
 {
-   newDate = atol(term);
+   newDate = TinyGPSPlus::parseInteger(term);
+}
+
+// ZDA sends day, month and 4 digits year as separate terms: keep the ddmmyy layout
+void TinyGPSDate::setDay(const char *term)
+{
+   newDate = newDate % 10000 + TinyGPSPlus::parseInteger(term) % 100 * 10000;
+}
+
+void TinyGPSDate::setMonth(const char *term)
+{
+   newDate = newDate / 10000 * 10000 + TinyGPSPlus::parseInteger(term) % 100 * 100 + newDate % 100;
+}
+
+void TinyGPSDate::setYear(const char *term)
+{
+   newDate = newDate / 100 * 100 + TinyGPSPlus::parseInteger(term) % 100;
+}
+
+void TinyGPSLocalZone::commit()
+{
+   zoneHours = newZoneHours;
+   zoneMinutes = newZoneMinutes;
+   lastCommitTime = millis();
+   valid = updated = true;
+}
+
+void TinyGPSLocalZone::setHours(const char *term)
+{
+   newZoneHours = (int8_t)TinyGPSPlus::parseInteger(term);
+}
+
+void TinyGPSLocalZone::setMinutes(const char *term)
+{
+   newZoneMinutes = (uint8_t)TinyGPSPlus::parseInteger(term);
 }
 
 uint16_t TinyGPSDate::year()
@@ -436,6 +715,51 @@ uint8_t TinyGPSTime::centisecond()
    return time % 100;
 }
 
+#ifdef TINYGPS_LAZY_DECODE
+void TinyGPSDecimal::commit()
+{
+   if (newTerm)
+   {
+      strcpy(rawTerm, newTerm);
+      decoded = false;
+   }
+   lastCommitTime = millis();
+   valid = updated = true;
+}
+
+void TinyGPSDecimal::set(const char *term)
+{
+   newTerm = term;
+}
+
+void TinyGPSDecimal::decode()
+{
+   val = TinyGPSPlus::parseDecimal(rawTerm);
+   decoded = true;
+}
+
+void TinyGPSInteger::commit()
+{
+   if (newTerm)
+   {
+      strcpy(rawTerm, newTerm);
+      decoded = false;
+   }
+   lastCommitTime = millis();
+   valid = updated = true;
+}
+
+void TinyGPSInteger::set(const char *term)
+{
+   newTerm = term;
+}
+
+void TinyGPSInteger::decode()
+{
+   val = TinyGPSPlus::parseInteger(rawTerm);
+   decoded = true;
+}
+#else
 void TinyGPSDecimal::commit()
 {
    val = newval;
@@ -457,7 +781,182 @@ void TinyGPSInteger::commit()
 
 void TinyGPSInteger::set(const char *term)
 {
-   newval = atol(term);
+   newval = TinyGPSPlus::parseInteger(term);
+}
+#endif
+
+// Refine the talker constellation by PRN, for GPS and GN talkers mixing several systems
+static uint8_t satelliteConstellation(uint8_t talker, uint16_t prn)
+{
+   if (talker != GPS_CONSTELLATION_GPS && talker != GPS_CONSTELLATION_MIXED)
+      return talker;
+   if (prn >= 1 && prn <= 32)
+      return GPS_CONSTELLATION_GPS;
+   if ((prn >= 33 && prn <= 64) || (prn >= 120 && prn <= 158))
+      return GPS_CONSTELLATION_SBAS;
+   if (prn >= 65 && prn <= 96)
+      return GPS_CONSTELLATION_GLONASS;
+   if (prn >= 193 && prn <= 200)
+      return GPS_CONSTELLATION_QZSS;
+   if ((prn >= 201 && prn <= 237) || (prn >= 401 && prn <= 437))
+      return GPS_CONSTELLATION_BEIDOU;
+   if (prn >= 301 && prn <= 336)
+      return GPS_CONSTELLATION_GALILEO;
+   return talker;
+}
+
+// NMEA 4.1 GSA system IDs
+static uint8_t systemIdConstellation(uint8_t systemId)
+{
+   switch (systemId)
+   {
+   case 1: return GPS_CONSTELLATION_GPS;
+   case 2: return GPS_CONSTELLATION_GLONASS;
+   case 3: return GPS_CONSTELLATION_GALILEO;
+   case 4: return GPS_CONSTELLATION_BEIDOU;
+   case 5: return GPS_CONSTELLATION_QZSS;
+   }
+   return GPS_CONSTELLATION_UNKNOWN;
+}
+
+uint8_t TinyGPSSatelliteTable::usedCount() const
+{
+   uint8_t count = 0;
+   for (uint32_t mask = usedMask; mask; mask &= mask - 1)
+      ++count;
+   return count;
+}
+
+void TinyGPSSatelliteTable::beginSentence()
+{
+   newCount = 0;
+   newUsedCount = 0;
+   memset(newPrns, 0, sizeof(newPrns));
+   memset(newElevations, 0, sizeof(newElevations));
+   memset(newAzimuths, 0, sizeof(newAzimuths));
+   memset(newSnrs, 0, sizeof(newSnrs));
+}
+
+void TinyGPSSatelliteTable::setSatelliteTerm(uint8_t termNumber, const char *term)
+{
+   uint8_t index = (termNumber - 4) / 4;
+   if (index >= 4)
+      return;
+   switch ((termNumber - 4) % 4)
+   {
+   case 0:
+      newPrns[index] = (uint16_t)TinyGPSPlus::parseInteger(term);
+      if (index >= newCount)
+         newCount = index + 1;
+      break;
+   case 1:
+      newElevations[index] = (int8_t)TinyGPSPlus::parseInteger(term);
+      break;
+   case 2:
+      newAzimuths[index] = (uint16_t)TinyGPSPlus::parseInteger(term);
+      break;
+   case 3:
+      newSnrs[index] = (uint8_t)TinyGPSPlus::parseInteger(term);
+      break;
+   }
+}
+
+void TinyGPSSatelliteTable::setUsedTerm(uint8_t termNumber, const char *term)
+{
+   if (newUsedCount < sizeof(newUsedPrns) / sizeof(newUsedPrns[0]))
+      newUsedPrns[newUsedCount++] = (uint16_t)TinyGPSPlus::parseInteger(term);
+}
+
+int TinyGPSSatelliteTable::find(uint8_t constellation, uint16_t prn) const
+{
+   for (uint8_t i = 0; i < size; ++i)
+      if (prns[i] == prn && constellations[i] == constellation)
+         return i;
+   return -1;
+}
+
+void TinyGPSSatelliteTable::remove(uint8_t i)
+{
+   uint8_t last = --size;
+   if (i != last)
+   {
+      prns[i] = prns[last];
+      constellations[i] = constellations[last];
+      elevations[i] = elevations[last];
+      azimuths[i] = azimuths[last];
+      snrs[i] = snrs[last];
+      lastSeen[i] = lastSeen[last];
+      if (usedMask & (1UL << last))
+         usedMask |= 1UL << i;
+      else
+         usedMask &= ~(1UL << i);
+   }
+   usedMask &= ~(1UL << last);
+}
+
+void TinyGPSSatelliteTable::commitInView(uint8_t talker, uint8_t lastTermNumber)
+{
+   uint8_t count = newCount;
+   // NMEA 4.1 appends a signal ID after the last satellite: don't mistake it for a PRN
+   if (lastTermNumber >= 4 && (lastTermNumber - 4) % 4 == 0 && count > (lastTermNumber - 4) / 4)
+      count = (lastTermNumber - 4) / 4;
+
+   uint32_t now = millis();
+   for (uint8_t n = 0; n < count; ++n)
+   {
+      if (newPrns[n] == 0)
+         continue;
+      uint8_t constellation = satelliteConstellation(talker, newPrns[n]);
+      int i = find(constellation, newPrns[n]);
+      if (i < 0)
+      {
+         if (size >= _GPS_MAX_SATELLITES)
+            continue;
+         i = size++;
+         prns[i] = newPrns[n];
+         constellations[i] = constellation;
+         usedMask &= ~(1UL << i);
+      }
+      elevations[i] = newElevations[n];
+      azimuths[i] = newAzimuths[n];
+      snrs[i] = newSnrs[n];
+      lastSeen[i] = now;
+   }
+
+   for (uint8_t i = size; i > 0; --i)
+      if (now - lastSeen[i - 1] > _GPS_SATELLITE_TIMEOUT)
+         remove(i - 1);
+
+   lastCommitTime = now;
+   valid = true;
+}
+
+void TinyGPSSatelliteTable::commitUsed(uint8_t talker, uint8_t systemId)
+{
+   uint8_t constellation = systemId ? systemIdConstellation(systemId) : talker;
+
+   // Constellations this sentence reports on: their previous used flags are stale
+   uint8_t reported = 0;
+   if (constellation != GPS_CONSTELLATION_MIXED && constellation != GPS_CONSTELLATION_UNKNOWN)
+      reported |= 1 << constellation;
+   if (constellation == GPS_CONSTELLATION_GPS)
+      reported |= 1 << GPS_CONSTELLATION_SBAS;
+   for (uint8_t n = 0; n < newUsedCount; ++n)
+      reported |= 1 << satelliteConstellation(constellation, newUsedPrns[n]);
+
+   for (uint8_t i = 0; i < size; ++i)
+      if (reported & (1 << constellations[i]))
+         usedMask &= ~(1UL << i);
+
+   for (uint8_t n = 0; n < newUsedCount; ++n)
+   {
+      int i = find(satelliteConstellation(constellation, newUsedPrns[n]), newUsedPrns[n]);
+      if (i >= 0)
+         usedMask |= 1UL << i;
+   }
+
+   lastCommitTime = millis();
+   valid = true;
 }
 
 TinyGPSCustom::TinyGPSCustom(TinyGPSPlus &gps, const char *_sentenceName, int _termNumber)
@@ -467,17 +966,22 @@ TinyGPSCustom::TinyGPSCustom(TinyGPSPlus &gps, const char *_sentenceName, int _t
 
 void TinyGPSCustom::begin(TinyGPSPlus &gps, const char *_sentenceName, int _termNumber)
 {
-   lastCommitTime = 0;
-   updated = valid = false;
+   clear();
    sentenceName = _sentenceName;
    termNumber = _termNumber;
-   memset(stagingBuffer, '\0', sizeof(stagingBuffer));
-   memset(buffer, '\0', sizeof(buffer));
 
    // Insert this item into the GPS tree
    gps.insertCustom(this, _sentenceName, _termNumber);
 }
 
+void TinyGPSCustom::clear()
+{
+   lastCommitTime = 0;
+   updated = valid = false;
+   memset(stagingBuffer, '\0', sizeof(stagingBuffer));
+   memset(buffer, '\0', sizeof(buffer));
+}
+
 void TinyGPSCustom::commit()
 {
    strcpy(this->buffer, this->stagingBuffer);
@@ -487,7 +991,14 @@ void TinyGPSCustom::commit()
 
 void TinyGPSCustom::set(const char *term)
 {
-   strncpy(this->stagingBuffer, term, sizeof(this->stagingBuffer));
+   strncpy(this->stagingBuffer, term, sizeof(this->stagingBuffer) - 1);
+   this->stagingBuffer[sizeof(this->stagingBuffer) - 1] = '\0';
+}
+
+void TinyGPSPlus::setCustomFieldsHandler(CustomFieldsHandler handler, void *context)
+{
+   customFieldsHandler = handler;
+   customFieldsContext = context;
 }
 
 void TinyGPSPlus::insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int termNumber)
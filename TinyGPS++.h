@@ -30,6 +30,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "WProgram.h"
 #endif
 #include <limits.h>
+#include <string.h>
+#include "defines.h"
 
 #define _GPS_VERSION "0.92" // software version of this library
 #define _GPS_MPH_PER_KNOT 1.15077945
@@ -39,6 +41,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define _GPS_KM_PER_METER 0.001
 #define _GPS_FEET_PER_METER 3.2808399
 #define _GPS_MAX_FIELD_SIZE 15
+#define _GPS_MAX_SENTENCE_SIZE 82 // NMEA 0183 limit, from '$' to the line feed
+#define _GPS_MAX_TERMS 31 // term numbers must fit in the 5 bits of COMBINE
+#define _GPS_MAX_SATELLITES 32 // must fit in the 32 bits of TinyGPSSatelliteTable masks
+#define _GPS_SATELLITE_TIMEOUT 5000 // ms without GSV updates before a satellite is dropped
 
 struct RawDegrees
 {
@@ -57,18 +63,36 @@ public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
    uint32_t age() const    { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+#ifdef TINYGPS_LAZY_DECODE
+   const RawDegrees &rawLat()     { updated = false; if (!decoded) decode(); return rawLatData; }
+   const RawDegrees &rawLng()     { updated = false; if (!decoded) decode(); return rawLngData; }
+#else
    const RawDegrees &rawLat()     { updated = false; return rawLatData; }
    const RawDegrees &rawLng()     { updated = false; return rawLngData; }
+#endif
    double lat();
    double lng();
 
+#ifdef TINYGPS_LAZY_DECODE
+   TinyGPSLocation() : valid(false), updated(false), decoded(true), newLatTerm(NULL), newLngTerm(NULL)
+   {}
+#else
    TinyGPSLocation() : valid(false), updated(false)
    {}
+#endif
 
 private:
    bool valid, updated;
    RawDegrees rawLatData, rawLngData, rawNewLatData, rawNewLngData;
    uint32_t lastCommitTime;
+#ifdef TINYGPS_LAZY_DECODE
+   // Terms are kept as received, and parsed on first access
+   bool decoded;
+   const char *newLatTerm, *newLngTerm; // in the sentence being parsed
+   char latTerm[_GPS_MAX_FIELD_SIZE], lngTerm[_GPS_MAX_FIELD_SIZE];
+   void beginSentence() { newLatTerm = newLngTerm = NULL; }
+   void decode();
+#endif
    void commit();
    void setLatitude(const char *term);
    void setLongitude(const char *term);
@@ -96,6 +120,9 @@ private:
    uint32_t lastCommitTime;
    void commit();
    void setDate(const char *term);
+   void setDay(const char *term);
+   void setMonth(const char *term);
+   void setYear(const char *term);
 };
 
 struct TinyGPSTime
@@ -111,18 +138,48 @@ public:
    uint8_t minute();
    uint8_t second();
    uint8_t centisecond();
+   // millis() at the reception of the first byte of the sentence carrying this time
+   uint32_t arrivalMillis() const { return arrivalTime; }
 
-   TinyGPSTime() : valid(false), updated(false), time(0)
+   TinyGPSTime() : valid(false), updated(false), time(0), arrivalTime(0)
    {}
 
 private:
    bool valid, updated;
    uint32_t time, newTime;
    uint32_t lastCommitTime;
+   uint32_t arrivalTime;
    void commit();
    void setTime(const char *term);
 };
 
+struct TinyGPSLocalZone
+{
+   friend class TinyGPSPlus;
+public:
+   bool isValid() const       { return valid; }
+   bool isUpdated() const     { return updated; }
+   uint32_t age() const       { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+
+   int8_t hours()             { updated = false; return zoneHours; }
+   uint8_t minutes()          { updated = false; return zoneMinutes; }
+   int16_t offsetMinutes()    { updated = false; return zoneHours * 60 + (zoneHours < 0 ? -zoneMinutes : zoneMinutes); }
+
+   TinyGPSLocalZone() : valid(false), updated(false), zoneHours(0), zoneMinutes(0), newZoneHours(0), newZoneMinutes(0)
+   {}
+
+private:
+   bool valid, updated;
+   int8_t zoneHours;
+   uint8_t zoneMinutes;
+   int8_t newZoneHours;
+   uint8_t newZoneMinutes;
+   uint32_t lastCommitTime;
+   void commit();
+   void setHours(const char *term);
+   void setMinutes(const char *term);
+};
+
 struct TinyGPSDecimal
 {
    friend class TinyGPSPlus;
@@ -130,15 +187,29 @@ public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
    uint32_t age() const    { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+#ifdef TINYGPS_LAZY_DECODE
+   int32_t value()         { updated = false; if (!decoded) decode(); return val; }
+
+   TinyGPSDecimal() : valid(false), updated(false), val(0), decoded(true), newTerm(NULL)
+   {}
+#else
    int32_t value()         { updated = false; return val; }
 
    TinyGPSDecimal() : valid(false), updated(false), val(0)
    {}
+#endif
 
 private:
    bool valid, updated;
    uint32_t lastCommitTime;
    int32_t val, newval;
+#ifdef TINYGPS_LAZY_DECODE
+   bool decoded;
+   const char *newTerm; // in the sentence being parsed
+   char rawTerm[_GPS_MAX_FIELD_SIZE];
+   void beginSentence() { newTerm = NULL; }
+   void decode();
+#endif
    void commit();
    void set(const char *term);
 };
@@ -150,15 +221,29 @@ public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
    uint32_t age() const    { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+#ifdef TINYGPS_LAZY_DECODE
+   uint32_t value()        { updated = false; if (!decoded) decode(); return val; }
+
+   TinyGPSInteger() : valid(false), updated(false), val(0), decoded(true), newTerm(NULL)
+   {}
+#else
    uint32_t value()        { updated = false; return val; }
 
    TinyGPSInteger() : valid(false), updated(false), val(0)
    {}
+#endif
 
 private:
    bool valid, updated;
    uint32_t lastCommitTime;
    uint32_t val, newval;
+#ifdef TINYGPS_LAZY_DECODE
+   bool decoded;
+   const char *newTerm; // in the sentence being parsed
+   char rawTerm[_GPS_MAX_FIELD_SIZE];
+   void beginSentence() { newTerm = NULL; }
+   void decode();
+#endif
    void commit();
    void set(const char *term);
 };
@@ -184,7 +269,72 @@ struct TinyGPSAltitude : TinyGPSDecimal
    double feet()         { return _GPS_FEET_PER_METER * value() / 100.0; }
 };
 
+enum TinyGPSConstellation
+{
+   GPS_CONSTELLATION_UNKNOWN = 0,
+   GPS_CONSTELLATION_GPS,
+   GPS_CONSTELLATION_SBAS,
+   GPS_CONSTELLATION_GLONASS,
+   GPS_CONSTELLATION_GALILEO,
+   GPS_CONSTELLATION_BEIDOU,
+   GPS_CONSTELLATION_QZSS,
+   GPS_CONSTELLATION_MIXED, // GN talker, only used while parsing
+};
+
+// Satellites in view (from GSV) and used in fix (from GSA), for every constellation.
+// Kept as a structure of arrays with a fixed capacity, updated in place.
+struct TinyGPSSatelliteTable
+{
+   friend class TinyGPSPlus;
+public:
+   bool isValid() const       { return valid; }
+   uint32_t age() const       { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+
+   uint8_t count() const      { return size; }
+   uint8_t usedCount() const;
+
+   uint16_t prn(uint8_t i) const       { return prns[i]; }
+   uint8_t constellation(uint8_t i) const { return constellations[i]; }
+   int8_t elevation(uint8_t i) const   { return elevations[i]; }
+   uint16_t azimuth(uint8_t i) const   { return azimuths[i]; }
+   uint8_t snr(uint8_t i) const        { return snrs[i]; } // dB-Hz, 0 when not tracking
+   bool used(uint8_t i) const          { return usedMask & (1UL << i); }
+
+   TinyGPSSatelliteTable() : valid(false), size(0), usedMask(0), newCount(0), newUsedCount(0)
+   {}
+
+private:
+   bool valid;
+   uint8_t size;
+   uint32_t usedMask;
+   uint32_t lastCommitTime;
+   uint16_t prns[_GPS_MAX_SATELLITES];
+   uint8_t constellations[_GPS_MAX_SATELLITES];
+   int8_t elevations[_GPS_MAX_SATELLITES];
+   uint16_t azimuths[_GPS_MAX_SATELLITES];
+   uint8_t snrs[_GPS_MAX_SATELLITES];
+   uint32_t lastSeen[_GPS_MAX_SATELLITES];
+
+   // staging for the current GSV (up to 4 satellites) or GSA (up to 12 PRNs) sentence
+   uint8_t newCount;
+   uint16_t newPrns[4];
+   int8_t newElevations[4];
+   uint16_t newAzimuths[4];
+   uint8_t newSnrs[4];
+   uint8_t newUsedCount;
+   uint16_t newUsedPrns[12];
+
+   void beginSentence();
+   void setSatelliteTerm(uint8_t termNumber, const char *term);
+   void setUsedTerm(uint8_t termNumber, const char *term);
+   void commitInView(uint8_t talker, uint8_t lastTermNumber);
+   void commitUsed(uint8_t talker, uint8_t systemId);
+   int find(uint8_t constellation, uint16_t prn) const;
+   void remove(uint8_t i);
+};
+
 class TinyGPSPlus;
+template<typename... Fields> class TinyGPSCustomFields;
 class TinyGPSCustom
 {
 public:
@@ -198,6 +348,7 @@ public:
    const char *value()     { updated = false; return buffer; }
 
 private:
+   void clear();
    void commit();
    void set(const char *term);
 
@@ -208,6 +359,7 @@ private:
    const char *sentenceName;
    int termNumber;
    friend class TinyGPSPlus;
+   template<typename... Fields> friend class TinyGPSCustomFields;
    TinyGPSCustom *next;
 };
 
@@ -216,16 +368,22 @@ class TinyGPSPlus
 public:
   TinyGPSPlus();
   bool encode(char c); // process one character received from GPS
+  bool encode(char c, uint32_t arrivalTime); // same, with the millis() the character was received at
   TinyGPSPlus &operator << (char c) {encode(c); return *this;}
 
   TinyGPSLocation location;
   TinyGPSDate date;
   TinyGPSTime time;
+  TinyGPSLocalZone localZone; // from ZDA
   TinyGPSSpeed speed;
   TinyGPSCourse course;
   TinyGPSAltitude altitude;
   TinyGPSInteger satellites;
   TinyGPSDecimal hdop;
+  TinyGPSInteger fixType; // from GSA: 1 = no fix, 2 = 2D, 3 = 3D
+  TinyGPSDecimal pdop;
+  TinyGPSDecimal vdop;
+  TinyGPSSatelliteTable satelliteTable;
 
   static const char *libraryVersion() { return _GPS_VERSION; }
 
@@ -233,6 +391,8 @@ public:
   static double courseTo(double lat1, double long1, double lat2, double long2);
   static const char *cardinal(double course);
 
+  // Terms are only read up to _GPS_MAX_FIELD_SIZE characters, numbers up to 9 digits
+  static int32_t parseInteger(const char *term);
   static int32_t parseDecimal(const char *term);
   static void parseDegrees(const char *term, RawDegrees &deg);
 
@@ -241,23 +401,51 @@ public:
   uint32_t failedChecksum()   const { return failedChecksumCount; }
   uint32_t passedChecksum()   const { return passedChecksumCount; }
 
+  // FNV-1a hash of a sentence name ("GPGSV"), computed at compile time for TinyGPSCustomFields
+  static constexpr uint32_t sentenceHash(const char *name, uint32_t hash = 2166136261UL)
+  {
+    return *name ? sentenceHash(name + 1, (hash ^ (uint8_t)*name) * 16777619UL) : hash;
+  }
+  // Hook for TinyGPSCustomFields: called with the sentence type term (term number 0),
+  // returning whether the sentence has any field; then only for the other terms of
+  // those sentences, and with a NULL term once they pass the checksum.
+  typedef bool (*CustomFieldsHandler)(void *context, uint32_t sentenceHash, uint8_t termNumber, const char *term);
+  void setCustomFieldsHandler(CustomFieldsHandler handler, void *context = NULL);
+
 private:
-  enum {GPS_SENTENCE_GPGGA, GPS_SENTENCE_GPRMC, GPS_SENTENCE_OTHER};
+  enum {GPS_SENTENCE_GPGGA, GPS_SENTENCE_GPRMC, GPS_SENTENCE_GSA, GPS_SENTENCE_GSV, GPS_SENTENCE_ZDA, GPS_SENTENCE_OTHER};
 
   // parsing state variables
   uint8_t parity;
   bool isChecksumTerm;
+#ifdef TINYGPS_LAZY_DECODE
+  // The whole sentence, with its terms NUL terminated in place: fields keep pointers
+  // to their terms, and copy them only once the checksum is verified
+  char sentence[_GPS_MAX_SENTENCE_SIZE];
+  char *term;
+#else
   char term[_GPS_MAX_FIELD_SIZE];
+#endif
   uint8_t curSentenceType;
   uint8_t curTermNumber;
   uint8_t curTermOffset;
+  uint8_t sentenceSize;
+  bool discardSentence; // until the next '$': malformed, or already complete
   bool sentenceHasFix;
+  uint8_t curTalker;
+  uint8_t curSystemId;
+  uint8_t curDateTimeTerms; // bit mask of the non empty ZDA terms
+  uint32_t sentenceArrivalTime;
 
   // custom element support
   friend class TinyGPSCustom;
   TinyGPSCustom *customElts;
   TinyGPSCustom *customCandidates;
   void insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int index);
+  CustomFieldsHandler customFieldsHandler;
+  void *customFieldsContext;
+  uint32_t curSentenceHash;
+  bool customFieldsSentence;
 
   // statistics
   uint32_t encodedCharCount;
@@ -267,7 +455,90 @@ private:
 
   // internal utilities
   int fromHex(char a);
+  static uint8_t talkerConstellation(const char *talker);
   bool endOfTermHandler();
 };
 
+// Declares a field for TinyGPSCustomFields: term termNumber of sentenceName sentences
+#define TINYGPS_CUSTOM_FIELD(name, sentenceName, termNumber) \
+   struct name \
+   { \
+      static const char *sentence() { return sentenceName; } \
+      static constexpr uint32_t hash = TinyGPSPlus::sentenceHash(sentenceName); \
+      static constexpr uint8_t term = termNumber; \
+   }
+
+// Custom fields declared at compile time, instead of registered at runtime with TinyGPSCustom:
+//   TINYGPS_CUSTOM_FIELD(SatellitesInView, "GPGSV", 3);
+//   TinyGPSCustomFields<SatellitesInView> custom(gps);
+//   custom.get<SatellitesInView>().value();
+// Each term is matched against constant sentence hashes and term numbers, unrolled by
+// the compiler, instead of walking the TinyGPSCustom list with strcmp. Sentences
+// without fields only cost a hash of their type.
+template<typename... Fields>
+class TinyGPSCustomFields
+{
+public:
+   TinyGPSCustomFields(TinyGPSPlus &gps)
+   {
+      for (TinyGPSCustom &value : values)
+         value.clear();
+      gps.setCustomFieldsHandler(handle, this);
+   }
+
+   template<typename Field> TinyGPSCustom &get() { return values[Index<Field, Fields...>::value]; }
+
+private:
+   TinyGPSCustom values[sizeof...(Fields) > 0 ? sizeof...(Fields) : 1];
+
+   template<typename Field, typename First, typename... Rest> struct Index
+   {
+      enum { value = 1 + Index<Field, Rest...>::value };
+   };
+   template<typename Field, typename... Rest> struct Index<Field, Field, Rest...>
+   {
+      enum { value = 0 };
+   };
+
+   template<size_t I, typename... Rest> struct Dispatch
+   {
+      static bool sentence(uint32_t, const char *) { return false; }
+      static void term(TinyGPSCustom *, uint32_t, uint8_t, const char *) {}
+      static void commit(TinyGPSCustom *, uint32_t) {}
+   };
+   template<size_t I, typename Field, typename... Rest> struct Dispatch<I, Field, Rest...>
+   {
+      static_assert(Field::term > 0 && Field::term <= _GPS_MAX_TERMS, "Custom field term out of range");
+      // Only the type term of sentences with a matching hash is compared
+      static bool sentence(uint32_t hash, const char *term)
+      {
+         return (hash == Field::hash && !strcmp(term, Field::sentence())) || Dispatch<I + 1, Rest...>::sentence(hash, term);
+      }
+      static void term(TinyGPSCustom *values, uint32_t hash, uint8_t termNumber, const char *term)
+      {
+         if (hash == Field::hash && termNumber == Field::term)
+            values[I].set(term);
+         Dispatch<I + 1, Rest...>::term(values, hash, termNumber, term);
+      }
+      static void commit(TinyGPSCustom *values, uint32_t hash)
+      {
+         if (hash == Field::hash)
+            values[I].commit();
+         Dispatch<I + 1, Rest...>::commit(values, hash);
+      }
+   };
+
+   static bool handle(void *context, uint32_t hash, uint8_t termNumber, const char *term)
+   {
+      TinyGPSCustom *values = static_cast<TinyGPSCustomFields *>(context)->values;
+      if (termNumber == 0)
+         return Dispatch<0, Fields...>::sentence(hash, term);
+      if (term)
+         Dispatch<0, Fields...>::term(values, hash, termNumber, term);
+      else
+         Dispatch<0, Fields...>::commit(values, hash);
+      return true;
+   }
+};
+
 #endif // def(__TinyGPSPlus_h)
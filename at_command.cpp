@@ -0,0 +1,80 @@
+#include "at_command.h"
+#include "logging.h"
+#include "serial_capture.h"
+
+ATCommand::ATCommand(Stream &port) : _port(port) {
+  _reply[0] = 0;
+}
+
+void ATCommand::send(const char *command, uint32_t timeout) {
+  // Discard anything left from previous commands
+  while(_port.available()) {
+    uint8_t discarded = _port.read();
+    CAPTURE_RX(_port, discarded);
+    (void) discarded;
+  }
+  _port.print(command);
+  _port.print(F("\r\n"));
+  CAPTURE_TX(_port, command);
+  CAPTURE_TX(_port, "\r\n");
+  VERBOSE_F(">>> %s", command);
+  _reply_size = 0;
+  _line_size = 0;
+  _reply[0] = 0;
+  _sent_at = millis();
+  _timeout = timeout;
+  _result = Pending;
+}
+
+ATCommand::Result ATCommand::check_line() {
+  _line[_line_size] = 0;
+  _line_size = 0;
+  if(strncmp(_line, "OK", 2) == 0) {
+    return Ok;
+  }
+  if(strncmp(_line, "ERROR", 5) == 0 || strncmp(_line, "FAIL", 4) == 0) {
+    return Error;
+  }
+  return Pending;
+}
+
+ATCommand::Result ATCommand::process() {
+  if(_result != Pending) {
+    return Idle;
+  }
+  while(_port.available()) {
+    char c = static_cast<char>(_port.read());
+    CAPTURE_RX(_port, c);
+    if(c == '\r') {
+      continue;
+    }
+    if(c == '\n') {
+      Result result = check_line();
+      if(_reply_size < sizeof(_reply) - 1) {
+        _reply[_reply_size++] = '\n';
+        _reply[_reply_size] = 0;
+      }
+      if(result != Pending) {
+        VERBOSE_F("<<< %s", _reply);
+        _result = Idle;
+        return result;
+      }
+      continue;
+    }
+    if(_line_size < sizeof(_line) - 1) {
+      _line[_line_size++] = c;
+    }
+    if(_reply_size < sizeof(_reply) - 1) {
+      _reply[_reply_size++] = c;
+      _reply[_reply_size] = 0;
+    }
+  }
+  if(millis() - _sent_at > _timeout) {
+    VERBOSE_F("<<< timeout: %s", _reply);
+    _result = Idle;
+    return Timeout;
+  }
+  return Pending;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
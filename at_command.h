@@ -0,0 +1,39 @@
+#pragma once
+#include "Arduino.h"
+
+#define AT_REPLY_BUFFER_SIZE 64
+#define AT_DEFAULT_TIMEOUT 500
+
+// Non blocking AT command exchange: send() a command, then poll process() until it completes.
+// Replies are collected in a fixed buffer, and completed by an "OK" or "ERROR" line.
+class ATCommand {
+public:
+  enum Result {
+    Idle,
+    Pending,
+    Ok,
+    Error,
+    Timeout,
+  };
+  ATCommand(Stream &port);
+  void send(const char *command, uint32_t timeout = AT_DEFAULT_TIMEOUT);
+  // Returns Pending until the reply is complete, then the command result, once.
+  Result process();
+  inline bool busy() const { return _result == Pending; }
+  // Reply lines received for the last command, each ended by '\n' (truncated to the buffer size)
+  inline const char *reply() const { return _reply; }
+
+private:
+  Stream &_port;
+  char _reply[AT_REPLY_BUFFER_SIZE];
+  uint8_t _reply_size = 0;
+  // Start of the current line, enough to match the final result
+  char _line[6];
+  uint8_t _line_size = 0;
+  uint32_t _sent_at = 0;
+  uint32_t _timeout = 0;
+  Result _result = Idle;
+  Result check_line();
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
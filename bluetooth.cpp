@@ -1,39 +1,212 @@
 #include "bluetooth.h"
 #include "logging.h"
 #include "defines.h"
+#include <libmaple/bkp.h>
 
+// Time for the module to boot after powering it on, before accepting AT commands
+#define BT_POWER_UP_DELAY 200
+#define BT_AT_BAUD_RATE 38400
+#ifdef BLUETOOTH_BAUD_RATE
+#define BT_DATA_BAUD_RATE BLUETOOTH_BAUD_RATE
+#else
+#define BT_DATA_BAUD_RATE 9600
+#endif
+// Backup registers (kept by the RTC battery) storing the hash of the provisioned settings
+#define BT_PROVISIONED_HASH_REG_LOW 8
+#define BT_PROVISIONED_HASH_REG_HIGH 9
 
-Bluetooth::Bluetooth(HardwareSerial &port, int power_pin, int at_mode_pin) : port(port), power_pin(power_pin), at_mode_pin(at_mode_pin) {
+#define BT_STRINGIFY(x) #x
+#define BT_TO_STRING(x) BT_STRINGIFY(x)
+
+namespace {
+  const char dataBaudRate[] = BT_TO_STRING(BT_DATA_BAUD_RATE);
+  // baud rate, 1 stop bit, no parity
+  const char baudRateCommand[] = "AT+UART=" BT_TO_STRING(BT_DATA_BAUD_RATE) ",0,0";
+  const char baudRateReply[] = BT_TO_STRING(BT_DATA_BAUD_RATE) ",0,0";
+
+  // Sizes are bounded by the settings validation
+  const char *concat(char *buffer, const char *prefix, const char *value, const char *suffix = "") {
+    strcpy(buffer, prefix);
+    strcat(buffer, value);
+    return strcat(buffer, suffix);
+  }
+
+  // True if a whole line of the reply is prefix followed by value, which may be quoted
+  // (depending on the module firmware version)
+  bool has_reply_line(const char *reply, const char *prefix, const char *value) {
+    size_t prefix_size = strlen(prefix);
+    size_t value_size = strlen(value);
+    for(const char *line = reply; *line;) {
+      const char *end = strchr(line, '\n');
+      size_t size = end ? end - line : strlen(line);
+      if(size >= prefix_size && strncmp(line, prefix, prefix_size) == 0) {
+        const char *line_value = line + prefix_size;
+        size_t line_value_size = size - prefix_size;
+        if(line_value_size >= 2 && line_value[0] == '"' && line_value[line_value_size - 1] == '"') {
+          line_value++;
+          line_value_size -= 2;
+        }
+        if(line_value_size == value_size && strncmp(line_value, value, value_size) == 0) {
+          return true;
+        }
+      }
+      if(!end) {
+        break;
+      }
+      line = end + 1;
+    }
+    return false;
+  }
+
+  uint32_t fnv1a(uint32_t hash, const char *s) {
+    // include the terminator, so that different splits of the same string don't collide
+    do {
+      hash = (hash ^ static_cast<uint8_t>(*s)) * 16777619UL;
+    } while(*s++);
+    return hash;
+  }
+}
+
+Bluetooth::Bluetooth(HardwareSerial &port, int power_pin, int at_mode_pin, const Settings &settings)
+  : port(port), power_pin(power_pin), at_mode_pin(at_mode_pin), settings(settings), at(port) {
+}
+
+uint32_t Bluetooth::settings_hash() const {
+  uint32_t hash = 2166136261UL;
+  hash = fnv1a(hash, settings.values().bluetooth_name);
+  hash = fnv1a(hash, settings.values().bluetooth_pin);
+  return fnv1a(hash, dataBaudRate);
+}
+
+uint32_t Bluetooth::provisioned_hash() {
+  return static_cast<uint32_t>(bkp_read(BT_PROVISIONED_HASH_REG_HIGH)) << 16 | bkp_read(BT_PROVISIONED_HASH_REG_LOW);
+}
+
+void Bluetooth::set_provisioned_hash(uint32_t hash) {
+  bkp_enable_writes();
+  bkp_write(BT_PROVISIONED_HASH_REG_LOW, hash & 0xFFFF);
+  bkp_write(BT_PROVISIONED_HASH_REG_HIGH, hash >> 16);
+  bkp_disable_writes();
 }
 
 void Bluetooth::setup() {
   pinMode(power_pin, OUTPUT);
   pinMode(at_mode_pin, OUTPUT);
+  bkp_init();
+  if(provisioned_hash() == settings_hash()) {
+    TRACE("[BT] Already provisioned");
+    return;
+  }
 
   digitalWrite(at_mode_pin, 1); // Set AT mode
   power_on(true);
-
+  powered_on_at = millis();
+  state = PoweringUp;
   TRACE("Initialising BT");
-  send_command("AT");
-  send_command("AT+NAME=\"" BLUETOOTH_DEVICE_NAME "\"");
-  send_command("AT+PSWD=\"" BLUETOOTH_DEVICE_PIN "\"");
+}
+
+void Bluetooth::process() {
+  switch(state) {
+    case Idle:
+      return;
+    case PoweringUp:
+      if(millis() - powered_on_at >= BT_POWER_UP_DELAY) {
+        state = Configuring;
+        step = Check;
+        step_failed = false;
+        send_step();
+      }
+      return;
+    case Configuring:
+      break;
+  }
+  ATCommand::Result result = at.process();
+  if(result == ATCommand::Pending) {
+    return;
+  }
+  step = next_step(result);
+  if(step != Done) {
+    send_step();
+    return;
+  }
+  if(!step_failed) {
+    set_provisioned_hash(settings_hash());
+  }
+  TRACE_F("[BT] Configuration completed, success: %T", !step_failed);
   digitalWrite(at_mode_pin, 0);
-  send_command("AT+RESET");
+  state = Idle;
   power_off();
 }
 
+Bluetooth::Step Bluetooth::next_step(ATCommand::Result result) {
+  bool ok = result == ATCommand::Ok;
+  switch(step) {
+    case Check:
+      return QueryName;
+    // Settings survive in the module even if the backup domain lost power: only write them if any differs
+    case QueryName:
+      return ok && has_reply_line(at.reply(), "+NAME:", settings.values().bluetooth_name) ? QueryPin : SetName;
+    case QueryPin:
+      return ok && has_reply_line(at.reply(), "+PSWD:", settings.values().bluetooth_pin) ? QueryBaudRate : SetName;
+    case QueryBaudRate:
+      return ok && has_reply_line(at.reply(), "+UART:", baudRateReply) ? Done : SetName;
+    case SetName:
+    case SetPin:
+    case SetBaudRate:
+      if(!ok) {
+        TRACE_F("[BT] Command failed: %s", step == SetBaudRate ? baudRateCommand : command);
+        step_failed = true;
+      }
+      return step == SetName ? SetPin : step == SetPin ? SetBaudRate : Reset;
+    default:
+      return Done;
+  }
+}
+
+void Bluetooth::send_step() {
+  switch(step) {
+    case Check:
+      at.send("AT");
+      break;
+    case QueryName:
+      at.send("AT+NAME?");
+      break;
+    case QueryPin:
+      at.send("AT+PSWD?");
+      break;
+    case QueryBaudRate:
+      at.send("AT+UART?");
+      break;
+    case SetName:
+      at.send(concat(command, "AT+NAME=\"", settings.values().bluetooth_name, "\""));
+      break;
+    case SetPin:
+      at.send(concat(command, "AT+PSWD=\"", settings.values().bluetooth_pin, "\""));
+      break;
+    case SetBaudRate:
+      at.send(baudRateCommand);
+      break;
+    case Reset:
+      // AT mode pin must be released before resetting, so that the module restarts in data mode
+      digitalWrite(at_mode_pin, 0);
+      at.send("AT+RESET");
+      break;
+    default:
+      break;
+  }
+}
+
 void Bluetooth::power_on(bool at_mode) {
-  if(powered_on) {
+  if(powered_on || is_configuring()) {
     return;
   }
   digitalWrite(power_pin, 1);
-  delay(200); 
-  port.begin(at_mode ? 38400 : 9600);
+  port.begin(at_mode ? BT_AT_BAUD_RATE : BT_DATA_BAUD_RATE);
   powered_on = true;
 }
 
 void Bluetooth::power_off() {
-  if(!powered_on) {
+  if(!powered_on || is_configuring()) {
     return;
   }
   digitalWrite(power_pin, 0);
@@ -41,20 +214,4 @@ void Bluetooth::power_off() {
   powered_on = false;
 }
 
-String Bluetooth::send_command(const String &command, int timeout) {
-  port.print(command);
-  port.print(F("\r\n"));
-  VERBOSE_F(">>> %s", command.c_str());
-  int watch_port_started = millis();
-  while(!port.available() && millis() - watch_port_started < timeout) {
-    delay(10);
-  }
-  String reply;
-  while(port.available())
-    reply += static_cast<char>(port.read());
-  VERBOSE_F("<<< %s", reply.c_str());
-  return reply;
-}
-
-
 /* vim: set shiftwidth=2 tabstop=2 expandtab smarttab : */
@@ -1,19 +1,57 @@
 #pragma once
 
 #include "Arduino.h"
+#include "at_command.h"
+#include "settings.h"
+
+// Longest AT command built from the settings
+#define BT_COMMAND_SIZE (sizeof("AT+NAME=\"\"") + SETTINGS_BLUETOOTH_NAME_SIZE)
 
 class Bluetooth {
 public:
-  Bluetooth(HardwareSerial &port, int power_pin, int at_mode_pin);
+  Bluetooth(HardwareSerial &port, int power_pin, int at_mode_pin, const Settings &settings);
+  // Starts configuring the module in AT mode, unless it was already provisioned with the current settings.
+  // Name and PIN come from the settings: changes apply at the next boot.
+  // process() carries on without blocking.
   void setup();
+  void process();
   void power_on(bool at_mode=false);
   void power_off();
+  inline bool is_configuring() const { return state != Idle; }
 private:
+  enum State {
+    Idle,
+    PoweringUp,
+    Configuring,
+  };
+  enum Step {
+    Check,
+    QueryName,
+    QueryPin,
+    QueryBaudRate,
+    SetName,
+    SetPin,
+    SetBaudRate,
+    Reset,
+    Done,
+  };
   HardwareSerial &port;
   int power_pin;
   int at_mode_pin;
-  String send_command(const String &command, int timeout=500);
+  const Settings &settings;
+  ATCommand at;
+  State state = Idle;
+  Step step = Check;
+  bool step_failed = false;
+  uint32_t powered_on_at = 0;
+  // Commands and expected replies built from the settings
+  char command[BT_COMMAND_SIZE];
   bool powered_on = false;
+  void send_step();
+  Step next_step(ATCommand::Result result);
+  uint32_t settings_hash() const;
+  static uint32_t provisioned_hash();
+  static void set_provisioned_hash(uint32_t hash);
 };
 
 // vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,70 @@
+#include "commport.h"
+#include "logging.h"
+#include "settings.h"
+
+// Give up waiting for a transaction to complete after this many milliseconds
+#define COMMPORT_DRAIN_TIMEOUT 4000
+
+CommPortSelector::CommPortSelector(Stream &usb, ConnectionCheck is_usb_connected, HardwareSerial &bluetooth_port, Bluetooth &bluetooth, Nexstar &nexstar, EventBus &events, const Settings &settings)
+  : _usb(usb), _is_usb_connected(is_usb_connected), _bluetooth_port(bluetooth_port), _bluetooth(bluetooth), _nexstar(nexstar), _events(events), _settings(settings) {
+  _events.subscribe(EventBus::mask(EventBus::USBConnected) | EventBus::mask(EventBus::USBDisconnected), &CommPortSelector::on_event, this);
+}
+
+void CommPortSelector::on_event(void *context, EventBus::Event event, int) {
+  CommPortSelector *selector = reinterpret_cast<CommPortSelector*>(context);
+  Port target = event == EventBus::USBConnected ? USBPort : BluetoothPort;
+  if(target != selector->_target) {
+    selector->_target = target;
+    selector->_switch_started_at = millis();
+    TRACE_F("[CommPort] Switching to %s", target == USBPort ? "USB Serial" : "Bluetooth");
+  }
+}
+
+void CommPortSelector::debounce_usb() {
+  bool raw_state = _is_usb_connected();
+  uint32_t now = millis();
+  if(raw_state != _usb_raw_state) {
+    _usb_raw_state = raw_state;
+    _usb_raw_changed_at = now;
+    return;
+  }
+  if((_usb_state_known && raw_state == _usb_connected) || now - _usb_raw_changed_at < _settings.values().commport_debounce) {
+    return;
+  }
+  _usb_connected = raw_state;
+  _usb_state_known = true;
+  _events.publish(raw_state ? EventBus::USBConnected : EventBus::USBDisconnected);
+}
+
+void CommPortSelector::process() {
+  debounce_usb();
+  // No port until the first USB event
+  if(_target == NoPort) {
+    return;
+  }
+  if(_current != _target) {
+    // Let the current client get its reply before handing over
+    if(_nexstar.is_transaction_pending() && millis() - _switch_started_at < COMMPORT_DRAIN_TIMEOUT) {
+      return;
+    }
+    // The first port assignment is not a switch
+    if(_current != NoPort) {
+      _switches++;
+      _switching_time += millis() - _switch_started_at;
+    }
+    apply(_target);
+  }
+  // Bluetooth ignores power changes while configuring: keep requesting the wanted state
+  if(_current == USBPort) {
+    _bluetooth.power_off();
+  } else {
+    _bluetooth.power_on();
+  }
+}
+
+void CommPortSelector::apply(Port port) {
+  _current = port;
+  _nexstar.set_comm_port(port == USBPort ? &_usb : static_cast<Stream*>(&_bluetooth_port));
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
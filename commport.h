@@ -0,0 +1,53 @@
+#pragma once
+#include "Arduino.h"
+#include "bluetooth.h"
+#include "nexstar.h"
+#include "events.h"
+#include "settings.h"
+
+// Selects the client port (USB when connected, Bluetooth otherwise) for Nexstar passthrough.
+// USB connection changes must be stable for the debounce time before being published as events,
+// which drive the selection; switching waits for any in-flight Nexstar transaction to complete.
+class CommPortSelector {
+public:
+  typedef bool (*ConnectionCheck)();
+  CommPortSelector(Stream &usb, ConnectionCheck is_usb_connected, HardwareSerial &bluetooth_port, Bluetooth &bluetooth, Nexstar &nexstar, EventBus &events, const Settings &settings);
+  void process();
+
+  // Port changes, not counting the first port assignment
+  inline uint32_t switches() const { return _switches; }
+  // Total milliseconds spent between deciding a switch and completing it
+  inline uint32_t switching_time() const { return _switching_time; }
+
+private:
+  enum Port {
+    NoPort,
+    USBPort,
+    BluetoothPort,
+  };
+  Stream &_usb;
+  ConnectionCheck _is_usb_connected;
+  HardwareSerial &_bluetooth_port;
+  Bluetooth &_bluetooth;
+  Nexstar &_nexstar;
+  EventBus &_events;
+  const Settings &_settings;
+
+  bool _usb_raw_state = false;
+  uint32_t _usb_raw_changed_at = 0;
+  bool _usb_connected = false;
+  bool _usb_state_known = false;
+
+  Port _current = NoPort;
+  Port _target = NoPort;
+  uint32_t _switch_started_at = 0;
+
+  uint32_t _switches = 0;
+  uint32_t _switching_time = 0;
+
+  static void on_event(void *context, EventBus::Event event, int value);
+  void debounce_usb();
+  void apply(Port port);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,161 @@
+#include "diagnostics.h"
+#include "profiler.h"
+#include "logging.h"
+#include "serial_capture.h"
+
+#define DIAGNOSTICS_UNKNOWN '?'
+// Milliseconds to wait for the arguments of a command
+#define DIAGNOSTICS_ARGUMENTS_TIMEOUT 100
+
+namespace {
+  inline uint16_t clamp16(uint32_t value) {
+    return value > UINT16_MAX ? UINT16_MAX : value;
+  }
+}
+
+Diagnostics::Diagnostics(GPS &gps, Nexstar &nexstar, RTCProvider &rtc, Scheduler &scheduler, PowerManager &power, Settings &settings)
+  : _gps(gps), _nexstar(nexstar), _rtc(rtc), _scheduler(scheduler), _power(power), _settings(settings) {
+  _nexstar.set_escape_handler(&Diagnostics::on_escape, this);
+}
+
+DiagnosticsSnapshot Diagnostics::snapshot() const {
+  GPS::Counters parser = _gps.counters();
+  const Nexstar::Stats &nexstar = _nexstar.stats();
+  uint32_t max_task_runtime = 0;
+  for(uint8_t i = 0; i < _scheduler.tasks_count(); i++) {
+    if(_scheduler.task(i).max_runtime > max_task_runtime) {
+      max_task_runtime = _scheduler.task(i).max_runtime;
+    }
+  }
+  return DiagnosticsSnapshot{
+    DIAGNOSTICS_VERSION,
+    millis(),
+    parser.chars,
+    parser.sentencesWithFix,
+    parser.passedChecksum,
+    parser.failedChecksum,
+    static_cast<uint8_t>(_gps.status()),
+    static_cast<uint8_t>(_gps.fixType().value()),
+    _gps.satellitesInView(),
+    _gps.satellitesUsed(),
+    _gps.isSuspended(),
+    static_cast<uint8_t>(_nexstar.status()),
+    nexstar.commands,
+    nexstar.timeouts,
+    nexstar.replies,
+    clamp16(nexstar.replies > 0 ? nexstar.rtt_min : 0),
+    clamp16(nexstar.rtt_max),
+    clamp16(nexstar.rtt_mean()),
+    nexstar.passthrough_transactions,
+    nexstar.passthrough_sent,
+    nexstar.passthrough_received,
+    _scheduler.iterations(),
+    max_task_runtime,
+    static_cast<uint16_t>(_power.sleep_fraction() * 1000),
+    _rtc.is_valid(),
+    _rtc.is_disciplined(),
+    static_cast<uint32_t>(_rtc.utc()),
+  };
+}
+
+void Diagnostics::on_escape(void *context, uint8_t command, Stream &port) {
+  Diagnostics *diagnostics = reinterpret_cast<Diagnostics*>(context);
+  TRACE_F("[Diagnostics] Command: %d", command);
+  switch(command) {
+    case DIAGNOSTICS_SNAPSHOT: {
+      DiagnosticsSnapshot snapshot = diagnostics->snapshot();
+      reply(port, command, &snapshot, sizeof(snapshot));
+      break;
+    }
+    case DIAGNOSTICS_PROFILE:
+      diagnostics->send_profile(port);
+      break;
+    case DIAGNOSTICS_SETTINGS:
+      diagnostics->send_setting(port);
+      break;
+    default:
+      reply(port, DIAGNOSTICS_UNKNOWN, nullptr, 0);
+      break;
+  }
+}
+
+// Payload: zones count, ticks per microsecond (4 bytes), then for each zone
+// count, min, max, mean (4 bytes each) and its NUL terminated name.
+void Diagnostics::send_profile(Stream &port) {
+  uint16_t size = 1 + sizeof(uint32_t);
+  for(uint8_t i = 0; i < Profiler::ZonesCount; i++) {
+    size += 4 * sizeof(uint32_t) + strlen(Profiler::name(static_cast<Profiler::Zone>(i))) + 1;
+  }
+  uint8_t header[] = {DIAGNOSTICS_PROFILE, static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8), Profiler::ZonesCount};
+  port.write(header, sizeof(header));
+  CAPTURE_TX(port, header, sizeof(header));
+  uint32_t ticks_per_us = Profiler::ticks_per_us();
+  port.write(reinterpret_cast<const uint8_t*>(&ticks_per_us), sizeof(ticks_per_us));
+  CAPTURE_TX(port, reinterpret_cast<const uint8_t*>(&ticks_per_us), sizeof(ticks_per_us));
+  for(uint8_t i = 0; i < Profiler::ZonesCount; i++) {
+    Profiler::Zone zone = static_cast<Profiler::Zone>(i);
+    const Profiler::Stats &stats = profiler.stats(zone);
+    uint32_t values[] = {stats.count, stats.count > 0 ? stats.min : 0, stats.max, stats.mean()};
+    port.write(reinterpret_cast<const uint8_t*>(values), sizeof(values));
+    CAPTURE_TX(port, reinterpret_cast<const uint8_t*>(values), sizeof(values));
+    port.write(reinterpret_cast<const uint8_t*>(Profiler::name(zone)), strlen(Profiler::name(zone)) + 1);
+    CAPTURE_TX(port, reinterpret_cast<const uint8_t*>(Profiler::name(zone)), strlen(Profiler::name(zone)) + 1);
+  }
+  port.write('#');
+  CAPTURE_TX(port, '#');
+}
+
+void Diagnostics::send_setting(Stream &port) {
+  uint8_t request[2];
+  uint8_t value[SETTINGS_BLUETOOTH_NAME_SIZE];
+  if(!read_arguments(port, request, sizeof(request)) || request[1] > sizeof(value) || !read_arguments(port, value, request[1])) {
+    reply(port, DIAGNOSTICS_UNKNOWN, nullptr, 0);
+    return;
+  }
+  Settings::Key key = static_cast<Settings::Key>(request[0]);
+  if(request[1] > 0 && !_settings.set(key, value, request[1])) {
+    reply(port, DIAGNOSTICS_UNKNOWN, nullptr, 0);
+    return;
+  }
+  uint8_t size;
+  const void *current = _settings.get(key, size);
+  if(!current) {
+    reply(port, DIAGNOSTICS_UNKNOWN, nullptr, 0);
+    return;
+  }
+  uint8_t payload[1 + SETTINGS_BLUETOOTH_NAME_SIZE] = {request[0]};
+  memcpy(payload + 1, current, size);
+  reply(port, DIAGNOSTICS_SETTINGS, payload, size + 1);
+}
+
+// The client sends the arguments right after the command, but they may still be on their way
+bool Diagnostics::read_arguments(Stream &port, uint8_t *arguments, uint8_t size) {
+  uint32_t started_at = millis();
+  uint8_t received = 0;
+  while(received < size) {
+    if(!port.available()) {
+      if(millis() - started_at > DIAGNOSTICS_ARGUMENTS_TIMEOUT) {
+        return false;
+      }
+      continue;
+    }
+    arguments[received] = port.read();
+    CAPTURE_RX(port, arguments[received]);
+    received++;
+  }
+  return true;
+}
+
+void Diagnostics::reply(Stream &port, uint8_t command, const void *payload, uint16_t size) {
+  uint8_t header[] = {command, static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8)};
+  port.write(header, sizeof(header));
+  CAPTURE_TX(port, header, sizeof(header));
+  if(size > 0) {
+    port.write(reinterpret_cast<const uint8_t*>(payload), size);
+    CAPTURE_TX(port, reinterpret_cast<const uint8_t*>(payload), size);
+  }
+  port.write('#');
+  CAPTURE_TX(port, '#');
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,76 @@
+#pragma once
+#include "Arduino.h"
+#include "gps.h"
+#include "nexstar.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "power.h"
+#include "settings.h"
+
+#define DIAGNOSTICS_VERSION 1
+
+// Escape commands (sent after NEXSTAR_ESCAPE)
+#define DIAGNOSTICS_SNAPSHOT 'D'
+#define DIAGNOSTICS_PROFILE 'P'
+// Followed by key, value size and value: reads the setting with an empty value, changes it otherwise.
+// The reply payload is the key and its current value.
+#define DIAGNOSTICS_SETTINGS 'S'
+
+// Reply: command, payload size (2 bytes, little endian), payload, '#'.
+// Unknown commands and invalid requests get a '?' reply with an empty payload.
+// tools/diagnostics.py decodes the replies.
+struct __attribute__ ((packed)) DiagnosticsSnapshot {
+  uint8_t version;
+  uint32_t uptime; // ms
+  // NMEA parser
+  uint32_t gps_chars;
+  uint32_t gps_sentences_with_fix;
+  uint32_t gps_passed_checksum;
+  uint32_t gps_failed_checksum;
+  uint8_t gps_status;
+  uint8_t gps_fix_type;
+  uint8_t gps_satellites_in_view;
+  uint8_t gps_satellites_used;
+  uint8_t gps_suspended;
+  // Hand control
+  uint8_t nexstar_status;
+  uint32_t nexstar_commands;
+  uint32_t nexstar_timeouts;
+  uint32_t nexstar_replies;
+  uint16_t nexstar_rtt_min; // ms
+  uint16_t nexstar_rtt_max; // ms
+  uint16_t nexstar_rtt_mean; // ms
+  uint32_t passthrough_transactions;
+  uint32_t passthrough_sent; // bytes
+  uint32_t passthrough_received; // bytes
+  // Main loop
+  uint32_t loop_iterations;
+  uint32_t loop_max_task_runtime; // us
+  uint16_t sleep_permille;
+  // RTC
+  uint8_t rtc_valid;
+  uint8_t rtc_disciplined;
+  uint32_t rtc_utc;
+};
+
+// Answers in-band diagnostics queries from the Nexstar client port
+class Diagnostics {
+public:
+  Diagnostics(GPS &gps, Nexstar &nexstar, RTCProvider &rtc, Scheduler &scheduler, PowerManager &power, Settings &settings);
+  DiagnosticsSnapshot snapshot() const;
+
+private:
+  GPS &_gps;
+  Nexstar &_nexstar;
+  RTCProvider &_rtc;
+  Scheduler &_scheduler;
+  PowerManager &_power;
+  Settings &_settings;
+  static void on_escape(void *context, uint8_t command, Stream &port);
+  void send_profile(Stream &port);
+  void send_setting(Stream &port);
+  static bool read_arguments(Stream &port, uint8_t *arguments, uint8_t size);
+  static void reply(Stream &port, uint8_t command, const void *payload, uint16_t size);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,20 @@
+#include "events.h"
+
+bool EventBus::subscribe(uint16_t events_mask, Callback callback, void *context) {
+  if(_subscribers_count >= EVENT_BUS_MAX_SUBSCRIBERS) {
+    return false;
+  }
+  _subscribers[_subscribers_count++] = Subscriber{events_mask, callback, context};
+  return true;
+}
+
+void EventBus::publish(Event event, int value) {
+  uint16_t event_mask = mask(event);
+  for(uint8_t i = 0; i < _subscribers_count; i++) {
+    if(_subscribers[i].events_mask & event_mask) {
+      _subscribers[i].callback(_subscribers[i].context, event, value);
+    }
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
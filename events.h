@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+#define EVENT_BUS_MAX_SUBSCRIBERS 8
+
+// Synchronous publish/subscribe bus, so that components can react to state changes
+// instead of polling each other on every loop iteration.
+// Subscribers are kept in a fixed size array: no allocation happens.
+class EventBus {
+public:
+  enum Event {
+    GPSTimeAcquired = 0, // once, on the first valid date and time
+    GPSFixAcquired,
+    GPSFixLost,
+    GPSPositionStable,
+    GPSNoData,
+    GPSDataResumed,
+    RTCSet,
+    RTCDisciplined,
+    NexstarStatusChanged, // value: new Nexstar::Status
+    NexstarSyncStarted, // value: Nexstar::Status on success
+    NexstarSyncFailed,
+    USBConnected,
+    USBDisconnected,
+  };
+  typedef void (*Callback)(void *context, Event event, int value);
+
+  static inline uint16_t mask(Event event) { return 1 << event; }
+
+  // Returns false if there's no room left for the subscriber.
+  bool subscribe(uint16_t events_mask, Callback callback, void *context = nullptr);
+  void publish(Event event, int value = 0);
+
+private:
+  struct Subscriber {
+    uint16_t events_mask;
+    Callback callback;
+    void *context;
+  };
+  Subscriber _subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+  uint8_t _subscribers_count = 0;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
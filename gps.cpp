@@ -1,99 +1,297 @@
 #include "gps.h"
 #include "logging.h"
+#include "profiler.h"
+#include "serial_capture.h"
+#include <TimeLib.h>
+
+#define GPS_BAUD_RATE 9600
+// Milliseconds needed to receive the given number of bytes (8N1: 10 bits per byte)
+#define GPS_BYTES_TIME(bytes) ((bytes) * 10000UL / GPS_BAUD_RATE)
 
 //#define DEBUG_GPS
 
+#if defined(GPS_INTERRUPT_PARSING) && defined(SERIAL_CAPTURE)
+#error "SERIAL_CAPTURE can't record bytes read by the GPS_INTERRUPT_PARSING timer interrupt"
+#endif
+
 namespace {
   static const char sleepMessage[] = {0xB5, 0x62, 0x02, 0x41, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x4D, 0x3B};
+  volatile uint32_t ppsCounter = 0;
+#ifdef GPS_PPS_PIN
+  // Also wakes up the CPU from idle
+  void onPPS() {
+    ppsCounter++;
+  }
+#endif
+#ifdef GPS_INTERRUPT_PARSING
+  GPS *_gps_instance = nullptr;
+#endif
 }
 
 
 
-GPS::GPS(HardwareSerial &port) : port(port) {
+GPS::GPS(HardwareSerial &port, HardwareTimer &timer, EventBus &events) : port(port), timer(timer), events(events) {
+#ifdef GPS_INTERRUPT_PARSING
+  _gps_instance = this;
+#endif
 }
 
 void GPS::begin() {
   TRACE("[GPS] Initialising GPS");
-  port.begin(9600);
+  port.begin(GPS_BAUD_RATE);
+  _begin_time = millis();
+  _last_data_time = _begin_time;
+#ifdef GPS_PPS_PIN
+  pinMode(GPS_PPS_PIN, INPUT);
+  attachInterrupt(GPS_PPS_PIN, onPPS, RISING);
+#endif
+#ifdef GPS_INTERRUPT_PARSING
+  timer.pause();
+  timer.setPeriod(GPS_DRAIN_PERIOD_US);
+  timer.setChannel1Mode(TIMER_OUTPUT_COMPARE);
+  timer.setCompare(TIMER_CH1, 1);
+  timer.attachCompare1Interrupt(on_timer);
+  timer.refresh();
+  timer.resume();
+#endif
   TRACE_F("[GPS] Initialised TinyGPS++: %s", gps.libraryVersion());
 }
-int lastDebugPrinted = 0;
+#if defined(DEBUG_GPS) && !defined(DISABLE_LOGGING)
+namespace {
+  // Longer sentences are truncated
+  char lastSentence[_GPS_MAX_SENTENCE_SIZE + 1];
+  uint8_t lastSentenceSize = 0;
+}
+#endif
 
-String last_sentence;
+#ifdef GPS_INTERRUPT_PARSING
+void GPS::on_timer() {
+  if(_gps_instance) {
+    _gps_instance->drain();
+  }
+}
+
+// Runs in the timer interrupt: the main loop only sees the published snapshots
+void GPS::drain() {
+  bool received = false;
+  while (port.available() > 0) {
+    int incoming = port.read();
+    _bytes_received++;
+    received = true;
+    uint32_t arrival_time = 0;
+    if(incoming == '$') {
+      // Everything still queued after '$' was received later than it
+      arrival_time = millis() - GPS_BYTES_TIME(port.available());
+    }
+    gps.encode(incoming, arrival_time);
+  }
+  if(received) {
+    _fix.write(Snapshot{
+      gps.location, gps.date, gps.time, gps.hdop, gps.satellites,
+      gps.fixType, gps.pdop, gps.vdop, gps.satelliteTable.count(), gps.satelliteTable.usedCount(),
+      counters_of(gps),
+    });
+  }
+}
+#endif
 
 void GPS::process() {
+  PROFILE_ZONE(GPSProcess);
+#ifdef GPS_INTERRUPT_PARSING
+  uint32_t bytes_received = _bytes_received;
+  bool has_data = bytes_received != _last_bytes_received;
+  _last_bytes_received = bytes_received;
+#else
   int incoming = 0;
-  while (port.available() > 1) {
+  bool has_data = port.available() > 0;
+#endif
+  if(has_data) {
+    _last_data_time = millis();
+    if(_first_data_time == 0) {
+      _first_data_time = _last_data_time;
+      TRACE_F("[GPS] First data received %d ms after boot", _first_data_time);
+    }
+    if(_no_data) {
+      _no_data = false;
+      TRACE("[GPS] Receiving data again");
+      events.publish(EventBus::GPSDataResumed);
+    }
+  } else if(!_no_data && !_suspended && millis() - _last_data_time > GPS_NO_DATA_TIMEOUT) {
+    _no_data = true;
+    TRACE("[GPS] No data from receiver");
+    events.publish(EventBus::GPSNoData);
+  }
+#ifdef GPS_INTERRUPT_PARSING
+  if(has_data) {
+    Snapshot snapshot = _fix.read();
+    if(snapshot.counters.sentencesWithFix != _last_sentences_with_fix) {
+      _last_sentences_with_fix = snapshot.counters.sentencesWithFix;
+      filter_location(snapshot.time.value(), snapshot.location, snapshot.hdop, snapshot.satellites);
+    }
+  }
+#else
+  while (port.available() > 0) {
     incoming = port.read();
+    CAPTURE_RX(port, incoming);
 #ifndef DISABLE_LOGGING
 #ifdef DEBUG_GPS
     char c = static_cast<char>(incoming);
     if(c == '\r') {
-      last_sentence.trim();
-      VERBOSE_F("[GPS] Last sentence: %s", last_sentence.c_str());
-      last_sentence = String();
-    } else {
-      last_sentence += c;
+      lastSentence[lastSentenceSize] = 0;
+      VERBOSE_F("[GPS] Last sentence: %s", lastSentence);
+      lastSentenceSize = 0;
+    } else if(c != '\n' && lastSentenceSize < _GPS_MAX_SENTENCE_SIZE) {
+      lastSentence[lastSentenceSize++] = c;
     }
 #endif
 #endif
-    gps.encode(incoming);
+    uint32_t arrival_time = 0;
+    if(incoming == '$') {
+      // Everything still queued after '$' was received later than it
+      arrival_time = millis() - GPS_BYTES_TIME(port.available());
+    }
+    bool committed;
+    {
+      PROFILE_ZONE(GPSEncode);
+      committed = gps.encode(incoming, arrival_time);
+    }
+    if(committed && gps.location.isUpdated()) {
+      filter_location(gps.time.value(), gps.location, gps.hdop, gps.satellites);
+    }
   }
+#endif
 
-  if(hasFix()) {
-    _status = Fix;
-  } else if(hasDateTime()) {
-    _status = TimeFix;
+  update_status();
+}
+
+void GPS::debug() {
+#ifndef DISABLE_LOGGING
+  TinyGPSLocation location = this->location();
+  TinyGPSDate date = this->date();
+  TinyGPSTime time = this->time();
+  if(location.isValid()) {
+    VERBOSE_F("[GPS] Location Fix: %F lat, %F lng", location.lat(), location.lng());
+  } else {
+    VERBOSE("[GPS] Location Fix: no");
+  }
+  if(date.isValid()) {
+    VERBOSE_F("[GPS] Date/Time: %d-%d-%dT%d:%d:%d.%d", 
+      date.year(),
+      date.month(),
+      date.day(),
+      time.hour(),
+      time.minute(),
+      time.second(),
+      time.centisecond()
+    );
   } else {
-    _status = NoFix;
+    VERBOSE("[GPS] Date/Time: no");
   }
+  if(satellitesInView() > 0) {
+    VERBOSE_F("[GPS] Satellites: %d in view, %d used, fix type: %d, pdop: %d", satellitesInView(), satellitesUsed(), fixType().value(), pdop().value());
+  }
+#endif
+}
 
-  #ifndef DISABLE_LOGGING
-  if(millis() - lastDebugPrinted > 1000) {
-    lastDebugPrinted = millis();
-    Log.verbose(F("[GPS] Location Fix: "));
-    if(gps.location.isValid()) {
-      VERBOSE_F("%F lat, %F lng", gps.location.lat(), gps.location.lng());
-    } else {
-      VERBOSE("no"); 
-    }
-    Log.verbose(F("[GPS] Date/Time: "));
-    if(gps.date.isValid()) {
-      VERBOSE_F("%d-%d-%dT%d:%d:%d.%d", 
-        gps.date.year(),
-        gps.date.month(),
-        gps.date.day(),
-        gps.time.hour(),
-        gps.time.minute(),
-        gps.time.second(),
-        gps.time.centisecond()
-      );
-    } else {
-      VERBOSE("no");
-    }
+void GPS::update_status() {
+  if(_suspended) {
+    // No updates are expected in backup mode: keep the last known status
+    return;
+  }
+  Status status = NoFix;
+  if(hasFix()) {
+    status = Fix;
+  } else if(_status != NoFix || hasDateTime()) {
+    // Date/time never gets invalidated once received
+    status = TimeFix;
   }
-  #endif
+  // Updated before publishing: the subscribers read status()
+  Status previous = _status;
+  _status = status;
+  // Independent of the status: a fix can come before any dated sentence (GGA has no date)
+  if(!_time_acquired && hasDateTime()) {
+    _time_acquired = true;
+    _time_to_time_fix = millis() - _begin_time;
+    TRACE_F("[GPS] Date/Time fix after %d ms", _time_to_time_fix);
+    events.publish(EventBus::GPSTimeAcquired);
+  }
+  if(status == previous) {
+    return;
+  }
+  if(status == Fix) {
+    events.publish(EventBus::GPSFixAcquired);
+  } else if(previous == Fix) {
+    TRACE("[GPS] Location fix lost");
+    // The next fix may be somewhere else: don't average it with the old ones
+    _position.reset();
+    _last_filtered_time = 0;
+    events.publish(EventBus::GPSFixLost);
+  }
+}
+
+time_t GPS::utc() const {
+#ifdef GPS_INTERRUPT_PARSING
+  // Date and time from the same sentence
+  Snapshot snapshot = _fix.read();
+  TinyGPSDate &date = snapshot.date;
+  TinyGPSTime &time = snapshot.time;
+#else
+  TinyGPSDate date = this->date();
+  TinyGPSTime time = this->time();
+#endif
+  tmElements_t _time{
+    time.second(), time.minute(), time.hour(),
+    0,
+    date.day(), date.month(), static_cast<uint8_t>(CalendarYrToTm(date.year())),
+  };
+  // GPS time refers to the fix epoch, just before the sentence started arriving
+  uint32_t elapsed = time.centisecond() * 10UL + (millis() - time.arrivalMillis());
+  return makeTime(_time) + (elapsed + 500) / 1000;
+}
 
+void GPS::filter_location(uint32_t fix_time, TinyGPSLocation &location, TinyGPSDecimal &hdop, TinyGPSInteger &satellites) {
+  // RMC and GGA both commit the same fix: feed each epoch only once
+  if(fix_time == _last_filtered_time) {
+    return;
+  }
+  _last_filtered_time = fix_time;
+  bool was_confident = _position.is_confident();
+  _position.add(
+    location.lat(),
+    location.lng(),
+    hdop.isValid() ? hdop.value() : 0,
+    satellites.isValid() ? satellites.value() : 0
+  );
+  if(!was_confident && _position.is_confident()) {
+    TRACE_F("[GPS] Stable position after %d samples (%d rejected), error: %F m", _position.samples(), _position.rejected(), _position.error_meters());
+    events.publish(EventBus::GPSPositionStable);
+  }
 }
 
 void GPS::sleep() {
   VERBOSE("Suspending GPS");
-  for (uint8_t i = 0; i < sizeof(sleepMessage); i++)
+  for (uint8_t i = 0; i < sizeof(sleepMessage); i++) {
     port.write(sleepMessage[i]);
-  delay(1000);
+    CAPTURE_TX(port, sleepMessage[i]);
+  }
   _suspended = true;
-
 }
 
+// Any byte wakes the receiver up; it starts sending again once booted, the no data timeout covers it
 void GPS::resume() {
   VERBOSE("Resuming GPS");
-  delay(500);
-  for (int i = 0; i < 10; i++)
+  for (int i = 0; i < 10; i++) {
     port.write("\xFF");
-  delay(500);
+    CAPTURE_TX(port, "\xFF");
+  }
+  _last_data_time = millis();
   _suspended = false;
 }
 
+uint32_t GPS::ppsCount() const {
+  return ppsCounter;
+}
+
 GPS::Status GPS::status() const {
     return _status;
 }
@@ -1,19 +1,79 @@
 #pragma once
 #include "Arduino.h"
 #include "TinyGPS++.h"
+#include "position_filter.h"
+#include "events.h"
+#include "seqlock.h"
+#include "defines.h"
+
+// Location fix is considered lost after this many milliseconds without updates
+#define GPS_FIX_TIMEOUT 5000
+// The receiver is considered unresponsive after this many milliseconds without data
+#define GPS_NO_DATA_TIMEOUT 5000
+// With GPS_INTERRUPT_PARSING, period of the timer interrupt parsing the received bytes:
+// the 64 bytes RX buffer takes 66 ms to fill up at 9600 baud
+#define GPS_DRAIN_PERIOD_US 10000
 
 class GPS {
 public:
-    GPS(HardwareSerial &port);
+    // The timer is only used with GPS_INTERRUPT_PARSING
+    GPS(HardwareSerial &port, HardwareTimer &timer, EventBus &events);
     void begin();
     void process();
+    // Log current GPS state
+    void debug();
+    // Backup mode: neither blocks. The firmware never resumes it, once suspended after sync.
     void sleep();
     void resume();
+    inline bool isSuspended() const { return _suspended; }
+    // Number of PPS pulses received (only if GPS_PPS_PIN is set)
+    uint32_t ppsCount() const;
+#ifdef GPS_INTERRUPT_PARSING
+    inline TinyGPSLocation location() const { return _fix.read().location; }
+    inline TinyGPSDate date() const { return _fix.read().date; }
+    inline TinyGPSTime time() const { return _fix.read().time; }
+#else
     inline TinyGPSLocation location() const { return gps.location; }
     inline TinyGPSDate date() const { return gps.date; }
     inline TinyGPSTime time() const { return gps.time; }
-    inline bool hasFix() const { return gps.location.isValid(); }
+#endif
+    inline bool hasFix() const { TinyGPSLocation location = this->location(); return location.isValid() && location.age() < GPS_FIX_TIMEOUT; }
     inline bool hasDateTime() const { return date().isValid() && date().year() >= 2019; }
+    // Current UTC time from the last GPS date/time, accounting for the time elapsed since it was received
+    time_t utc() const;
+    // Milliseconds from begin() to the first date/time fix, 0 if not available yet
+    inline uint32_t timeToTimeFix() const { return _time_to_time_fix; }
+    // millis() at the first byte received from the GPS, since boot (cold boot time), 0 if not available yet
+    inline uint32_t firstDataTime() const { return _first_data_time; }
+    // Filtered position, averaged over several fixes
+    inline const PositionFilter &position() const { return _position; }
+    inline bool hasStableFix() const { return hasFix() && _position.is_confident(); }
+    // Per satellite details, from GSV/GSA sentences. Not synchronised: with
+    // GPS_INTERRUPT_PARSING they are read while the parser may update them.
+    inline const TinyGPSSatelliteTable &satelliteTable() const { return gps.satelliteTable; }
+    struct Counters {
+        uint32_t chars;
+        uint32_t sentencesWithFix;
+        uint32_t passedChecksum;
+        uint32_t failedChecksum;
+    };
+#ifdef GPS_INTERRUPT_PARSING
+    inline TinyGPSInteger fixType() const { return _fix.read().fixType; }
+    inline TinyGPSDecimal pdop() const { return _fix.read().pdop; }
+    inline TinyGPSDecimal vdop() const { return _fix.read().vdop; }
+    inline uint8_t satellitesInView() const { return _fix.read().satellitesInView; }
+    inline uint8_t satellitesUsed() const { return _fix.read().satellitesUsed; }
+    // NMEA parser counters
+    inline Counters counters() const { return _fix.read().counters; }
+#else
+    inline TinyGPSInteger fixType() const { return gps.fixType; }
+    inline TinyGPSDecimal pdop() const { return gps.pdop; }
+    inline TinyGPSDecimal vdop() const { return gps.vdop; }
+    inline uint8_t satellitesInView() const { return gps.satelliteTable.count(); }
+    inline uint8_t satellitesUsed() const { return gps.satelliteTable.usedCount(); }
+    // NMEA parser counters
+    inline Counters counters() const { return counters_of(gps); }
+#endif
     
     enum Status {
         NoFix = 0,
@@ -24,9 +84,47 @@ public:
 
 private:
     HardwareSerial &port;
+    HardwareTimer &timer;
+    EventBus &events;
     TinyGPSPlus gps;
+#ifdef GPS_INTERRUPT_PARSING
+    // Parser state, published by the timer interrupt after each batch of bytes
+    struct Snapshot {
+        TinyGPSLocation location;
+        TinyGPSDate date;
+        TinyGPSTime time;
+        TinyGPSDecimal hdop;
+        TinyGPSInteger satellites;
+        TinyGPSInteger fixType;
+        TinyGPSDecimal pdop;
+        TinyGPSDecimal vdop;
+        uint8_t satellitesInView;
+        uint8_t satellitesUsed;
+        Counters counters;
+    };
+    SeqLock<Snapshot> _fix;
+    volatile uint32_t _bytes_received = 0;
+    uint32_t _last_bytes_received = 0;
+    uint32_t _last_sentences_with_fix = 0;
+    static void on_timer();
+    void drain();
+#endif
     bool _suspended = false;
     Status _status = NoFix;
+    // GPSTimeAcquired was published: a valid date and time were received
+    bool _time_acquired = false;
+    PositionFilter _position;
+    uint32_t _begin_time = 0;
+    uint32_t _time_to_time_fix = 0;
+    uint32_t _last_filtered_time = 0;
+    uint32_t _last_data_time = 0;
+    uint32_t _first_data_time = 0;
+    bool _no_data = false;
+    static inline Counters counters_of(const TinyGPSPlus &parser) {
+        return Counters{parser.charsProcessed(), parser.sentencesWithFix(), parser.passedChecksum(), parser.failedChecksum()};
+    }
+    void filter_location(uint32_t fix_time, TinyGPSLocation &location, TinyGPSDecimal &hdop, TinyGPSInteger &satellites);
+    void update_status();
 };
 
 // vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
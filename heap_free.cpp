@@ -0,0 +1,57 @@
+// With HEAP_FREE, the link fails if anything in the firmware can allocate from the heap.
+//
+// These replace the newlib allocator, and reference a symbol that is never defined.
+// Functions are in their own sections, garbage collected by the linker when nothing
+// calls them: only a reachable allocation leaves the undefined reference behind.
+// The linker then reports "undefined reference to heap_free_violation"; link with
+// -Wl,--trace-symbol=malloc (or _malloc_r, realloc...) to find the caller.
+#include "defines.h"
+
+#if defined(HEAP_FREE) && !defined(HOST_BUILD)
+#include <stddef.h>
+
+extern "C" {
+  // Never defined
+  void heap_free_violation();
+
+  void *malloc(size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  void *calloc(size_t, size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  void *realloc(void *, size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  // Reentrant variants, called directly by newlib (stdio buffers, dtoa)
+  void *_malloc_r(struct _reent *, size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  void *_calloc_r(struct _reent *, size_t, size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  void *_realloc_r(struct _reent *, void *, size_t) {
+    heap_free_violation();
+    return NULL;
+  }
+
+  // Nothing was allocated
+  void free(void *) {
+  }
+
+  void _free_r(struct _reent *, void *) {
+  }
+}
+#endif
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,447 @@
+// Offline analysis of raw NMEA logs recorded from the GPS port.
+// The log is memory mapped and split at '$' boundaries into chunks, parsed in
+// parallel with the firmware TinyGPS++ parser (one instance per chunk); the per
+// epoch results are then joined in order for the fix, checksum and position reports.
+#include "TinyGPS++.h"
+#include "nmea_scan.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Chunks per thread, so that threads finishing early pick up more work
+#define ANALYZER_CHUNKS_PER_THREAD 4
+// Fixes further apart than this are reported as an outage
+#define ANALYZER_OUTAGE_CS 200
+#define ANALYZER_CENTISECONDS_PER_DAY 8640000L
+#define METERS_PER_DEGREE 111194.93
+
+// TinyGPS++ reads millis() for the fix ages only, which mean nothing offline.
+// Parsers run on several threads: keep them off the shared virtual clock.
+uint32_t millis() {
+  return 0;
+}
+
+namespace {
+  struct Epoch {
+    // Since midnight, from the sentence time. Negative for the sentences at the
+    // start of a chunk, before the first time: they belong to the previous chunk
+    int32_t time_cs = -1;
+    bool fix = false;
+    double lat = 0;
+    double lng = 0;
+    int satellites = -1;
+    int hdop = -1;
+    int fix_type = -1;
+  };
+
+  struct ChecksumFailure {
+    uint64_t offset;
+    std::string type;
+    // No checksum, or the computed and received ones differ
+    bool missing;
+    uint8_t computed;
+    uint8_t transmitted;
+  };
+
+  struct Analysis {
+    uint64_t bytes = 0;
+    uint64_t sentences = 0;
+    uint64_t invalid = 0;
+    uint64_t missing = 0;
+    uint32_t passed = 0;
+    uint32_t failed = 0;
+    std::map<std::string, uint64_t> sentence_types;
+    std::map<std::string, uint64_t> failed_types;
+    std::vector<ChecksumFailure> failures;
+    std::vector<Epoch> epochs;
+    std::string date;
+  };
+
+  class Log {
+  public:
+    explicit Log(const char *path) {
+      int fd = open(path, O_RDONLY);
+      if(fd < 0) {
+        _error = std::string(path) + ": " + strerror(errno);
+        return;
+      }
+      struct stat info;
+      if(fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+          _data = static_cast<const char*>(data);
+          _size = info.st_size;
+          madvise(data, _size, MADV_WILLNEED);
+        }
+      }
+      close(fd);
+      if(!_data) {
+        _error = std::string(path) + ": can't map the file";
+      }
+    }
+    ~Log() {
+      if(_data) {
+        munmap(const_cast<char*>(_data), _size);
+      }
+    }
+    Log(const Log&) = delete;
+    Log &operator=(const Log&) = delete;
+
+    inline const std::string &error() const { return _error; }
+    inline const char *data() const { return _data; }
+    inline size_t size() const { return _size; }
+  private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+    std::string _error;
+  };
+
+  std::string sentence_type(const char *begin, const char *end) {
+    std::string type;
+    for(const char *c = begin + 1; c < end && type.size() < 5 && isalnum(*c); c++) {
+      type += *c;
+    }
+    return type.empty() ? "?" : type;
+  }
+
+  int32_t time_cs(uint32_t hhmmsscc) {
+    return (hhmmsscc / 1000000) * 360000 + (hhmmsscc / 10000 % 100) * 6000 + hhmmsscc % 10000;
+  }
+
+  void parse_chunk(const char *log, const char *begin, const char *end, size_t max_failures, Analysis &result) {
+    TinyGPSPlus gps;
+    result.bytes = end - begin;
+    result.epochs.push_back(Epoch());
+    const char *sentence = nmea_scan::find(begin, end, '$');
+    for(const char *c = begin; c < sentence; c++) {
+      gps.encode(*c);
+    }
+    while(sentence < end) {
+      const char *next = nmea_scan::find(sentence + 1, end, '$');
+      std::string type = sentence_type(sentence, next);
+      result.sentences++;
+      result.sentence_types[type]++;
+      uint8_t computed, transmitted = 0;
+      nmea_scan::Result checked = nmea_scan::check(sentence, next, computed, transmitted);
+      if(checked != nmea_scan::Valid) {
+        (checked == nmea_scan::Invalid ? result.invalid : result.missing)++;
+        result.failed_types[type]++;
+        if(result.failures.size() < max_failures) {
+          result.failures.push_back({static_cast<uint64_t>(sentence - log), type, checked == nmea_scan::Missing, computed, transmitted});
+        }
+      }
+
+      for(const char *c = sentence; c < next; c++) {
+        gps.encode(*c);
+      }
+      if(gps.time.isUpdated()) {
+        int32_t time = time_cs(gps.time.value());
+        if(result.epochs.back().time_cs != time) {
+          result.epochs.push_back(Epoch());
+          result.epochs.back().time_cs = time;
+        }
+      }
+      if(gps.date.isUpdated() && result.date.empty()) {
+        char date[16];
+        snprintf(date, sizeof(date), "%04d-%02d-%02d", gps.date.year(), gps.date.month(), gps.date.day());
+        result.date = date;
+      }
+      Epoch &epoch = result.epochs.back();
+      if(gps.location.isUpdated()) {
+        epoch.fix = true;
+        epoch.lat = gps.location.lat();
+        epoch.lng = gps.location.lng();
+      }
+      if(gps.satellites.isUpdated()) {
+        epoch.satellites = gps.satellites.value();
+      }
+      if(gps.hdop.isUpdated()) {
+        epoch.hdop = gps.hdop.value();
+      }
+      if(gps.fixType.isUpdated()) {
+        epoch.fix_type = gps.fixType.value();
+      }
+      sentence = next;
+    }
+    result.passed = gps.passedChecksum();
+    result.failed = gps.failedChecksum();
+  }
+
+  // Chunk boundaries, on '$' characters
+  std::vector<const char*> split(const Log &log, size_t chunks) {
+    std::vector<const char*> boundaries{log.data()};
+    const char *end = log.data() + log.size();
+    for(size_t i = 1; i < chunks; i++) {
+      const char *boundary = nmea_scan::find(std::max(boundaries.back(), log.data() + log.size() / chunks * i), end, '$');
+      if(boundary > boundaries.back() && boundary < end) {
+        boundaries.push_back(boundary);
+      }
+    }
+    boundaries.push_back(end);
+    return boundaries;
+  }
+
+  std::vector<Analysis> analyse(const Log &log, unsigned threads, size_t max_failures) {
+    std::vector<const char*> boundaries = split(log, threads * ANALYZER_CHUNKS_PER_THREAD);
+    std::vector<Analysis> results(boundaries.size() - 1);
+    std::atomic<size_t> next_chunk{0};
+    auto worker = [&] {
+      for(size_t chunk; (chunk = next_chunk++) < results.size();) {
+        parse_chunk(log.data(), boundaries[chunk], boundaries[chunk + 1], max_failures, results[chunk]);
+      }
+    };
+    std::vector<std::thread> pool;
+    for(unsigned i = 1; i < threads; i++) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for(std::thread &thread : pool) {
+      thread.join();
+    }
+    return results;
+  }
+
+  // Joins the chunks in log order
+  Analysis merge(std::vector<Analysis> &chunks, size_t max_failures) {
+    Analysis total;
+    for(Analysis &chunk : chunks) {
+      total.bytes += chunk.bytes;
+      total.sentences += chunk.sentences;
+      total.invalid += chunk.invalid;
+      total.missing += chunk.missing;
+      total.passed += chunk.passed;
+      total.failed += chunk.failed;
+      for(auto &type : chunk.sentence_types) {
+        total.sentence_types[type.first] += type.second;
+      }
+      for(auto &type : chunk.failed_types) {
+        total.failed_types[type.first] += type.second;
+      }
+      for(ChecksumFailure &failure : chunk.failures) {
+        if(total.failures.size() < max_failures) {
+          total.failures.push_back(failure);
+        }
+      }
+      if(total.date.empty()) {
+        total.date = chunk.date;
+      }
+      auto epoch = chunk.epochs.begin();
+      // Sentences before the first time, and the first epoch when it started in the previous chunk
+      for(; epoch != chunk.epochs.end(); ++epoch) {
+        if(total.epochs.empty()) {
+          if(epoch->time_cs < 0) {
+            continue;
+          }
+          break;
+        }
+        Epoch &last = total.epochs.back();
+        if(epoch->time_cs >= 0 && epoch->time_cs != last.time_cs) {
+          break;
+        }
+        if(epoch->fix) {
+          last.fix = true;
+          last.lat = epoch->lat;
+          last.lng = epoch->lng;
+        }
+        last.satellites = epoch->satellites >= 0 ? epoch->satellites : last.satellites;
+        last.hdop = epoch->hdop >= 0 ? epoch->hdop : last.hdop;
+        last.fix_type = epoch->fix_type >= 0 ? epoch->fix_type : last.fix_type;
+      }
+      total.epochs.insert(total.epochs.end(), epoch, chunk.epochs.end());
+    }
+    return total;
+  }
+
+  std::string format_time(int64_t cs) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld:%02lld:%02lld.%02lld",
+      static_cast<long long>(cs / 360000), static_cast<long long>(cs / 6000 % 60),
+      static_cast<long long>(cs / 100 % 60), static_cast<long long>(cs % 100));
+    return buffer;
+  }
+
+  double percentile(std::vector<double> &sorted, double fraction) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+  }
+
+  void report(const Analysis &analysis) {
+    printf("Log: %llu bytes, %llu sentences\n", static_cast<unsigned long long>(analysis.bytes), static_cast<unsigned long long>(analysis.sentences));
+    for(auto &type : analysis.sentence_types) {
+      printf("  %-6s %llu\n", type.first.c_str(), static_cast<unsigned long long>(type.second));
+    }
+
+    printf("\nChecksums: %llu invalid, %llu missing (parser: %u passed, %u failed)\n",
+      static_cast<unsigned long long>(analysis.invalid), static_cast<unsigned long long>(analysis.missing), analysis.passed, analysis.failed);
+    for(auto &type : analysis.failed_types) {
+      printf("  %-6s %llu\n", type.first.c_str(), static_cast<unsigned long long>(type.second));
+    }
+    for(const ChecksumFailure &failure : analysis.failures) {
+      if(!failure.missing) {
+        printf("  offset %llu: %s computed %02X, received %02X\n", static_cast<unsigned long long>(failure.offset), failure.type.c_str(), failure.computed, failure.transmitted);
+      } else {
+        printf("  offset %llu: %s without checksum\n", static_cast<unsigned long long>(failure.offset), failure.type.c_str());
+      }
+    }
+
+    // Timeline: time of day only, so that days are counted at midnight wrap arounds
+    const std::vector<Epoch> &epochs = analysis.epochs;
+    if(epochs.empty()) {
+      printf("\nNo epochs\n");
+      return;
+    }
+    int64_t now = 0;
+    int64_t first_fix = -1;
+    int64_t last_fix = -1;
+    int64_t longest_outage = 0;
+    uint64_t outages = 0;
+    uint64_t fixes = 0;
+    uint64_t fix_types[4] = {};
+    double satellites = 0, hdop = 0;
+    uint64_t satellites_count = 0, hdop_count = 0;
+    for(size_t i = 0; i < epochs.size(); i++) {
+      if(i > 0) {
+        now += ((epochs[i].time_cs - epochs[i - 1].time_cs) % ANALYZER_CENTISECONDS_PER_DAY + ANALYZER_CENTISECONDS_PER_DAY) % ANALYZER_CENTISECONDS_PER_DAY;
+      }
+      const Epoch &epoch = epochs[i];
+      if(epoch.fix_type >= 0 && epoch.fix_type < 4) {
+        fix_types[epoch.fix_type]++;
+      }
+      if(!epoch.fix) {
+        continue;
+      }
+      fixes++;
+      if(first_fix < 0) {
+        first_fix = now;
+      } else if(now - last_fix > ANALYZER_OUTAGE_CS) {
+        outages++;
+        longest_outage = std::max(longest_outage, now - last_fix);
+      }
+      last_fix = now;
+      if(epoch.satellites >= 0) {
+        satellites += epoch.satellites;
+        satellites_count++;
+      }
+      if(epoch.hdop >= 0) {
+        hdop += epoch.hdop / 100.0;
+        hdop_count++;
+      }
+    }
+    printf("\nFixes: %s %s UTC, duration %s, %llu epochs\n",
+      analysis.date.empty() ? "(no date)" : analysis.date.c_str(), format_time(epochs.front().time_cs).c_str(),
+      format_time(now).c_str(), static_cast<unsigned long long>(epochs.size()));
+    if(first_fix < 0) {
+      printf("  no position fix\n");
+      return;
+    }
+    printf("  time to first fix: %s\n", format_time(first_fix).c_str());
+    printf("  epochs with fix: %llu (%.1f%%)\n", static_cast<unsigned long long>(fixes), 100.0 * fixes / epochs.size());
+    printf("  outages over %.1f s: %llu, longest %s\n", ANALYZER_OUTAGE_CS / 100.0, static_cast<unsigned long long>(outages), format_time(longest_outage).c_str());
+    printf("  GSA fix type: %llu none, %llu 2D, %llu 3D\n", static_cast<unsigned long long>(fix_types[1]), static_cast<unsigned long long>(fix_types[2]), static_cast<unsigned long long>(fix_types[3]));
+    printf("  mean satellites: %.1f, mean HDOP: %.2f\n", satellites_count ? satellites / satellites_count : 0, hdop_count ? hdop / hdop_count : 0);
+
+    // Scatter around the mean position, on a local flat projection
+    double lat = 0, lng = 0;
+    for(const Epoch &epoch : epochs) {
+      if(epoch.fix) {
+        lat += epoch.lat / fixes;
+        lng += epoch.lng / fixes;
+      }
+    }
+    double east_scale = METERS_PER_DEGREE * cos(lat * M_PI / 180);
+    double north_variance = 0, east_variance = 0;
+    double min_north = 0, max_north = 0, min_east = 0, max_east = 0;
+    std::vector<double> distances;
+    for(const Epoch &epoch : epochs) {
+      if(!epoch.fix) {
+        continue;
+      }
+      double north = (epoch.lat - lat) * METERS_PER_DEGREE;
+      double east = (epoch.lng - lng) * east_scale;
+      north_variance += north * north / fixes;
+      east_variance += east * east / fixes;
+      min_north = std::min(min_north, north);
+      max_north = std::max(max_north, north);
+      min_east = std::min(min_east, east);
+      max_east = std::max(max_east, east);
+      distances.push_back(sqrt(north * north + east * east));
+    }
+    std::sort(distances.begin(), distances.end());
+    printf("\nPosition: %.7f, %.7f\n", lat, lng);
+    printf("  standard deviation: %.2f m north, %.2f m east\n", sqrt(north_variance), sqrt(east_variance));
+    printf("  CEP50: %.2f m, CEP95: %.2f m, max: %.2f m\n", percentile(distances, 0.5), percentile(distances, 0.95), distances.back());
+    printf("  extent: %.2f m north-south, %.2f m east-west\n", max_north - min_north, max_east - min_east);
+  }
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options] log.nmea\n"
+      "  --threads N     parser threads (default: all cores, %u)\n"
+      "  --failures N    checksum failures to list (default 10)\n"
+      "  --scaling       measure the throughput from 1 thread up to --threads\n",
+      name, std::max(1u, std::thread::hardware_concurrency()));
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t max_failures = 10;
+  bool scaling = false;
+  const char *path = nullptr;
+  for(int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if(!strcmp(argv[i], "--threads") && has_value) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if(!strcmp(argv[i], "--failures") && has_value) {
+      max_failures = strtoul(argv[++i], nullptr, 10);
+    } else if(!strcmp(argv[i], "--scaling")) {
+      scaling = true;
+    } else if(argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if(!path) {
+    usage(argv[0]);
+    return 1;
+  }
+  Log log(path);
+  if(!log.error().empty()) {
+    fprintf(stderr, "%s\n", log.error().c_str());
+    return 1;
+  }
+
+  if(scaling) {
+    printf("Threads  Seconds    GB/s  Speedup (%s scan)\n", nmea_scan::implementation());
+    double single = 0;
+    for(unsigned count = 1; count <= threads; count = count < threads && count * 2 > threads ? threads : count * 2) {
+      auto start = std::chrono::steady_clock::now();
+      analyse(log, count, max_failures);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      single = count == 1 ? seconds : single;
+      printf("%7u %8.3f %7.3f %8.2f\n", count, seconds, log.size() / seconds / 1e9, single / seconds);
+    }
+    printf("\n");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Analysis> chunks = analyse(log, threads, max_failures);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  report(merge(chunks, max_failures));
+  fprintf(stderr, "\nParsed in %.3f s with %u threads (%.3f GB/s)\n", seconds, threads, log.size() / seconds / 1e9);
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
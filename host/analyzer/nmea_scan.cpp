@@ -0,0 +1,97 @@
+#include "nmea_scan.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+  int hex_value(char c) {
+    if(c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if(c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    if(c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+}
+
+namespace nmea_scan {
+
+#ifdef __SSE2__
+const char *find(const char *begin, const char *end, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  for(; end - begin >= 16; begin += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+    if(mask) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+  while(begin < end && *begin != c) {
+    begin++;
+  }
+  return begin;
+}
+
+uint8_t checksum(const char *begin, const char *end) {
+  __m128i accumulator = _mm_setzero_si128();
+  for(; end - begin >= 16; begin += 16) {
+    accumulator = _mm_xor_si128(accumulator, _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)));
+  }
+  // Fold the 16 lanes into the lowest one
+  accumulator = _mm_xor_si128(accumulator, _mm_srli_si128(accumulator, 8));
+  accumulator = _mm_xor_si128(accumulator, _mm_srli_si128(accumulator, 4));
+  accumulator = _mm_xor_si128(accumulator, _mm_srli_si128(accumulator, 2));
+  accumulator = _mm_xor_si128(accumulator, _mm_srli_si128(accumulator, 1));
+  uint8_t result = _mm_cvtsi128_si32(accumulator) & 0xFF;
+  while(begin < end) {
+    result ^= *begin++;
+  }
+  return result;
+}
+
+const char *implementation() {
+  return "SSE2";
+}
+#else
+const char *find(const char *begin, const char *end, char c) {
+  while(begin < end && *begin != c) {
+    begin++;
+  }
+  return begin;
+}
+
+uint8_t checksum(const char *begin, const char *end) {
+  uint8_t result = 0;
+  while(begin < end) {
+    result ^= *begin++;
+  }
+  return result;
+}
+
+const char *implementation() {
+  return "scalar";
+}
+#endif
+
+Result check(const char *begin, const char *end, uint8_t &computed, uint8_t &transmitted) {
+  const char *star = find(begin + 1, end, '*');
+  computed = checksum(begin + 1, star);
+  if(end - star < 3) {
+    return Missing;
+  }
+  int high = hex_value(star[1]);
+  int low = hex_value(star[2]);
+  if(high < 0 || low < 0) {
+    return Missing;
+  }
+  transmitted = high * 16 + low;
+  return transmitted == computed ? Valid : Invalid;
+}
+
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
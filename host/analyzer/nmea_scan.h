@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Delimiter search and checksum of raw NMEA data, 16 bytes at a time with SSE2
+// when the host supports it, one byte at a time otherwise.
+namespace nmea_scan {
+  // First c in [begin, end), end if there's none
+  const char *find(const char *begin, const char *end, char c);
+  // XOR of every byte in [begin, end): the NMEA checksum of the sentence body
+  uint8_t checksum(const char *begin, const char *end);
+  // Name of the implementation in use
+  const char *implementation();
+
+  enum Result {
+    Valid,
+    Invalid,
+    // No '*' followed by two hex digits
+    Missing,
+  };
+
+  // Checks the sentence starting with '$' at begin, ending before end.
+  // Sets the checksum computed from the body and, if present, the transmitted one.
+  Result check(const char *begin, const char *end, uint8_t &computed, uint8_t &transmitted);
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,417 @@
+// Microbenchmarks of the parsing and conversion kernels, with fixed inputs and
+// iteration counts so that runs are comparable. Results are written as JSON.
+//
+// The default mode measures wall clock time. --instructions counts the user space
+// instructions retired instead (Linux perf events): it doesn't depend on the host
+// clock, caches or load, so it tracks the relative Cortex-M3 cost of the kernels
+// better, although host and ARM instruction counts differ.
+#include "Arduino.h"
+#include "TinyGPS++.h"
+#include "nexstar_data.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_DEFAULT_REPETITIONS 7
+
+namespace {
+  // Keeps the compiler from optimising away values that are never used
+  template<typename T> inline void keep(const T &value) {
+    asm volatile("" : : "r"(&value) : "memory");
+  }
+
+  struct Benchmark {
+    std::string name;
+    uint32_t iterations;
+    // Input bytes processed per iteration, 0 if not meaningful
+    uint32_t bytes;
+    std::function<void(uint32_t iterations)> run;
+  };
+
+  struct Result {
+    const Benchmark *benchmark;
+    // Per iteration, one value per repetition: nanoseconds, or instructions
+    std::vector<double> samples;
+  };
+
+  class InstructionCounter {
+  public:
+    InstructionCounter() {
+#ifdef __linux__
+      perf_event_attr attributes;
+      memset(&attributes, 0, sizeof(attributes));
+      attributes.size = sizeof(attributes);
+      attributes.type = PERF_TYPE_HARDWARE;
+      attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+      attributes.disabled = 1;
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv = 1;
+      _fd = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+#endif
+    }
+    ~InstructionCounter() {
+#ifdef __linux__
+      if(_fd >= 0) {
+        close(_fd);
+      }
+#endif
+    }
+    inline bool is_valid() const { return _fd >= 0; }
+    void start() {
+#ifdef __linux__
+      ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    uint64_t stop() {
+      uint64_t count = 0;
+#ifdef __linux__
+      ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if(::read(_fd, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+#endif
+      return count;
+    }
+  private:
+    int _fd = -1;
+  };
+
+  // Stream over a fixed buffer, rewound for each reply
+  class BufferStream : public Stream {
+  public:
+    explicit BufferStream(const char *data) : _data(data), _size(strlen(data)) {}
+    int available() override { return _size - _position; }
+    int read() override { return _position < _size ? static_cast<uint8_t>(_data[_position++]) : -1; }
+    int peek() override { return _position < _size ? static_cast<uint8_t>(_data[_position]) : -1; }
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    inline void rewind() { _position = 0; }
+  private:
+    const char *_data;
+    size_t _size;
+    size_t _position = 0;
+  };
+
+  const char *const sentences[][2] = {
+    {"RMC", "$GPRMC,123519.00,A,4807.03812,N,01131.00012,E,0.022,,230394,,,A*70\r\n"},
+    {"GGA", "$GPGGA,123519.00,4807.03812,N,01131.00012,E,1,08,0.91,545.4,M,46.9,M,,*58\r\n"},
+    {"GSA", "$GNGSA,A,3,21,05,29,25,12,10,26,02,,,,,1.72,1.03,1.38*1E\r\n"},
+    {"GSV", "$GPGSV,3,1,11,02,48,298,24,05,25,061,41,10,12,275,,12,32,079,42*78\r\n"},
+    {"ZDA", "$GPZDA,123519.00,23,03,1994,00,00*6C\r\n"},
+    {"TXT", "$GPTXT,01,01,02,u-blox AG - www.u-blox.com*50\r\n"},
+  };
+
+  // Custom fields of the epoch below: 4 of them are read in the first benchmarks, 16 in the others
+  const struct {
+    const char *sentence;
+    int term;
+  } customFields[] = {
+    {"GPRMC", 9}, {"GPGGA", 7}, {"GNGSA", 16}, {"GPGSV", 3},
+    {"GPRMC", 1}, {"GPRMC", 2}, {"GPRMC", 7}, {"GPGGA", 1},
+    {"GPGGA", 6}, {"GPGGA", 8}, {"GPGGA", 9}, {"GNGSA", 2},
+    {"GNGSA", 15}, {"GNGSA", 17}, {"GPGSV", 1}, {"GPGSV", 2},
+  };
+  TINYGPS_CUSTOM_FIELD(F0, "GPRMC", 9);
+  TINYGPS_CUSTOM_FIELD(F1, "GPGGA", 7);
+  TINYGPS_CUSTOM_FIELD(F2, "GNGSA", 16);
+  TINYGPS_CUSTOM_FIELD(F3, "GPGSV", 3);
+  TINYGPS_CUSTOM_FIELD(F4, "GPRMC", 1);
+  TINYGPS_CUSTOM_FIELD(F5, "GPRMC", 2);
+  TINYGPS_CUSTOM_FIELD(F6, "GPRMC", 7);
+  TINYGPS_CUSTOM_FIELD(F7, "GPGGA", 1);
+  TINYGPS_CUSTOM_FIELD(F8, "GPGGA", 6);
+  TINYGPS_CUSTOM_FIELD(F9, "GPGGA", 8);
+  TINYGPS_CUSTOM_FIELD(F10, "GPGGA", 9);
+  TINYGPS_CUSTOM_FIELD(F11, "GNGSA", 2);
+  TINYGPS_CUSTOM_FIELD(F12, "GNGSA", 15);
+  TINYGPS_CUSTOM_FIELD(F13, "GNGSA", 17);
+  TINYGPS_CUSTOM_FIELD(F14, "GPGSV", 1);
+  TINYGPS_CUSTOM_FIELD(F15, "GPGSV", 2);
+
+  // Encodes the RMC, GGA, GSA and GSV sentences, reading every custom field
+  template<typename Fields> void encode_custom(TinyGPSPlus &gps, Fields &fields, const std::string &input, uint32_t iterations) {
+    for(uint32_t i = 0; i < iterations; i++) {
+      for(char c : input) {
+        keep(gps.encode(c));
+      }
+      fields.read();
+    }
+  }
+
+  template<typename... Fields> struct CompiledFields {
+    TinyGPSCustomFields<Fields...> fields;
+    CompiledFields(TinyGPSPlus &gps) : fields(gps) {}
+    template<typename Field> void read_field() { keep(fields.template get<Field>().value()); }
+    void read() {
+      // Expands read_field for every field
+      int expand[] = {0, (read_field<Fields>(), 0)...};
+      keep(expand);
+    }
+  };
+
+  struct RuntimeFields {
+    std::vector<TinyGPSCustom> fields;
+    RuntimeFields(TinyGPSPlus &gps, size_t count) : fields(count) {
+      for(size_t i = 0; i < count; i++) {
+        fields[i].begin(gps, customFields[i].sentence, customFields[i].term);
+      }
+    }
+    void read() {
+      for(TinyGPSCustom &field : fields) {
+        keep(field.value());
+      }
+    }
+  };
+
+  std::vector<Benchmark> benchmarks() {
+    std::vector<Benchmark> result;
+    for(auto &sentence : sentences) {
+      const char *text = sentence[1];
+      result.push_back({std::string("encode/") + sentence[0], 20000, static_cast<uint32_t>(strlen(text)), [text](uint32_t iterations) {
+        TinyGPSPlus gps;
+        for(uint32_t i = 0; i < iterations; i++) {
+          for(const char *c = text; *c; c++) {
+            keep(gps.encode(*c));
+          }
+        }
+      }});
+    }
+    // One second of RMC+GGA input, read once: every field is parsed, few are read.
+    // At 10 Hz, nine epochs out of ten are overwritten before anyone reads them.
+    for(int rate : {1, 10}) {
+      std::string input;
+      for(int epoch = 0; epoch < rate; epoch++) {
+        input += sentences[0][1];
+        input += sentences[1][1];
+      }
+      result.push_back({"epoch/" + std::to_string(rate) + "Hz", static_cast<uint32_t>(20000 / rate), static_cast<uint32_t>(input.size()), [input](uint32_t iterations) {
+        TinyGPSPlus gps;
+        for(uint32_t i = 0; i < iterations; i++) {
+          for(char c : input) {
+            keep(gps.encode(c));
+          }
+          keep(gps.location.lat());
+          keep(gps.location.lng());
+          keep(gps.hdop.value());
+          keep(gps.satellites.value());
+        }
+      }});
+    }
+    // TinyGPSCustom list against TinyGPSCustomFields, with 0, 4 and 16 fields
+    std::string epoch = std::string(sentences[0][1]) + sentences[1][1] + sentences[2][1] + sentences[3][1];
+    uint32_t epoch_size = static_cast<uint32_t>(epoch.size());
+    for(size_t count : {0, 4, 16}) {
+      result.push_back({"custom/runtime/" + std::to_string(count), 5000, epoch_size, [epoch, count](uint32_t iterations) {
+        TinyGPSPlus gps;
+        RuntimeFields fields(gps, count);
+        encode_custom(gps, fields, epoch, iterations);
+      }});
+    }
+    result.push_back({"custom/compiled/0", 5000, epoch_size, [epoch](uint32_t iterations) {
+      TinyGPSPlus gps;
+      CompiledFields<> fields(gps);
+      encode_custom(gps, fields, epoch, iterations);
+    }});
+    result.push_back({"custom/compiled/4", 5000, epoch_size, [epoch](uint32_t iterations) {
+      TinyGPSPlus gps;
+      CompiledFields<F0, F1, F2, F3> fields(gps);
+      encode_custom(gps, fields, epoch, iterations);
+    }});
+    result.push_back({"custom/compiled/16", 5000, epoch_size, [epoch](uint32_t iterations) {
+      TinyGPSPlus gps;
+      CompiledFields<F0, F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12, F13, F14, F15> fields(gps);
+      encode_custom(gps, fields, epoch, iterations);
+    }});
+    result.push_back({"parseDegrees", 1000000, 0, [](uint32_t iterations) {
+      RawDegrees degrees;
+      for(uint32_t i = 0; i < iterations; i++) {
+        TinyGPSPlus::parseDegrees("4807.03812", degrees);
+        keep(degrees);
+      }
+    }});
+    result.push_back({"parseDecimal", 1000000, 0, [](uint32_t iterations) {
+      for(uint32_t i = 0; i < iterations; i++) {
+        keep(TinyGPSPlus::parseDecimal("-545.47"));
+      }
+    }});
+    result.push_back({"TinyGPSLocation::lat+lng", 1000000, 0, [](uint32_t iterations) {
+      TinyGPSPlus gps;
+      for(const char *c = sentences[1][1]; *c; c++) {
+        gps.encode(*c);
+      }
+      for(uint32_t i = 0; i < iterations; i++) {
+        keep(gps.location.lat());
+        keep(gps.location.lng());
+      }
+    }});
+    result.push_back({"LatLng", 1000000, 0, [](uint32_t iterations) {
+      volatile double latitude = -45.464211;
+      for(uint32_t i = 0; i < iterations; i++) {
+        LatLng value(latitude);
+        keep(value);
+      }
+    }});
+    result.push_back({"NexstarTime", 1000000, 0, [](uint32_t iterations) {
+      volatile time_t timestamp = 1704139200;
+      for(uint32_t i = 0; i < iterations; i++) {
+        NexstarTime value(timestamp, 1, 0);
+        keep(value);
+      }
+    }});
+    result.push_back({"NexstarReply::read", 1000000, 9, [](uint32_t iterations) {
+      BufferStream port("\x0c\x1e\x14\x01\x01\x18\x01\x00#");
+      NexstarReply reply;
+      for(uint32_t i = 0; i < iterations; i++) {
+        port.rewind();
+        reply.reset();
+        keep(reply.read(port));
+      }
+    }});
+    result.push_back({"NexstarReply::equals", 1000000, 0, [](uint32_t iterations) {
+      BufferStream port("\x0c\x1e\x14\x01\x01\x18\x01\x00#");
+      NexstarReply reply;
+      reply.read(port);
+      volatile const char *expected = "\x0c\x1e\x14\x01\x01\x18\x01\x00#";
+      for(uint32_t i = 0; i < iterations; i++) {
+        keep(reply.equals(const_cast<const char*>(expected), 9));
+      }
+    }});
+    result.push_back({"NexstarReply::to_hex", 200000, 0, [](uint32_t iterations) {
+      BufferStream port("\x0c\x1e\x14\x01\x01\x18\x01\x00#");
+      NexstarReply reply;
+      reply.read(port);
+      char hex[NEXSTAR_REPLY_HEX_SIZE];
+      for(uint32_t i = 0; i < iterations; i++) {
+        keep(reply.to_hex(hex));
+      }
+    }});
+    return result;
+  }
+
+  double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+  }
+
+  void write_json(FILE *output, const std::vector<Result> &results, bool instructions, int repetitions) {
+    fprintf(output, "{\n  \"context\": {\n");
+    fprintf(output, "    \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(output, "    \"build_type\": \"%s\",\n", BENCH_BUILD_TYPE);
+    fprintf(output, "    \"unit\": \"%s\",\n", instructions ? "instructions" : "ns");
+    fprintf(output, "    \"repetitions\": %d\n  },\n  \"benchmarks\": [\n", repetitions);
+    for(size_t i = 0; i < results.size(); i++) {
+      const Result &result = results[i];
+      const Benchmark &benchmark = *result.benchmark;
+      double middle = median(result.samples);
+      fprintf(output, "    {\"name\": \"%s\", \"iterations\": %u, \"bytes\": %u, ", benchmark.name.c_str(), benchmark.iterations, benchmark.bytes);
+      fprintf(output, "\"min\": %.3f, \"median\": %.3f, \"max\": %.3f",
+        *std::min_element(result.samples.begin(), result.samples.end()),
+        middle,
+        *std::max_element(result.samples.begin(), result.samples.end()));
+      if(benchmark.bytes > 0) {
+        fprintf(output, ", \"per_byte\": %.3f", middle / benchmark.bytes);
+      }
+      fprintf(output, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(output, "  ]\n}\n");
+  }
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options]\n"
+      "  --filter TEXT      only run benchmarks whose name contains TEXT\n"
+      "  --repetitions N    runs of each benchmark, the median is reported (default %d)\n"
+      "  --instructions     count instructions instead of measuring time\n"
+      "  --output FILE      JSON results file (default: standard output)\n"
+      "  --list             list the benchmarks\n",
+      name, BENCH_DEFAULT_REPETITIONS);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *filter = "";
+  const char *output_path = nullptr;
+  int repetitions = BENCH_DEFAULT_REPETITIONS;
+  bool instructions = false;
+  bool list = false;
+  for(int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if(!strcmp(argv[i], "--filter") && has_value) {
+      filter = argv[++i];
+    } else if(!strcmp(argv[i], "--repetitions") && has_value) {
+      repetitions = std::max(1, atoi(argv[++i]));
+    } else if(!strcmp(argv[i], "--output") && has_value) {
+      output_path = argv[++i];
+    } else if(!strcmp(argv[i], "--instructions")) {
+      instructions = true;
+    } else if(!strcmp(argv[i], "--list")) {
+      list = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  InstructionCounter counter;
+  if(instructions && !counter.is_valid()) {
+    fprintf(stderr, "Instruction counting is not available (perf_event_open: %s)\n", strerror(errno));
+    return 1;
+  }
+
+  std::vector<Benchmark> all = benchmarks();
+  std::vector<Result> results;
+  for(const Benchmark &benchmark : all) {
+    if(!strstr(benchmark.name.c_str(), filter)) {
+      continue;
+    }
+    if(list) {
+      printf("%s\n", benchmark.name.c_str());
+      continue;
+    }
+    Result result{&benchmark, {}};
+    // Warm up caches and branch predictors
+    benchmark.run(benchmark.iterations / 10 + 1);
+    for(int i = 0; i < repetitions; i++) {
+      double total;
+      if(instructions) {
+        counter.start();
+        benchmark.run(benchmark.iterations);
+        total = counter.stop();
+      } else {
+        auto start = std::chrono::steady_clock::now();
+        benchmark.run(benchmark.iterations);
+        total = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      }
+      result.samples.push_back(total / benchmark.iterations);
+    }
+    fprintf(stderr, "%-28s %12.1f %s\n", benchmark.name.c_str(), median(result.samples), instructions ? "instructions" : "ns");
+    results.push_back(result);
+  }
+  if(list) {
+    return 0;
+  }
+
+  FILE *output = output_path ? fopen(output_path, "w") : stdout;
+  if(!output) {
+    fprintf(stderr, "Cannot write %s: %s\n", output_path, strerror(errno));
+    return 1;
+  }
+  write_json(output, results, instructions, repetitions);
+  if(output_path) {
+    fclose(output);
+  }
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
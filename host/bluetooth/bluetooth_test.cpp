@@ -0,0 +1,154 @@
+// Bluetooth configuration test, against the simulated HC-05 (10 ms AT replies, 100 ms
+// boot) on the virtual clock: a factory module gets the name, PIN and data baud rate of
+// the settings, without process() ever waiting for a reply, and restarts in data mode.
+// Later boots skip the configuration while the backup registers hold the hash of the
+// settings; without it, the module is only written if a setting differs, as a whole
+// reply line. Exits with 1 if any check fails.
+#include "Arduino.h"
+#include "bluetooth.h"
+#include "settings.h"
+#include "defines.h"
+#include "timeline.h"
+#include "hc05_model.h"
+#include "client_model.h"
+#include "test.h"
+#include <string>
+
+// Same wiring as NexstarGPSLite.ino
+#define BT_POWER_PIN PB1
+#define BT_AT_MODE_PIN PB0
+#define LOOP_PERIOD_US 1000
+#define CONFIGURATION_TIMEOUT_US 5000000
+// Reply time of the HC-05 model: a process() call waiting for a reply takes at least as long
+#define HC05_AT_REPLY_US 10000
+
+namespace {
+  struct Boot {
+    uint64_t configuration_us;
+    uint64_t longest_process_us;
+    uint64_t at_commands;
+    uint64_t settings_writes;
+    // Still configuring when setup() returned: false if the configuration was skipped
+    bool configuring_after_setup;
+  };
+
+  // Powers the board up: configuration runs from the main loop, then the module is used in data mode
+  Boot boot(HC05Model &hc05, const Settings &settings) {
+    host::Clock &clock = host::Clock::instance();
+    Bluetooth bluetooth(Serial3, BT_POWER_PIN, BT_AT_MODE_PIN, settings);
+    uint64_t at_commands = hc05.at_commands();
+    uint64_t settings_writes = hc05.settings_writes();
+    uint64_t started = clock.now_us();
+    uint64_t longest = 0;
+    bluetooth.setup();
+    bool configuring = bluetooth.is_configuring();
+    while(bluetooth.is_configuring() && clock.now_us() - started < CONFIGURATION_TIMEOUT_US) {
+      uint64_t before = clock.now_us();
+      bluetooth.process();
+      if(clock.now_us() - before > longest) {
+        longest = clock.now_us() - before;
+      }
+      clock.advance(LOOP_PERIOD_US);
+    }
+    Boot result{clock.now_us() - started, longest, hc05.at_commands() - at_commands, hc05.settings_writes() - settings_writes, configuring};
+    bluetooth.power_on();
+    clock.advance(1000000);
+    bluetooth.power_off();
+    clock.advance(1000000);
+    return result;
+  }
+
+  void test_factory_module(HC05Model &hc05) {
+    const char *test = "factory module";
+    host::erase_flash();
+    Settings settings;
+    settings.load();
+    uint64_t mismatches = hc05.baud_mismatches();
+    Boot result = boot(hc05, settings);
+    fprintf(stderr, "%s: configured in %.0f ms, %llu AT commands, longest process() %llu us\n", test,
+      result.configuration_us / 1000.0, static_cast<unsigned long long>(result.at_commands), static_cast<unsigned long long>(result.longest_process_us));
+    check(result.configuration_us < CONFIGURATION_TIMEOUT_US, test, "the configuration didn't complete");
+    check(result.longest_process_us < HC05_AT_REPLY_US, test, "process() waited for a reply");
+    check(hc05.device_name() == settings.values().bluetooth_name, test, "wrong module name");
+    check(hc05.device_pin() == settings.values().bluetooth_pin, test, "wrong module PIN");
+    check(hc05.baud_rate() == BLUETOOTH_BAUD_RATE, test, "wrong module data baud rate");
+    check(hc05.baud_mismatches() == mismatches, test, "bytes sent at the wrong baud rate");
+  }
+
+  void test_provisioned(HC05Model &hc05) {
+    const char *test = "provisioned";
+    Settings settings;
+    settings.load();
+    Boot result = boot(hc05, settings);
+    fprintf(stderr, "%s: %llu AT commands\n", test, static_cast<unsigned long long>(result.at_commands));
+    // Not on the elapsed time: setup() takes some with logging enabled
+    check(result.at_commands == 0 && !result.configuring_after_setup, test, "the module was configured again");
+  }
+
+  void test_backup_domain_lost(HC05Model &hc05) {
+    const char *test = "backup domain lost";
+    host::reset_backup_domain();
+    Settings settings;
+    settings.load();
+    Boot result = boot(hc05, settings);
+    fprintf(stderr, "%s: verified in %.0f ms, %llu AT commands\n", test, result.configuration_us / 1000.0, static_cast<unsigned long long>(result.at_commands));
+    check(result.at_commands > 0 && result.settings_writes == 0, test, "the module settings were not only verified");
+    result = boot(hc05, settings);
+    check(result.at_commands == 0 && !result.configuring_after_setup, test, "the verified settings were not remembered");
+  }
+
+  void test_similar_settings(HC05Model &hc05) {
+    const char *test = "similar settings";
+    Settings settings;
+    settings.load();
+    std::string name = settings.values().bluetooth_name;
+    std::string pin = settings.values().bluetooth_pin;
+    // The settings are a prefix of the module name, and a substring of the module PIN
+    hc05.set_stored_settings(name + "-2", "0" + pin + "0", BLUETOOTH_BAUD_RATE);
+    host::reset_backup_domain();
+    Boot result = boot(hc05, settings);
+    check(result.settings_writes > 0, test, "the module settings were not written");
+    check(hc05.device_name() == name && hc05.device_pin() == pin, test, "wrong module name or PIN");
+  }
+
+  void test_settings_changed(HC05Model &hc05) {
+    const char *test = "settings changed";
+    Settings settings;
+    settings.load();
+    const char name[] = "MyTelescope";
+    check(settings.set(Settings::BluetoothName, name, sizeof(name) - 1), test, "the name setting couldn't be changed");
+    Boot result = boot(hc05, settings);
+    check(result.settings_writes > 0 && hc05.device_name() == name, test, "the new name was not written");
+    result = boot(hc05, settings);
+    check(result.at_commands == 0 && !result.configuring_after_setup, test, "the module was configured again");
+  }
+
+  void test_data_mode(HC05Model &hc05) {
+    const char *test = "data mode";
+    Settings settings;
+    settings.load();
+    Bluetooth bluetooth(Serial3, BT_POWER_PIN, BT_AT_MODE_PIN, settings);
+    bluetooth.power_on();
+    host::Clock::instance().advance(1000000);
+    check(hc05.in_data_mode(), test, "the module didn't start in data mode");
+    check(Serial3.baud() == hc05.baud_rate(), test, "the data port isn't opened at the module baud rate");
+    bluetooth.power_off();
+    host::Clock::instance().advance(1000000);
+  }
+}
+
+int main() {
+  Timeline timeline(fopen("/dev/null", "w"));
+  ClientModel phone("phone", timeline, 1000);
+  HC05Model hc05(Serial3, timeline, phone, HC05Model::Config{BT_POWER_PIN, BT_AT_MODE_PIN, 0, 20});
+  host::set_pin_listener([&](uint8_t pin, uint16_t value) { hc05.on_pin(pin, value); });
+  test_factory_module(hc05);
+  test_provisioned(hc05);
+  test_backup_domain_lost(hc05);
+  test_similar_settings(hc05);
+  test_settings_changed(hc05);
+  test_data_mode(hc05);
+  return checks_result("bluetooth");
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Parsers must reject anything in bounded time: no character may take longer than
+// this (in wall clock nanoseconds) to process
+#ifndef FUZZ_BYTE_BUDGET_NS
+#define FUZZ_BYTE_BUDGET_NS 20000
+#endif
+// Slow measurements are repeated this many times, the fastest one counts:
+// it keeps preemptions and page faults from failing the run
+#define FUZZ_RETRIES 8
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Valid inputs the standalone driver mutates (libFuzzer uses its own corpus)
+const std::vector<std::string> &fuzz_seeds();
+
+namespace fuzz {
+  template<typename F> uint64_t elapsed_ns(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // measure() runs the operation once, returning its duration.
+  // Aborts if it never fits the budget.
+  template<typename F> void check_budget(uint64_t elapsed, uint64_t budget, const char *what, size_t offset, F &&measure) {
+    if(elapsed <= budget) {
+      return;
+    }
+    for(int i = 0; i < FUZZ_RETRIES && elapsed > budget; i++) {
+      uint64_t retry = measure();
+      elapsed = retry < elapsed ? retry : elapsed;
+    }
+    if(elapsed > budget) {
+      fprintf(stderr, "%s at offset %zu took %llu ns, budget: %llu ns\n", what, offset,
+        static_cast<unsigned long long>(elapsed), static_cast<unsigned long long>(budget));
+      abort();
+    }
+  }
+
+  inline void check(bool condition, const char *what, size_t offset) {
+    if(!condition) {
+      fprintf(stderr, "%s at offset %zu\n", what, offset);
+      abort();
+    }
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,94 @@
+// Fuzzing of the hand control reply parser (NexstarReply).
+// The first input byte sets how many bytes the port makes available at a time, to
+// exercise replies split across read() calls; the rest is the port data.
+#include "fuzz.h"
+#include "nexstar_data.h"
+#include <string.h>
+
+namespace {
+  class FuzzStream : public Stream {
+  public:
+    FuzzStream(const uint8_t *data, size_t size, size_t chunk) : _data(data), _size(size), _chunk(chunk) {}
+    int available() override { return _available; }
+    int read() override {
+      if(_available == 0) {
+        return -1;
+      }
+      _available--;
+      return _data[_position++];
+    }
+    int peek() override { return _available ? _data[_position] : -1; }
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    // The next chunk is received, false at the end of the data
+    bool receive() {
+      if(_position == _size) {
+        return false;
+      }
+      _available = _size - _position < _chunk ? _size - _position : _chunk;
+      return true;
+    }
+    inline size_t position() const { return _position; }
+  private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _chunk;
+    size_t _position = 0;
+    size_t _available = 0;
+  };
+}
+
+const std::vector<std::string> &fuzz_seeds() {
+  static const std::vector<std::string> seeds = {
+    std::string("\x01#", 2),
+    std::string("\x04\x0c\x1e\x00\x0a\x14\x13\x01\x00#", 10),
+    std::string("\x10Vk#", 4),
+    std::string("\x02" "0123456789abcdef0123456789#", 27),
+    std::string("\x03##\x00#", 5),
+  };
+  return seeds;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if(size == 0) {
+    return 0;
+  }
+  FuzzStream port(data + 1, size - 1, data[0] % NEXSTAR_REPLY_SIZE + 1);
+  NexstarReply reply;
+  // Bytes consumed since the last reset
+  size_t received = 0;
+  while(port.receive()) {
+    while(port.available()) {
+      size_t offset = port.position();
+      // Copies to re-time the same read
+      FuzzStream port_before = port;
+      NexstarReply reply_before = reply;
+      NexstarReply::State state;
+      uint64_t elapsed = fuzz::elapsed_ns([&]{ state = reply.read(port); });
+      size_t consumed = port.position() - offset;
+      received += consumed;
+      fuzz::check_budget(elapsed, FUZZ_BYTE_BUDGET_NS * (consumed ? consumed : 1), "read", offset, [&]{
+        FuzzStream retry_port = port_before;
+        NexstarReply retry = reply_before;
+        return fuzz::elapsed_ns([&]{ retry.read(retry_port); });
+      });
+
+      size_t length = strlen(reply.c_str());
+      fuzz::check(length <= NEXSTAR_REPLY_SIZE, "reply longer than its buffer", offset);
+      if(state == NexstarReply::Pending) {
+        fuzz::check(port.available() == 0, "pending reply with data available", offset);
+        continue;
+      }
+      if(state == NexstarReply::Complete) {
+        fuzz::check(data[port.position()] == '#' && received <= NEXSTAR_REPLY_SIZE, "invalid complete reply", offset);
+      } else {
+        fuzz::check(received == NEXSTAR_REPLY_SIZE + 1, "overlong reply not rejected at once", offset);
+      }
+      reply.reset();
+      received = 0;
+    }
+  }
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,66 @@
+// Fuzzing of the NMEA parser: TinyGPSPlus::encode on the raw input, and the term
+// parsers (parseInteger, parseDecimal, parseDegrees) on each comma separated slice of it.
+#include "fuzz.h"
+#include "TinyGPS++.h"
+#include <string.h>
+
+// Slices longer than any NMEA term, to check that parsing stops at the field size
+#define FUZZ_MAX_TERM 64
+
+namespace {
+  // Re-times byte offset on a parser fed with the same input up to it
+  uint64_t measure_byte(const uint8_t *data, size_t offset) {
+    TinyGPSPlus gps;
+    for(size_t i = 0; i < offset; i++) {
+      gps.encode(data[i]);
+    }
+    return fuzz::elapsed_ns([&]{ gps.encode(data[offset]); });
+  }
+
+  void parse_term(const char *term, size_t offset) {
+    volatile int32_t sink;
+    RawDegrees degrees;
+    auto parse = [&]{
+      sink = TinyGPSPlus::parseInteger(term);
+      sink = TinyGPSPlus::parseDecimal(term);
+      TinyGPSPlus::parseDegrees(term, degrees);
+    };
+    fuzz::check_budget(fuzz::elapsed_ns(parse), FUZZ_BYTE_BUDGET_NS, "term parsing", offset, [&]{ return fuzz::elapsed_ns(parse); });
+  }
+}
+
+const std::vector<std::string> &fuzz_seeds() {
+  static const std::vector<std::string> seeds = {
+    "$GPRMC,123519.00,A,4807.03812,N,01131.00012,E,0.022,,230394,,,A*70\r\n",
+    "$GPGGA,123519.00,4807.03812,N,01131.00012,E,1,08,0.91,545.4,M,46.9,M,,*58\r\n",
+    "$GNGSA,A,3,21,05,29,25,12,10,26,02,,,,,1.72,1.03,1.38*1E\r\n",
+    "$GPGSV,3,1,11,02,48,298,24,05,25,061,41,10,12,275,,12,32,079,42*78\r\n",
+    "$GPZDA,123519.00,23,03,1994,00,00*6C\r\n",
+    "$GPTXT,01,01,02,u-blox AG - www.u-blox.com*50\r\n",
+  };
+  return seeds;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  TinyGPSPlus gps;
+  for(size_t i = 0; i < size; i++) {
+    uint64_t elapsed = fuzz::elapsed_ns([&]{ gps.encode(data[i]); });
+    fuzz::check_budget(elapsed, FUZZ_BYTE_BUDGET_NS, "encode", i, [&]{ return measure_byte(data, i); });
+  }
+  fuzz::check(gps.charsProcessed() == size, "characters not counted", size);
+
+  char term[FUZZ_MAX_TERM + 1];
+  size_t start = 0;
+  while(start < size) {
+    const uint8_t *comma = static_cast<const uint8_t*>(memchr(data + start, ',', size - start));
+    size_t end = comma ? comma - data : size;
+    size_t length = end - start < FUZZ_MAX_TERM ? end - start : FUZZ_MAX_TERM;
+    memcpy(term, data + start, length);
+    term[length] = 0;
+    parse_term(term, start);
+    start = end + 1;
+  }
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
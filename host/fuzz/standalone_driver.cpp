@@ -0,0 +1,120 @@
+// Stand-in for libFuzzer on compilers without it: runs the files given on the command
+// line, or mutates the fuzzer seeds randomly (no coverage feedback) for a number of runs.
+#include "fuzz.h"
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string.h>
+
+namespace {
+  // Characters with a meaning to the parsers
+  const char specialCharacters[] = "$,*#.-\r\n0123456789ABCDEFGNPRSTVZ";
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options] [inputs...]\n"
+      "  --runs N      mutated inputs to run when no input file is given (default 100000)\n"
+      "  --seed N      random seed (default 1)\n"
+      "  --max-len N   maximum input size (default 512)\n",
+      name);
+  }
+
+  void mutate(std::string &input, const std::vector<std::string> &seeds, std::mt19937 &random, size_t max_len) {
+    auto pick = [&](size_t n) { return static_cast<size_t>(random() % n); };
+    int mutations = 1 + pick(4);
+    for(int i = 0; i < mutations; i++) {
+      size_t position = input.empty() ? 0 : pick(input.size());
+      switch(pick(7)) {
+      case 0: // flip a bit
+        if(!input.empty()) {
+          input[position] ^= 1 << pick(8);
+        }
+        break;
+      case 1: // random byte
+        if(!input.empty()) {
+          input[position] = static_cast<char>(random());
+        }
+        break;
+      case 2: // insert a meaningful character
+        input.insert(position, 1, specialCharacters[pick(sizeof(specialCharacters) - 1)]);
+        break;
+      case 3: // delete a range
+        input.erase(position, pick(8) + 1);
+        break;
+      case 4: // repeat a range
+        input.insert(position, input.substr(position, pick(32) + 1));
+        break;
+      case 5: { // splice another seed in
+        const std::string &other = seeds[pick(seeds.size())];
+        size_t start = pick(other.size());
+        input.insert(position, other.substr(start, pick(other.size() - start) + 1));
+        break;
+      }
+      default: // long run of the same character
+        input.insert(position, pick(256) + 1, specialCharacters[pick(sizeof(specialCharacters) - 1)]);
+        break;
+      }
+    }
+    if(input.size() > max_len) {
+      input.resize(max_len);
+    }
+  }
+
+  int run(const std::string &input) {
+    return LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned long runs = 100000;
+  unsigned long seed = 1;
+  size_t max_len = 512;
+  std::vector<const char*> files;
+  for(int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if(!strcmp(argv[i], "--runs") && has_value) {
+      runs = strtoul(argv[++i], nullptr, 10);
+    } else if(!strcmp(argv[i], "--seed") && has_value) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if(!strcmp(argv[i], "--max-len") && has_value) {
+      max_len = strtoul(argv[++i], nullptr, 10);
+    } else if(argv[i][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+
+  if(!files.empty()) {
+    for(const char *path : files) {
+      std::ifstream file(path, std::ios::binary);
+      if(!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+      }
+      run(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
+    fprintf(stderr, "Ran %zu inputs\n", files.size());
+    return 0;
+  }
+
+  const std::vector<std::string> &seeds = fuzz_seeds();
+  std::mt19937 random(seed);
+  for(const std::string &input : seeds) {
+    run(input);
+  }
+  // Random walk: mutations pile up on the same input, restarting from a seed now and then
+  std::string input;
+  for(unsigned long i = 0; i < runs; i++) {
+    if(input.empty() || random() % 16 == 0) {
+      input = seeds[random() % seeds.size()];
+    }
+    mutate(input, seeds, random, max_len);
+    run(input);
+  }
+  fprintf(stderr, "Ran %lu mutated inputs, seed %lu\n", runs, seed);
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,116 @@
+// GPS status LED test: runs the sketch on the virtual clock, feeds it 1 Hz NMEA
+// sentences for each GPS status and counts the GPS LED blinks in one pattern period:
+// one without a fix, two with date and time only, three with a location fix, and
+// back to two once the fix is lost. Exits with 1 if any check fails.
+#include "Arduino.h"
+#include "sketch.h"
+#include "gps.h"
+#include "leds.h"
+#include "test.h"
+#include <TimeLib.h>
+#include <string>
+#include <vector>
+
+// Same wiring as NexstarGPSLite.ino
+#define GPS_LED_PIN PA6
+#define START_UTC 1704139200
+// Long enough for a fix to time out (GPS_FIX_TIMEOUT) and the status to settle
+#define SETTLE_SECONDS 7
+
+extern GPS gps;
+
+namespace {
+  enum Sentences {
+    NoFix, // GGA without a fix: no date either
+    DateTime, // RMC with a date, but no fix
+    Fix, // RMC and GGA with a location
+  };
+
+  uint32_t epoch = 0;
+  uint16_t led = 0;
+  // Times the GPS LED turned on
+  std::vector<uint64_t> blinks;
+
+  void send(const std::string &body) {
+    uint8_t checksum = 0;
+    for(char c : body) {
+      checksum ^= static_cast<uint8_t>(c);
+    }
+    char trailer[8];
+    snprintf(trailer, sizeof(trailer), "*%02X\r\n", checksum);
+    Serial2.inject(("$" + body + trailer).c_str());
+  }
+
+  // One second of receiver output, run through the firmware
+  void second(Sentences sentences) {
+    tmElements_t tm;
+    breakTime(START_UTC + epoch, tm);
+    char time[16];
+    snprintf(time, sizeof(time), "%02d%02d%02d.00", tm.Hour, tm.Minute, tm.Second);
+    char date[16];
+    snprintf(date, sizeof(date), "%02d%02d%02d", tm.Day, tm.Month, tmYearToCalendar(tm.Year) % 100);
+    switch(sentences) {
+      case NoFix:
+        send(std::string("GPGGA,") + time + ",,,,,0,00,99.99,,,,,,");
+        break;
+      case DateTime:
+        send(std::string("GPRMC,") + time + ",V,,,,,,," + date + ",,,N");
+        break;
+      case Fix:
+        send(std::string("GPRMC,") + time + ",A,4527.85200,N,00911.40000,E,0.01,," + date + ",,,A");
+        send(std::string("GPGGA,") + time + ",4527.85200,N,00911.40000,E,1,08,0.95,102.3,M,47.0,M,,");
+        break;
+    }
+    epoch++;
+    host::Clock &clock = host::Clock::instance();
+    uint64_t end_us = clock.now_us() + 1000000;
+    while(clock.now_us() < end_us) {
+      loop();
+    }
+  }
+
+  // GPS LED blinks in one pattern period, while the receiver sends `sentences`
+  size_t gps_blinks(Sentences sentences) {
+    for(int i = 0; i < SETTLE_SECONDS; i++) {
+      second(sentences);
+    }
+    uint64_t start_us = host::Clock::instance().now_us();
+    uint64_t end_us = start_us + LEDS_INTERVAL * 1000ULL * LEDS_PATTERN_SIZE;
+    while(host::Clock::instance().now_us() < end_us) {
+      second(sentences);
+    }
+    size_t count = 0;
+    for(uint64_t blink : blinks) {
+      if(blink >= start_us && blink < end_us) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  void test_status(const char *test, Sentences sentences, GPS::Status status, size_t expected_blinks) {
+    size_t count = gps_blinks(sentences);
+    fprintf(stderr, "%s: status %d, %zu blinks\n", test, gps.status(), count);
+    check(gps.status() == status, test, "wrong GPS status");
+    check(count == expected_blinks, test, "wrong GPS LED pattern");
+  }
+}
+
+int main() {
+  host::set_pin_listener([](uint8_t pin, uint16_t value) {
+    if(pin == GPS_LED_PIN) {
+      if(value && !led) {
+        blinks.push_back(host::Clock::instance().now_us());
+      }
+      led = value;
+    }
+  });
+  setup();
+  test_status("no fix", NoFix, GPS::NoFix, 1);
+  test_status("date/time", DateTime, GPS::TimeFix, 2);
+  test_status("fix", Fix, GPS::Fix, 3);
+  test_status("fix lost", DateTime, GPS::TimeFix, 2);
+  return checks_result("GPS LED");
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,18 @@
+// Runs the firmware on the virtual clock, with nothing connected to it.
+#include "Arduino.h"
+#include "sketch.h"
+
+int main(int argc, char **argv) {
+  double duration = argc > 1 ? atof(argv[1]) : 60;
+  uint64_t end_us = static_cast<uint64_t>(duration * 1000000);
+  uint64_t iterations = 0;
+  setup();
+  while(host::Clock::instance().now_us() < end_us) {
+    loop();
+    iterations++;
+  }
+  printf("%.3f s, %llu loop iterations\n", host::Clock::instance().now_us() / 1000000.0, static_cast<unsigned long long>(iterations));
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,210 @@
+// Position filter test: feeds the firmware GPS 1 Hz NMEA sentences (RMC and GGA, as
+// GPSModel) with gaussian position noise, on the virtual clock, and checks that:
+// - the filtered position gets closer to the true one than the single fixes, and its
+//   estimated error drops as fixes accumulate
+// - far away fixes are rejected as outliers, without moving the estimate
+// - after OUTLIER_MAX_CONSECUTIVE (10) rejections in a row, as when the receiver moved,
+//   the filter starts over and settles on the new position
+// - after a fix loss, the filter starts over from the next fix.
+// Exits with 1 if any check fails.
+#include "Arduino.h"
+#include "gps.h"
+#include "events.h"
+#include "test.h"
+#include <TimeLib.h>
+#include <math.h>
+#include <random>
+#include <string>
+
+#define START_UTC 1704139200
+#define LAT 45.4642
+#define LNG 9.19
+#define NOISE_METERS 3.0
+#define OUTLIER_METERS 150.0
+#define MOVE_METERS 300.0
+#define METERS_PER_DEGREE 111319.49
+// Firmware loop period while sentences arrive: the GPS RX buffer holds 66 ms at 9600 baud
+#define LOOP_PERIOD_US 10000
+
+namespace {
+  EventBus events;
+  HardwareTimer timer(2);
+  GPS gps(Serial2, timer, events);
+  std::mt19937 generator(1);
+  std::normal_distribution<double> noise{0, NOISE_METERS};
+  uint32_t epoch = 0;
+
+  double distance_meters(double lat1, double lng1, double lat2, double lng2) {
+    double x = (lng2 - lng1) * METERS_PER_DEGREE * cos(lat1 * M_PI / 180);
+    double y = (lat2 - lat1) * METERS_PER_DEGREE;
+    return sqrt(x * x + y * y);
+  }
+
+  std::string coordinate(double value, int degrees_digits, char positive, char negative) {
+    char hemisphere = value < 0 ? negative : positive;
+    value = fabs(value);
+    int degrees = static_cast<int>(value);
+    double minutes = (value - degrees) * 60;
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%0*d%08.5f,%c", degrees_digits, degrees, minutes, hemisphere);
+    return buffer;
+  }
+
+  void send(const std::string &body) {
+    uint8_t checksum = 0;
+    for(char c : body) {
+      checksum ^= static_cast<uint8_t>(c);
+    }
+    char trailer[8];
+    snprintf(trailer, sizeof(trailer), "*%02X\r\n", checksum);
+    Serial2.inject(("$" + body + trailer).c_str());
+  }
+
+  // Receiver time and date of the current epoch, as in RMC
+  void epoch_time(char *time, char *date, size_t size) {
+    tmElements_t tm;
+    breakTime(START_UTC + epoch, tm);
+    snprintf(time, size, "%02d%02d%02d.00", tm.Hour, tm.Minute, tm.Second);
+    snprintf(date, size, "%02d%02d%02d", tm.Day, tm.Month, tmYearToCalendar(tm.Year) % 100);
+  }
+
+  // Runs the firmware until the end of the current epoch
+  void run_epoch() {
+    epoch++;
+    host::Clock &clock = host::Clock::instance();
+    uint64_t end_us = epoch * 1000000ULL;
+    while(clock.now_us() < end_us) {
+      clock.advance(LOOP_PERIOD_US);
+      gps.process();
+    }
+  }
+
+  // One second of receiver output, a fix offset by (east, north) meters from (lat, lng), run through the firmware
+  void fix(double lat, double lng, double east, double north) {
+    char time[16];
+    char date[16];
+    epoch_time(time, date, sizeof(time));
+    lat += north / METERS_PER_DEGREE;
+    lng += east / (METERS_PER_DEGREE * cos(lat * M_PI / 180));
+    std::string position = coordinate(lat, 2, 'N', 'S') + "," + coordinate(lng, 3, 'E', 'W');
+    send(std::string("GPRMC,") + time + ",A," + position + ",0.01,," + date + ",,,A");
+    send(std::string("GPGGA,") + time + "," + position + ",1,08,0.95,102.3,M,47.0,M,,");
+    run_epoch();
+  }
+
+  // One second of receiver output without a fix
+  void no_fix() {
+    char time[16];
+    char date[16];
+    epoch_time(time, date, sizeof(time));
+    send(std::string("GPRMC,") + time + ",V,,,,,,," + date + ",,,N");
+    send(std::string("GPGGA,") + time + ",,,,,0,00,99.99,,,,,,");
+    run_epoch();
+  }
+
+  void noisy_fix(double lat, double lng) {
+    fix(lat, lng, noise(generator), noise(generator));
+  }
+
+  double filtered_error(double lat, double lng) {
+    return distance_meters(lat, lng, gps.position().lat(), gps.position().lng());
+  }
+
+  void test_convergence() {
+    const char *test = "convergence";
+    double raw_squares = 0;
+    for(int i = 0; i < 10; i++) {
+      double east = noise(generator);
+      double north = noise(generator);
+      raw_squares += east * east + north * north;
+      fix(LAT, LNG, east, north);
+    }
+    const PositionFilter &position = gps.position();
+    check(position.samples() == 10 && position.rejected() == 0, test, "fixes were not all accepted");
+    float early_error = position.error_meters();
+    for(int i = 0; i < 50; i++) {
+      double east = noise(generator);
+      double north = noise(generator);
+      raw_squares += east * east + north * north;
+      fix(LAT, LNG, east, north);
+    }
+    double raw_error = sqrt(raw_squares / 60);
+    double error = filtered_error(LAT, LNG);
+    fprintf(stderr, "%s: single fixes %.2f m RMS from the true position, filtered %.2f m; estimated error %.2f m after 10 fixes, %.2f m after 60\n",
+      test, raw_error, error, early_error, position.error_meters());
+    check(error < raw_error / 3, test, "the filtered position is not closer than the single fixes");
+    check(position.error_meters() < early_error / 2, test, "the estimated error didn't drop");
+    check(position.error_meters() < NOISE_METERS && error < 3 * position.error_meters(), test, "the estimated error doesn't match the actual one");
+    check(position.is_confident() && gps.hasStableFix(), test, "no stable fix after 60 fixes");
+  }
+
+  void test_outliers() {
+    const char *test = "outliers";
+    const PositionFilter &position = gps.position();
+    for(int i = 0; i < 5; i++) {
+      for(int j = 0; j < 9; j++) {
+        noisy_fix(LAT, LNG);
+      }
+      uint16_t samples = position.samples();
+      uint16_t rejected = position.rejected();
+      double lat = position.lat();
+      double lng = position.lng();
+      fix(LAT, LNG, OUTLIER_METERS * cos(i), OUTLIER_METERS * sin(i));
+      check(position.rejected() == rejected + 1 && position.samples() == samples, test, "an outlier was accepted");
+      check(position.lat() == lat && position.lng() == lng, test, "an outlier moved the estimate");
+    }
+    noisy_fix(LAT, LNG);
+    check(position.rejected() == 5, test, "fixes within the noise were rejected");
+    check(filtered_error(LAT, LNG) < NOISE_METERS / 2, test, "the filtered position drifted");
+  }
+
+  void test_reset() {
+    const char *test = "reset";
+    const PositionFilter &position = gps.position();
+    uint16_t samples = position.samples();
+    uint16_t rejected = position.rejected();
+    double lat = LAT + MOVE_METERS / METERS_PER_DEGREE;
+    for(int i = 0; i < 9; i++) {
+      noisy_fix(lat, LNG);
+    }
+    check(position.samples() == samples && position.rejected() == rejected + 9, test, "fixes after moving were not rejected");
+    noisy_fix(lat, LNG);
+    check(position.samples() == 0 && position.rejected() == 0, test, "the filter didn't start over after 10 rejections in a row");
+    for(int i = 0; i < 60; i++) {
+      noisy_fix(lat, LNG);
+    }
+    double error = filtered_error(lat, LNG);
+    fprintf(stderr, "%s: %.2f m from the new position after 60 fixes\n", test, error);
+    check(position.samples() == 60 && position.rejected() == 0, test, "fixes at the new position were rejected");
+    check(error < NOISE_METERS / 2 && position.is_confident(), test, "the filter didn't settle on the new position");
+  }
+
+  void test_fix_lost() {
+    const char *test = "fix lost";
+    const PositionFilter &position = gps.position();
+    for(uint32_t i = 0; i <= GPS_FIX_TIMEOUT / 1000; i++) {
+      no_fix();
+    }
+    check(gps.status() == GPS::TimeFix, test, "the fix was not lost");
+    check(position.samples() == 0 && !position.is_confident() && !gps.hasStableFix(), test, "the filter kept the fixes before the loss");
+    // Far from the last estimate, but after the fix loss: not an outlier
+    double lat = LAT - MOVE_METERS / METERS_PER_DEGREE;
+    noisy_fix(lat, LNG);
+    check(position.samples() == 1 && position.rejected() == 0, test, "the first fix after the loss was rejected");
+    for(int i = 0; i < 59; i++) {
+      noisy_fix(lat, LNG);
+    }
+    check(filtered_error(lat, LNG) < NOISE_METERS / 2 && position.is_confident(), test, "the filter didn't settle on the new position");
+  }
+}
+
+int main() {
+  gps.begin();
+  test_convergence();
+  test_outliers();
+  test_reset();
+  test_fix_lost();
+  return checks_result("position filter");
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,213 @@
+// Replays a serial capture into the firmware: bytes received by the board are fed
+// to the same ports at their capture time, on the virtual clock, and the bytes the
+// firmware sends are compared with the captured ones.
+#include "Arduino.h"
+#include "sketch.h"
+#include "gps.h"
+#include "trace.h"
+#include <chrono>
+#include <functional>
+
+extern GPS gps;
+
+namespace {
+  const char *portNames[] = {"GPS", "Nexstar", "USB", "Bluetooth"};
+
+  // Feeds the received bytes to the ports when due
+  class TracePlayer : public host::EventSource {
+  public:
+    TracePlayer(const Trace &trace) : _reader(trace.reader()) {
+      host::Clock::instance().add_source(this);
+      advance();
+    }
+    ~TracePlayer() {
+      host::Clock::instance().remove_source(this);
+    }
+    uint64_t next_event_us() const override {
+      return _pending ? _next.time_us : UINT64_MAX;
+    }
+    void fire(uint64_t now_us) override {
+      if(_next.port == SerialCapture::USBPort) {
+        Serial.inject(_next.data, _next.size);
+      } else {
+        HardwareSerial &port = hardware_port(_next.port);
+        if(port.is_open()) {
+          port.replay(_next.data, _next.size);
+        } else {
+          _dropped += _next.size;
+        }
+      }
+      _received[_next.port] += _next.size;
+      _last_us = _next.time_us;
+      advance();
+    }
+    inline bool finished() const { return !_pending; }
+    inline uint64_t last_us() const { return _last_us; }
+    inline uint64_t received(SerialCapture::Port port) const { return _received[port]; }
+    // Bytes that arrived while the port was closed in the replay
+    inline uint64_t dropped() const { return _dropped; }
+    inline uint64_t lost() const { return _reader.lost(); }
+
+    static HardwareSerial &hardware_port(SerialCapture::Port port) {
+      // Same wiring as NexstarGPSLite.ino
+      switch(port) {
+        case SerialCapture::GPSPort:
+          return Serial2;
+        case SerialCapture::NexstarPort:
+          return Serial1;
+        default:
+          return Serial3;
+      }
+    }
+
+  private:
+    Trace::Reader _reader;
+    Trace::Record _next;
+    bool _pending = false;
+    uint64_t _last_us = 0;
+    uint64_t _received[SerialCapture::PortsCount] = {};
+    uint64_t _dropped = 0;
+    void advance() {
+      // Sent bytes are for the output checkers
+      while((_pending = _reader.next(_next)) && _next.direction == SerialCapture::Sent) {
+      }
+    }
+  };
+
+  // Compares what the firmware sends on a port with the captured bytes, in order
+  class OutputChecker {
+  public:
+    OutputChecker(const Trace &trace, SerialCapture::Port port) : _reader(trace.reader()), _port(port) {
+    }
+    void on_byte(uint8_t c, uint64_t time_us) {
+      _sent++;
+      int expected = next_expected();
+      if(expected < 0) {
+        _extra++;
+      } else if(expected != c) {
+        if(_mismatches++ == 0) {
+          _first_mismatch_us = time_us;
+          _first_mismatch_offset = _sent - 1;
+        }
+      }
+    }
+    // Also counts the captured bytes never sent during the replay
+    void report(FILE *output) {
+      while(next_expected() >= 0) {
+        _missing++;
+      }
+      fprintf(output, "%-9s sent %llu bytes: %llu different, %llu extra, %llu missing",
+        portNames[_port], static_cast<unsigned long long>(_sent), static_cast<unsigned long long>(_mismatches),
+        static_cast<unsigned long long>(_extra), static_cast<unsigned long long>(_missing));
+      if(_mismatches > 0) {
+        fprintf(output, ", first at byte %llu (%.6f s)", static_cast<unsigned long long>(_first_mismatch_offset), _first_mismatch_us / 1000000.0);
+      }
+      fprintf(output, "\n");
+    }
+    inline bool matches() const { return _mismatches == 0 && _extra == 0 && _missing == 0; }
+  private:
+    Trace::Reader _reader;
+    SerialCapture::Port _port;
+    Trace::Record _record{0, _port, SerialCapture::Sent, nullptr, 0};
+    uint8_t _offset = 0;
+    uint64_t _sent = 0;
+    uint64_t _mismatches = 0;
+    uint64_t _extra = 0;
+    uint64_t _missing = 0;
+    uint64_t _first_mismatch_us = 0;
+    uint64_t _first_mismatch_offset = 0;
+    int next_expected() {
+      while(_offset >= _record.size) {
+        if(!_reader.next(_record)) {
+          _record.size = 0;
+          _offset = 0;
+          return -1;
+        }
+        _offset = _record.port == _port && _record.direction == SerialCapture::Sent ? 0 : _record.size;
+      }
+      return _record.data[_offset++];
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  uint64_t systick_us = 10000;
+  double tail = 10;
+  const char *path = nullptr;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--systick") == 0 && i + 1 < argc) {
+      systick_us = strtoull(argv[++i], nullptr, 10);
+    } else if(strcmp(argv[i], "--tail") == 0 && i + 1 < argc) {
+      tail = atof(argv[++i]);
+    } else if(!path && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      break;
+    }
+  }
+  if(!path) {
+    fprintf(stderr,
+      "Usage: %s [options] TRACE\n"
+      "  --systick US   idle wake up period, 1000 as the real SysTick, 0: only wake up on events (default: 10000)\n"
+      "  --tail S       keep running after the last received byte, seconds (default: 10)\n",
+      argv[0]);
+    return 1;
+  }
+  Trace trace(path);
+  if(!trace.is_valid()) {
+    fprintf(stderr, "%s\n", trace.error().c_str());
+    return 1;
+  }
+  host::set_systick_period_us(systick_us);
+
+  TracePlayer player(trace);
+  OutputChecker checkers[] = {
+    {trace, SerialCapture::GPSPort},
+    {trace, SerialCapture::NexstarPort},
+    {trace, SerialCapture::USBPort},
+    {trace, SerialCapture::BluetoothPort},
+  };
+  for(uint8_t port = 0; port < SerialCapture::PortsCount; port++) {
+    auto listener = [&checkers, port](uint8_t c, uint64_t time_us) { checkers[port].on_byte(c, time_us); };
+    if(port == SerialCapture::USBPort) {
+      Serial.set_listener(listener);
+    } else {
+      TracePlayer::hardware_port(static_cast<SerialCapture::Port>(port)).set_listener(listener);
+    }
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  uint64_t iterations = 0;
+  setup();
+  host::Clock &clock = host::Clock::instance();
+  while(!player.finished() || clock.now_us() < player.last_us() + static_cast<uint64_t>(tail * 1000000)) {
+    loop();
+    iterations++;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  fprintf(stdout, "Replayed %.2f MB, %.0f s in %.2f s (%.1f MB/s), %llu loop iterations (%.0f/s simulated, %.0f/s host)\n",
+    trace.size() / 1e6, clock.now_us() / 1e6, elapsed, trace.size() / 1e6 / elapsed, static_cast<unsigned long long>(iterations),
+    iterations / (clock.now_us() / 1e6), iterations / elapsed);
+  fprintf(stdout, "Received: ");
+  for(uint8_t port = 0; port < SerialCapture::PortsCount; port++) {
+    fprintf(stdout, "%s%s %llu bytes", port > 0 ? ", " : "", portNames[port], static_cast<unsigned long long>(player.received(static_cast<SerialCapture::Port>(port))));
+  }
+  fprintf(stdout, "\n");
+  fprintf(stdout, "GPS: first data %u ms after boot, date/time fix %u ms after start (0: none)\n", gps.firstDataTime(), gps.timeToTimeFix());
+  if(player.lost() > 0) {
+    fprintf(stdout, "%llu bytes lost during the capture: the replay can't be exact\n", static_cast<unsigned long long>(player.lost()));
+  }
+  if(player.dropped() > 0) {
+    fprintf(stdout, "%llu bytes arrived on closed ports\n", static_cast<unsigned long long>(player.dropped()));
+  }
+  bool matches = true;
+  for(OutputChecker &checker : checkers) {
+    checker.report(stdout);
+    matches = matches && checker.matches();
+  }
+  return matches ? 0 : 2;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,98 @@
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Magic and version
+#define TRACE_HEADER_SIZE 5
+
+Trace::Trace(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    _error = std::string(path) + ": " + strerror(errno);
+    return;
+  }
+  struct stat info;
+  if(fstat(fd, &info) == 0 && info.st_size > 0) {
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data != MAP_FAILED) {
+      _data = static_cast<const uint8_t*>(data);
+      _size = info.st_size;
+      madvise(data, _size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+  if(!_data) {
+    _error = std::string(path) + ": can't map the file";
+  } else if(_size < TRACE_HEADER_SIZE || memcmp(_data, SERIAL_CAPTURE_MAGIC, 4) != 0) {
+    _error = std::string(path) + ": not a serial capture";
+  } else if(_data[4] != SERIAL_CAPTURE_VERSION) {
+    _error = std::string(path) + ": unsupported capture version " + std::to_string(_data[4]);
+  }
+}
+
+Trace::~Trace() {
+  if(_data) {
+    munmap(const_cast<uint8_t*>(_data), _size);
+  }
+}
+
+Trace::Reader::Reader(const Trace &trace) : _position(trace._data + TRACE_HEADER_SIZE), _end(trace._data + trace._size) {
+  if(!trace.is_valid()) {
+    _position = _end;
+  }
+}
+
+bool Trace::Reader::next(Record &record) {
+  while(_position < _end) {
+    uint8_t tag = *_position;
+    if(tag == SERIAL_CAPTURE_START) {
+      if(_end - _position < 5) {
+        break;
+      }
+      _time_us = _position[1] | _position[2] << 8 | _position[3] << 16 | static_cast<uint32_t>(_position[4]) << 24;
+      _position += 5;
+      continue;
+    }
+    if(tag == SERIAL_CAPTURE_OVERFLOW) {
+      if(_end - _position < 3) {
+        break;
+      }
+      _lost += _position[1] | _position[2] << 8;
+      _position += 3;
+      continue;
+    }
+    const uint8_t *position = _position + 1;
+    uint64_t delta = 0;
+    uint8_t shift = 0;
+    while(position < _end && (*position & 0x80) && shift < 28) {
+      delta |= static_cast<uint64_t>(*position++ & 0x7F) << shift;
+      shift += 7;
+    }
+    if(position >= _end) {
+      break;
+    }
+    delta |= static_cast<uint64_t>(*position++ & 0x7F) << shift;
+    uint8_t size = (tag & 0x1F) + 1;
+    if(_end - position < size) {
+      break;
+    }
+    _time_us += delta;
+    record = Record{
+      _time_us,
+      static_cast<SerialCapture::Port>(tag >> 6),
+      static_cast<SerialCapture::Direction>((tag >> 5) & 1),
+      position,
+      size,
+    };
+    _position = position + size;
+    return true;
+  }
+  _position = _end;
+  return false;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
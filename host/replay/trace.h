@@ -0,0 +1,50 @@
+#pragma once
+#include "serial_capture.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Read only, memory mapped serial capture (see serial_capture.h for the layout):
+// records are decoded in place, so traces of any length replay at disk speed.
+class Trace {
+public:
+  struct Record {
+    // Board micros(), without wrap arounds
+    uint64_t time_us;
+    SerialCapture::Port port;
+    SerialCapture::Direction direction;
+    const uint8_t *data;
+    uint8_t size;
+  };
+
+  class Reader {
+  public:
+    explicit Reader(const Trace &trace);
+    // Next data record, false at the end of the trace (or at a truncated record)
+    bool next(Record &record);
+    // Bytes lost to full buffers on the board, up to the current record
+    inline uint64_t lost() const { return _lost; }
+  private:
+    const uint8_t *_position;
+    const uint8_t *_end;
+    uint64_t _time_us = 0;
+    uint64_t _lost = 0;
+  };
+
+  explicit Trace(const char *path);
+  ~Trace();
+  Trace(const Trace&) = delete;
+  Trace &operator=(const Trace&) = delete;
+
+  inline bool is_valid() const { return _error.empty(); }
+  inline const std::string &error() const { return _error; }
+  inline size_t size() const { return _size; }
+  inline Reader reader() const { return Reader(*this); }
+
+private:
+  const uint8_t *_data = nullptr;
+  size_t _size = 0;
+  std::string _error;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
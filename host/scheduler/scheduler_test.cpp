@@ -0,0 +1,130 @@
+// Scheduler tests, against a fake clock: run order by priority, deadlines across the
+// millis() wraparound, missed deadlines counting, next_due_in() and runtime statistics.
+// Exits with 1 if any check fails.
+#include "Arduino.h"
+#include "scheduler.h"
+#include "test.h"
+#include <string>
+
+namespace {
+  uint32_t now_ms = 0;
+  uint32_t now_us = 0;
+  uint32_t clock_ms() { return now_ms; }
+  uint32_t clock_us() { return now_us; }
+
+  // Task names, in run order
+  std::string runs;
+  void task_a() { runs += 'a'; }
+  void task_b() { runs += 'b'; }
+  void task_c() { runs += 'c'; }
+  void task_d() { runs += 'd'; }
+  void busy_task() { now_us += 150; }
+
+  void test_priority() {
+    const char *test = "priority";
+    now_ms = 0;
+    runs.clear();
+    Scheduler scheduler(&clock_ms, &clock_us);
+    scheduler.add("a", task_a, 0, 0);
+    scheduler.add("b", task_b, 0, 2);
+    scheduler.add("c", task_c, 0, 1);
+    scheduler.add("d", task_d, 0, 2);
+    scheduler.run();
+    check(runs == "bdca", test, "tasks don't run by descending priority, in insertion order for equal ones");
+    for(uint8_t i = scheduler.tasks_count(); i < SCHEDULER_MAX_TASKS; i++) {
+      scheduler.add("a", task_a, 0);
+    }
+    check(!scheduler.add("a", task_a, 0), test, "a task was added past SCHEDULER_MAX_TASKS");
+  }
+
+  void test_wraparound() {
+    const char *test = "wraparound";
+    now_ms = UINT32_MAX - 5;
+    runs.clear();
+    Scheduler scheduler(&clock_ms, &clock_us);
+    scheduler.add("a", task_a, 10);
+    scheduler.run();
+    check(runs == "a", test, "a new task doesn't run immediately");
+    now_ms = UINT32_MAX - 1;
+    check(scheduler.next_due_in() == 6, test, "next_due_in() is wrong across the wraparound");
+    scheduler.run();
+    check(runs == "a", test, "the task ran before its deadline, past the wraparound");
+    now_ms = 3;
+    scheduler.run();
+    check(runs == "a", test, "the task ran one millisecond before its deadline, past the wraparound");
+    now_ms = 4;
+    scheduler.run();
+    check(runs == "aa", test, "the task didn't run at its deadline, past the wraparound");
+    check(scheduler.task(0).missed_deadlines == 0, test, "a deadline missed across the wraparound");
+  }
+
+  void test_missed_deadlines() {
+    const char *test = "missed deadlines";
+    now_ms = 1000;
+    runs.clear();
+    Scheduler scheduler(&clock_ms, &clock_us);
+    scheduler.add("a", task_a, 10);
+    scheduler.run();
+    now_ms = 1010;
+    scheduler.run();
+    // Late by less than a period: the next deadline stays on the grid
+    now_ms = 1025;
+    scheduler.run();
+    check(runs == "aaa", test, "the task didn't run when due");
+    check(scheduler.task(0).missed_deadlines == 0, test, "a run late by less than a period counted as missed");
+    check(scheduler.next_due_in() == 5, test, "the next deadline moved after a late run");
+    // Late by more than a period: a run was skipped, next deadline a period from now
+    now_ms = 1055;
+    scheduler.run();
+    check(scheduler.task(0).missed_deadlines == 1, test, "skipped runs not counted");
+    check(scheduler.next_due_in() == 10, test, "the next deadline isn't a period from the late run");
+    now_ms = 1064;
+    scheduler.run();
+    check(runs == "aaaa", test, "the missed runs were caught up");
+    now_ms = 1065;
+    scheduler.run();
+    check(runs == "aaaaa" && scheduler.task(0).missed_deadlines == 1, test, "the task didn't run on the new grid");
+  }
+
+  void test_next_due_in() {
+    const char *test = "next_due_in";
+    now_ms = 0;
+    Scheduler scheduler(&clock_ms, &clock_us);
+    check(scheduler.next_due_in() == UINT32_MAX, test, "a deadline without tasks");
+    scheduler.add("a", task_a, 0);
+    check(scheduler.next_due_in() == UINT32_MAX, test, "tasks running on every iteration have a deadline");
+    scheduler.add("b", task_b, 20);
+    scheduler.add("c", task_c, 50);
+    check(scheduler.next_due_in() == 0, test, "new tasks are not due");
+    scheduler.run();
+    now_ms = 15;
+    check(scheduler.next_due_in() == 5, test, "not the earliest deadline");
+  }
+
+  void test_statistics() {
+    const char *test = "statistics";
+    now_ms = 0;
+    now_us = 0;
+    Scheduler scheduler(&clock_ms, &clock_us);
+    scheduler.add("busy", busy_task, 0);
+    for(int i = 0; i < 4; i++) {
+      scheduler.run();
+    }
+    const Scheduler::Task &task = scheduler.task(0);
+    check(scheduler.iterations() == 4 && task.runs == 4, test, "wrong runs count");
+    check(task.max_runtime == 150 && task.avg_runtime() == 150, test, "wrong runtime");
+    scheduler.reset_stats();
+    check(scheduler.iterations() == 0 && task.runs == 0 && task.max_runtime == 0 && task.total_runtime == 0, test, "statistics not reset");
+  }
+}
+
+int main() {
+  test_priority();
+  test_wraparound();
+  test_missed_deadlines();
+  test_next_due_in();
+  test_statistics();
+  return checks_result("scheduler");
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
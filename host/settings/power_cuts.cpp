@@ -0,0 +1,208 @@
+// Crash test of the settings store: random changes, interrupted by power cuts at
+// random points of the flash operations (host::cut_flash_power_after). After each
+// cut the board "reboots": a new Settings loads the flash, and must have every
+// change completed before the cut, and either the old or the new value of the
+// interrupted one. Exits with 1 on the first mismatch.
+//
+// Also reports the flash wear (erases of each page) and the boot load time with the
+// active page full: halfwords read, and host time as a relative measure.
+#include "Arduino.h"
+#include "settings.h"
+#include "logging.h"
+#include "flash_stm32.h"
+#include <chrono>
+#include <functional>
+#include <map>
+#include <random>
+#include <string.h>
+#include <string>
+
+// Flash operations (programs and erases) between power cuts, at most
+#define POWER_CUTS_MAX_OPERATIONS 2000
+#define LOAD_ITERATIONS 10000
+
+namespace {
+  struct Options {
+    uint32_t cuts = 10000;
+    uint32_t seed = 1;
+  };
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options]\n"
+      "  --cuts N                power cuts (default: 10000)\n"
+      "  --seed N                random seed (default: 1)\n",
+      name);
+  }
+
+  bool parse(int argc, char **argv, Options &options) {
+    std::map<std::string, std::function<void(const char*)>> setters = {
+      {"--cuts", [&](const char *v) { options.cuts = strtoul(v, nullptr, 10); }},
+      {"--seed", [&](const char *v) { options.seed = strtoul(v, nullptr, 10); }},
+    };
+    for(int i = 1; i < argc; i++) {
+      auto setter = setters.find(argv[i]);
+      if(setter == setters.end() || i + 1 >= argc) {
+        return false;
+      }
+      setter->second(argv[++i]);
+    }
+    return options.cuts > 0;
+  }
+
+  // Value of a key, as stored
+  typedef std::string Value;
+
+  Value value_of(const Settings &settings, Settings::Key key) {
+    uint8_t size;
+    const char *value = reinterpret_cast<const char*>(settings.get(key, size));
+    return Value(value, size);
+  }
+
+  Value number(uint16_t value) {
+    return Value(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  class Changes {
+  public:
+    explicit Changes(uint32_t seed) : _random(seed) {}
+
+    Settings::Key key() {
+      return static_cast<Settings::Key>(_random() % Settings::KeysCount);
+    }
+
+    // Valid values, including the defaults now and then
+    Value value(Settings::Key key) {
+      switch(key) {
+        case Settings::BluetoothName:
+          return _random() % 8 == 0 ? Value(BLUETOOTH_DEVICE_NAME) : text(1 + _random() % (SETTINGS_BLUETOOTH_NAME_SIZE - 1), ' ', '~');
+        case Settings::BluetoothPin:
+          return _random() % 8 == 0 ? Value(BLUETOOTH_DEVICE_PIN) : text(4 + _random() % (SETTINGS_BLUETOOTH_PIN_SIZE - 5), '0', '9');
+        case Settings::LogLevel:
+          return Value(1, static_cast<char>(_random() % (LOG_LEVEL_VERBOSE + 1)));
+        default: {
+          return number(1 + _random() % UINT16_MAX);
+        }
+      }
+    }
+
+    uint32_t operations() {
+      return _random() % POWER_CUTS_MAX_OPERATIONS;
+    }
+
+    inline uint32_t seed() { return _random(); }
+
+  private:
+    std::mt19937 _random;
+    // Quotes are not allowed
+    Value text(uint8_t size, char first, char last) {
+      Value text;
+      while(text.size() < size) {
+        char c = first + _random() % (last - first + 1);
+        if(c != '"') {
+          text += c;
+        }
+      }
+      return text;
+    }
+  };
+
+  bool set(Settings &settings, Settings::Key key, const Value &value) {
+    return settings.set(key, value.data(), value.size());
+  }
+
+  void print_value(const char *label, const Value &value) {
+    fprintf(stderr, "  %s:", label);
+    for(char c : value) {
+      fprintf(stderr, " %02x", static_cast<uint8_t>(c));
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if(!parse(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+  Changes changes(options.seed);
+  host::erase_flash();
+  Settings settings;
+  settings.load();
+  Value expected[Settings::KeysCount];
+  for(uint8_t key = 0; key < Settings::KeysCount; key++) {
+    expected[key] = value_of(settings, static_cast<Settings::Key>(key));
+  }
+
+  uint64_t completed = 0;
+  uint64_t interrupted_new = 0;
+  uint64_t interrupted_old = 0;
+  for(uint32_t cut = 0; cut < options.cuts; cut++) {
+    host::cut_flash_power_after(changes.operations(), changes.seed());
+    Settings::Key interrupted;
+    Value value;
+    for(;;) {
+      interrupted = changes.key();
+      value = changes.value(interrupted);
+      bool written = set(settings, interrupted, value);
+      if(host::flash_power_cut()) {
+        break;
+      }
+      if(!written) {
+        fprintf(stderr, "Writing key %d failed before power cut %u\n", interrupted, cut);
+        return 1;
+      }
+      expected[interrupted] = value;
+      completed++;
+    }
+    host::restore_flash_power();
+
+    // Reboot
+    settings = Settings();
+    settings.load();
+    for(uint8_t key = 0; key < Settings::KeysCount; key++) {
+      Value loaded = value_of(settings, static_cast<Settings::Key>(key));
+      if(key == interrupted && loaded == value && loaded != expected[key]) {
+        interrupted_new++;
+        expected[key] = loaded;
+      } else if(loaded == expected[key]) {
+        interrupted_old += key == interrupted;
+      } else {
+        fprintf(stderr, "Key %d corrupted by power cut %u, %s\n", key, cut, key == interrupted ? "while changing it" : "while changing another one");
+        print_value("expected", expected[key]);
+        if(key == interrupted) {
+          print_value("or", value);
+        }
+        print_value("loaded", loaded);
+        return 1;
+      }
+    }
+  }
+
+  const host::FlashStats &stats = host::flash_stats();
+  fprintf(stderr, "%u power cuts: %llu changes completed; interrupted changes: %llu kept the new value, %llu the old one\n",
+    options.cuts, static_cast<unsigned long long>(completed), static_cast<unsigned long long>(interrupted_new), static_cast<unsigned long long>(interrupted_old));
+  fprintf(stderr, "Wear: %llu erases (page 0: %u, page 1: %u), %llu halfwords programmed\n",
+    static_cast<unsigned long long>(stats.erases), host::flash_page_erases(SETTINGS_ADDRESS), host::flash_page_erases(SETTINGS_ADDRESS + SETTINGS_PAGE_SIZE),
+    static_cast<unsigned long long>(stats.programs));
+
+  // Boot load with the active page full of the shortest records
+  host::erase_flash();
+  Settings full;
+  full.load();
+  for(uint16_t timeout = 1; full.used() + 6 <= SETTINGS_PAGE_SIZE; timeout++) {
+    set(full, Settings::NexstarTimeout, number(timeout));
+  }
+  uint64_t reads = host::flash_stats().reads;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < LOAD_ITERATIONS; i++) {
+    full.load();
+  }
+  double load_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOAD_ITERATIONS;
+  fprintf(stderr, "Boot load, %u bytes used: %llu halfwords read, %.0f ns (host)\n", full.used(),
+    static_cast<unsigned long long>((host::flash_stats().reads - reads) / LOAD_ITERATIONS), load_ns);
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,251 @@
+#pragma once
+// Subset of the Arduino STM32 (libmaple) core API used by the firmware, for host builds.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <deque>
+#include "host.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+
+enum WiringPinMode {
+  OUTPUT,
+  OUTPUT_OPEN_DRAIN,
+  INPUT,
+  INPUT_ANALOG,
+  INPUT_PULLUP,
+  INPUT_PULLDOWN,
+  INPUT_FLOATING,
+  PWM,
+  PWM_OPEN_DRAIN,
+};
+
+enum ExtIntTriggerMode {
+  RISING,
+  FALLING,
+  CHANGE,
+};
+
+// Bluepill pin numbering
+enum {
+  PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+  PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+  PC13, PC14, PC15,
+  BOARD_NR_GPIO_PINS,
+};
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, WiringPinMode mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint32_t digitalRead(uint8_t pin);
+void pwmWrite(uint8_t pin, uint16_t duty_cycle);
+void analogWrite(uint8_t pin, int duty_cycle);
+typedef void (*voidFuncPtr)();
+void attachInterrupt(uint8_t pin, voidFuncPtr handler, ExtIntTriggerMode mode);
+void detachInterrupt(uint8_t pin);
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+// Flash strings are plain strings on the host, as on STM32
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char *s) : std::string(s ? s : "") {}
+  String(const std::string &s) : std::string(s) {}
+  explicit String(char c) : std::string(1, c) {}
+  explicit String(int value);
+  explicit String(unsigned int value);
+  explicit String(long value);
+  explicit String(unsigned long value);
+  void trim();
+};
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return s ? write(reinterpret_cast<const uint8_t*>(s), strlen(s)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+
+  size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char*>(s)); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  template<typename T> size_t println(T value) { return print(value) + println(); }
+  template<typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+  size_t println() { return write("\r\n"); }
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  size_t readBytes(char *buffer, size_t length);
+};
+
+// USART with an in-memory link to a peer.
+// Received bytes become available at the configured baud rate (8N1), and are dropped
+// when the RX buffer is full; write() blocks until the previous byte has been sent,
+// like libmaple's usart_putc.
+class HardwareSerial : public Stream, public host::EventSource {
+public:
+  typedef std::function<void(uint8_t byte, uint64_t time_us)> Listener;
+  explicit HardwareSerial(const char *name);
+  ~HardwareSerial();
+
+  void begin(uint32_t baud);
+  void end();
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  using Print::write;
+  void flush() override;
+  operator bool() { return true; }
+
+  // Host side
+  inline const char *name() const { return _name; }
+  inline bool is_open() const { return _baud > 0; }
+  inline uint32_t baud() const { return _baud; }
+  // Bytes sent by the peer: they start arriving now, or after the ones still on the line
+  void inject(const uint8_t *data, size_t size);
+  void inject(const char *data) { inject(reinterpret_cast<const uint8_t*>(data), strlen(data)); }
+  // Same, but the first byte is already there: for bytes replayed at the time they were read
+  void replay(const uint8_t *data, size_t size);
+  // Called for every byte written by the firmware, with the time its transmission ends
+  inline void set_listener(Listener listener) { _listener = listener; }
+  inline uint64_t bytes_received() const { return _bytes_received; }
+  inline uint64_t bytes_sent() const { return _bytes_sent; }
+  inline uint64_t overruns() const { return _overruns; }
+  // Microseconds needed to transfer a byte at the current baud rate
+  inline uint32_t byte_time_us() const { return _baud > 0 ? 10000000UL / _baud : 0; }
+
+  uint64_t next_event_us() const override;
+  // USART interrupt: moves the bytes off the line into the RX buffer
+  void fire(uint64_t now_us) override { receive(); }
+
+private:
+  const char *_name;
+  uint32_t _baud = 0;
+  std::deque<std::pair<uint64_t, uint8_t>> _line;
+  std::deque<uint8_t> _rx_buffer;
+  uint64_t _rx_line_free_at = 0;
+  uint64_t _tx_free_at = 0;
+  Listener _listener;
+  uint64_t _bytes_received = 0;
+  uint64_t _bytes_sent = 0;
+  uint64_t _overruns = 0;
+  void receive();
+};
+
+// USB CDC: no baud rate, "connected" when the host opened the port
+class USBSerial : public Stream {
+public:
+  typedef std::function<void(uint8_t byte, uint64_t time_us)> Listener;
+  void begin(uint32_t baud = 0) {}
+  void end() {}
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  using Print::write;
+  operator bool() { return _connected; }
+  inline bool isConnected() { return _connected; }
+
+  // Host side
+  inline void set_connected(bool connected) { _connected = connected; }
+  void inject(const uint8_t *data, size_t size);
+  void inject(const char *data) { inject(reinterpret_cast<const uint8_t*>(data), strlen(data)); }
+  inline void set_listener(Listener listener) { _listener = listener; }
+private:
+  bool _connected = false;
+  std::deque<uint8_t> _rx_buffer;
+  Listener _listener;
+};
+
+extern USBSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#define TIMER_OUTPUT_COMPARE 1
+#define TIMER_CH1 1
+#define TIMER_CH2 2
+#define TIMER_CH3 3
+#define TIMER_CH4 4
+
+// Fires the overflow and compare handlers once per period (compare values are ignored)
+class HardwareTimer : public host::EventSource {
+public:
+  explicit HardwareTimer(uint8_t timer);
+  ~HardwareTimer();
+  void pause();
+  void resume();
+  void refresh();
+  uint32_t setPeriod(uint32_t microseconds);
+  void setMode(int channel, int mode) {}
+  void setChannel1Mode(int mode) {}
+  void setCompare(int channel, uint16_t value) {}
+  void attachInterrupt(voidFuncPtr handler) { _overflow_handler = handler; }
+  void attachCompare1Interrupt(voidFuncPtr handler) { _compare_handler = handler; }
+  void detachInterrupt() { _overflow_handler = nullptr; }
+
+  uint64_t next_event_us() const override;
+  void fire(uint64_t now_us) override;
+
+private:
+  uint32_t _period_us = 1000;
+  bool _running = true;
+  uint64_t _next_us = 0;
+  voidFuncPtr _overflow_handler = nullptr;
+  voidFuncPtr _compare_handler = nullptr;
+};
+
+extern HardwareTimer Timer1;
+extern HardwareTimer Timer2;
+extern HardwareTimer Timer3;
+extern HardwareTimer Timer4;
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
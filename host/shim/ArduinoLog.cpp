@@ -0,0 +1,82 @@
+#include "ArduinoLog.h"
+
+Logging Log;
+
+void Logging::print(int level, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vprint(level, format, args);
+  va_end(args);
+}
+
+void Logging::begin(int level, Print *output, bool show_level) {
+  _level = level;
+  _output = output;
+  _show_level = show_level;
+}
+
+void Logging::vprint(int level, const char *format, va_list args) {
+  if(!_output || level > _level) {
+    return;
+  }
+  if(_show_level) {
+    static const char levels[] = "?FEWNTV";
+    _output->print(levels[level]);
+    _output->print(": ");
+  }
+  for(const char *c = format; *c; c++) {
+    if(*c != '%') {
+      _output->print(*c);
+      continue;
+    }
+    switch(*++c) {
+      case 's':
+      case 'S':
+        _output->print(va_arg(args, const char*));
+        break;
+      case 'd':
+      case 'i':
+        _output->print(va_arg(args, int));
+        break;
+      case 'l':
+        _output->print(va_arg(args, long));
+        break;
+      case 'x':
+        _output->print(va_arg(args, unsigned int), HEX);
+        break;
+      case 'X':
+        _output->print("0x");
+        _output->print(va_arg(args, unsigned int), HEX);
+        break;
+      case 'b':
+        _output->print(va_arg(args, unsigned int), BIN);
+        break;
+      case 'B':
+        _output->print("0b");
+        _output->print(va_arg(args, unsigned int), BIN);
+        break;
+      case 'c':
+        _output->print(static_cast<char>(va_arg(args, int)));
+        break;
+      case 't':
+        _output->print(va_arg(args, int) ? 'T' : 'F');
+        break;
+      case 'T':
+        _output->print(va_arg(args, int) ? "true" : "false");
+        break;
+      case 'D':
+      case 'F':
+        _output->print(va_arg(args, double));
+        break;
+      case '%':
+        _output->print('%');
+        break;
+      case 0:
+        return;
+      default:
+        break;
+    }
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
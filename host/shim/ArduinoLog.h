@@ -0,0 +1,48 @@
+#pragma once
+// printf-like logger with the same format specifiers as the ArduinoLog library.
+// As in the library, calls compile to nothing where DISABLE_LOGGING is defined.
+#include <stdarg.h>
+#include "Arduino.h"
+
+#define LOG_LEVEL_SILENT 0
+#define LOG_LEVEL_FATAL 1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_NOTICE 4
+#define LOG_LEVEL_TRACE 5
+#define LOG_LEVEL_VERBOSE 6
+
+#define CR "\n"
+
+class Logging {
+public:
+  void begin(int level, Print *output, bool show_level = true);
+  void setPrefix(void (*)(Print*)) {}
+  void setSuffix(void (*)(Print*)) {}
+
+  template<class T, typename... Args> void fatal(T format, Args... args) { log(LOG_LEVEL_FATAL, format, args...); }
+  template<class T, typename... Args> void error(T format, Args... args) { log(LOG_LEVEL_ERROR, format, args...); }
+  template<class T, typename... Args> void warning(T format, Args... args) { log(LOG_LEVEL_WARNING, format, args...); }
+  template<class T, typename... Args> void notice(T format, Args... args) { log(LOG_LEVEL_NOTICE, format, args...); }
+  template<class T, typename... Args> void trace(T format, Args... args) { log(LOG_LEVEL_TRACE, format, args...); }
+  template<class T, typename... Args> void verbose(T format, Args... args) { log(LOG_LEVEL_VERBOSE, format, args...); }
+
+private:
+  int _level = LOG_LEVEL_SILENT;
+  Print *_output = nullptr;
+  bool _show_level = true;
+  template<typename... Args> void log(int level, const char *format, Args... args) {
+#ifndef DISABLE_LOGGING
+    print(level, format, args...);
+#endif
+  }
+  template<typename... Args> void log(int level, const __FlashStringHelper *format, Args... args) {
+    log(level, reinterpret_cast<const char*>(format), args...);
+  }
+  void print(int level, const char *format, ...);
+  void vprint(int level, const char *format, va_list args);
+};
+
+extern Logging Log;
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,20 @@
+#pragma once
+// libmaple RTClock: seconds counter in the battery powered backup domain
+#include <time.h>
+#include <stdint.h>
+
+typedef enum {
+  RTCSEL_NONE,
+  RTCSEL_LSE,
+  RTCSEL_LSI,
+  RTCSEL_HSE,
+} rtc_clk_src;
+
+class RTClock {
+public:
+  RTClock(rtc_clk_src source = RTCSEL_LSE, uint16_t prescaler = 0x7fff) {}
+  void setTime(time_t time);
+  time_t getTime();
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,134 @@
+#include "TimeLib.h"
+#include "Arduino.h"
+
+#define LEAP_YEAR(Y) (((1970 + (Y)) > 0) && !((1970 + (Y)) % 4) && (((1970 + (Y)) % 100) || !((1970 + (Y)) % 400)))
+
+namespace {
+  const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  uint32_t sysTime = 0;
+  uint32_t prevMillis = 0;
+  uint32_t nextSyncTime = 0;
+  timeStatus_t status = timeNotSet;
+  getExternalTime getTimePtr = nullptr;
+  uint32_t syncInterval = 300;
+
+  tmElements_t current() {
+    tmElements_t tm;
+    breakTime(now(), tm);
+    return tm;
+  }
+}
+
+void breakTime(time_t timeInput, tmElements_t &tm) {
+  uint32_t time = static_cast<uint32_t>(timeInput);
+  tm.Second = time % 60;
+  time /= 60;
+  tm.Minute = time % 60;
+  time /= 60;
+  tm.Hour = time % 24;
+  time /= 24;
+  tm.Wday = ((time + 4) % 7) + 1;
+
+  uint8_t year = 0;
+  unsigned long days = 0;
+  while((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= time) {
+    year++;
+  }
+  tm.Year = year;
+  days -= LEAP_YEAR(year) ? 366 : 365;
+  time -= days;
+
+  uint8_t month;
+  for(month = 0; month < 12; month++) {
+    uint8_t month_length = (month == 1 && LEAP_YEAR(year)) ? 29 : monthDays[month];
+    if(time >= month_length) {
+      time -= month_length;
+    } else {
+      break;
+    }
+  }
+  tm.Month = month + 1;
+  tm.Day = time + 1;
+}
+
+time_t makeTime(const tmElements_t &tm) {
+  uint32_t seconds = tm.Year * (SECS_PER_DAY * 365);
+  for(int i = 0; i < tm.Year; i++) {
+    if(LEAP_YEAR(i)) {
+      seconds += SECS_PER_DAY;
+    }
+  }
+  for(int i = 1; i < tm.Month; i++) {
+    if(i == 2 && LEAP_YEAR(tm.Year)) {
+      seconds += SECS_PER_DAY * 29;
+    } else {
+      seconds += SECS_PER_DAY * monthDays[i - 1];
+    }
+  }
+  seconds += (tm.Day - 1) * SECS_PER_DAY;
+  seconds += tm.Hour * SECS_PER_HOUR;
+  seconds += tm.Minute * SECS_PER_MIN;
+  seconds += tm.Second;
+  return static_cast<time_t>(seconds);
+}
+
+time_t now() {
+  while(millis() - prevMillis >= 1000) {
+    sysTime++;
+    prevMillis += 1000;
+  }
+  if(nextSyncTime <= sysTime && getTimePtr) {
+    time_t t = getTimePtr();
+    if(t != 0) {
+      setTime(t);
+    } else {
+      nextSyncTime = sysTime + syncInterval;
+      status = status == timeNotSet ? timeNotSet : timeNeedsSync;
+    }
+  }
+  return static_cast<time_t>(sysTime);
+}
+
+void setTime(time_t t) {
+  sysTime = static_cast<uint32_t>(t);
+  nextSyncTime = sysTime + syncInterval;
+  status = timeSet;
+  prevMillis = millis();
+}
+
+void setTime(int hr, int min, int sec, int day, int month, int yr) {
+  tmElements_t tm;
+  tm.Year = yr > 99 ? CalendarYrToTm(yr) : y2kYearToTm(yr);
+  tm.Month = month;
+  tm.Day = day;
+  tm.Hour = hr;
+  tm.Minute = min;
+  tm.Second = sec;
+  setTime(makeTime(tm));
+}
+
+timeStatus_t timeStatus() {
+  now();
+  return status;
+}
+
+void setSyncProvider(getExternalTime getTimeFunction) {
+  getTimePtr = getTimeFunction;
+  nextSyncTime = sysTime;
+  now();
+}
+
+void setSyncInterval(time_t interval) {
+  syncInterval = static_cast<uint32_t>(interval);
+  nextSyncTime = sysTime + syncInterval;
+}
+
+int hour() { return current().Hour; }
+int minute() { return current().Minute; }
+int second() { return current().Second; }
+int day() { return current().Day; }
+int month() { return current().Month; }
+int year() { return tmYearToCalendar(current().Year); }
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,56 @@
+#include "Arduino.h"
+#include "RTClock.h"
+#include "libmaple/bkp.h"
+
+namespace {
+  // The RTC counts seconds from the (virtual) time it was set
+  uint32_t rtcTime = 0;
+  uint64_t rtcSetAt = 0;
+  uint16_t backupRegisters[BKP_NR_DATA_REGS + 1] = {0};
+  bool backupWritesEnabled = false;
+}
+
+namespace host {
+  void set_rtc_time(uint32_t time) {
+    rtcTime = time;
+    rtcSetAt = Clock::instance().now_us();
+  }
+
+  void reset_backup_domain() {
+    for(uint16_t &value : backupRegisters) {
+      value = 0;
+    }
+    set_rtc_time(0);
+  }
+}
+
+void RTClock::setTime(time_t time) {
+  host::set_rtc_time(static_cast<uint32_t>(time));
+}
+
+time_t RTClock::getTime() {
+  return rtcTime + (host::Clock::instance().now_us() - rtcSetAt) / 1000000;
+}
+
+void bkp_init() {
+}
+
+void bkp_enable_writes() {
+  backupWritesEnabled = true;
+}
+
+void bkp_disable_writes() {
+  backupWritesEnabled = false;
+}
+
+uint16_t bkp_read(uint8_t reg) {
+  return reg >= 1 && reg <= BKP_NR_DATA_REGS ? backupRegisters[reg] : 0;
+}
+
+void bkp_write(uint8_t reg, uint16_t value) {
+  if(backupWritesEnabled && reg >= 1 && reg <= BKP_NR_DATA_REGS) {
+    backupRegisters[reg] = value;
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,109 @@
+#include "Arduino.h"
+#include <algorithm>
+
+// Code runs in no time on the virtual clock: reading it costs a little, so that
+// busy waits polling millis() for input eventually see it arrive (or time out)
+#define CLOCK_READ_COST_US 1
+
+namespace host {
+
+EventSource::~EventSource() {
+}
+
+OwnerScope::Owner OwnerScope::_current = OwnerScope::Host;
+
+Clock &Clock::instance() {
+  static Clock clock;
+  return clock;
+}
+
+uint64_t Clock::next_event_us() const {
+  uint64_t next = UINT64_MAX;
+  for(EventSource *source : _sources) {
+    next = std::min(next, source->next_event_us());
+  }
+  return next;
+}
+
+void Clock::advance_to(uint64_t time_us) {
+  // Handlers moving the clock themselves (delay() in an interrupt) just move it forward
+  if(_advancing) {
+    _now_us = std::max(_now_us, time_us);
+    return;
+  }
+  _advancing = true;
+  OwnerScope scope(OwnerScope::Host);
+  for(;;) {
+    EventSource *first = nullptr;
+    uint64_t first_us = UINT64_MAX;
+    for(EventSource *source : _sources) {
+      uint64_t next = source->next_event_us();
+      if(next < first_us) {
+        first = source;
+        first_us = next;
+      }
+    }
+    if(!first || first_us > time_us) {
+      break;
+    }
+    _now_us = std::max(_now_us, first_us);
+    first->fire(_now_us);
+  }
+  _now_us = std::max(_now_us, time_us);
+  _advancing = false;
+}
+
+void Clock::add_source(EventSource *source) {
+  _sources.push_back(source);
+}
+
+void Clock::remove_source(EventSource *source) {
+  _sources.erase(std::remove(_sources.begin(), _sources.end(), source), _sources.end());
+}
+
+void Clock::reset() {
+  _now_us = 0;
+}
+
+namespace {
+  uint64_t systickPeriod = 1000;
+}
+
+void set_systick_period_us(uint64_t period_us) {
+  systickPeriod = period_us;
+}
+
+void wait_for_interrupt() {
+  Clock &clock = Clock::instance();
+  uint64_t wake_up = std::max(clock.now_us(), clock.next_event_us());
+  if(systickPeriod > 0) {
+    wake_up = std::min(wake_up, (clock.now_us() / systickPeriod + 1) * systickPeriod);
+  }
+  if(wake_up == UINT64_MAX) {
+    // Nothing will ever happen: don't hang
+    wake_up = clock.now_us() + 1000;
+  }
+  clock.advance_to(wake_up);
+}
+
+}
+
+uint32_t millis() {
+  host::Clock::instance().advance(CLOCK_READ_COST_US);
+  return host::Clock::instance().now_us() / 1000;
+}
+
+uint32_t micros() {
+  host::Clock::instance().advance(CLOCK_READ_COST_US);
+  return host::Clock::instance().now_us();
+}
+
+void delay(uint32_t ms) {
+  host::Clock::instance().advance(static_cast<uint64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  host::Clock::instance().advance(us);
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
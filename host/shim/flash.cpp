@@ -0,0 +1,145 @@
+#include "Arduino.h"
+#include "flash_stm32.h"
+#include <random>
+#include <string.h>
+
+#define FLASH_PROGRAM_US 52
+#define FLASH_ERASE_US 20000
+#define FLASH_PAGES (FLASH_SIZE / FLASH_PAGE_SIZE)
+
+namespace {
+  uint16_t flash[FLASH_SIZE / 2];
+  uint32_t pageErases[FLASH_PAGES] = {0};
+  host::FlashStats stats = {0, 0, 0};
+  bool unlocked = false;
+  bool initialized = false;
+  // Operations left before the power cut, when armed
+  bool cutArmed = false;
+  bool powerCut = false;
+  uint32_t operationsLeft = 0;
+  std::mt19937 tornBits;
+
+  void initialize() {
+    if(!initialized) {
+      memset(flash, 0xFF, sizeof(flash));
+      initialized = true;
+    }
+  }
+
+  bool valid(uint32_t address) {
+    return address >= FLASH_BASE_ADDRESS && address < FLASH_BASE_ADDRESS + FLASH_SIZE;
+  }
+
+  inline uint16_t &halfword(uint32_t address) {
+    return flash[(address - FLASH_BASE_ADDRESS) / 2];
+  }
+
+  // True if the power fails during this operation
+  bool cut_now() {
+    if(!cutArmed) {
+      return false;
+    }
+    if(operationsLeft > 0) {
+      operationsLeft--;
+      return false;
+    }
+    cutArmed = false;
+    powerCut = true;
+    return true;
+  }
+}
+
+namespace host {
+  uint16_t flash_read(uint32_t address) {
+    initialize();
+    stats.reads++;
+    return valid(address) ? halfword(address & ~1UL) : 0xFFFF;
+  }
+
+  void erase_flash() {
+    initialized = false;
+    initialize();
+    memset(pageErases, 0, sizeof(pageErases));
+    stats = FlashStats{0, 0, 0};
+  }
+
+  const FlashStats &flash_stats() {
+    return stats;
+  }
+
+  uint32_t flash_page_erases(uint32_t address) {
+    return valid(address) ? pageErases[(address - FLASH_BASE_ADDRESS) / FLASH_PAGE_SIZE] : 0;
+  }
+
+  void cut_flash_power_after(uint32_t operations, uint32_t seed) {
+    cutArmed = true;
+    operationsLeft = operations;
+    tornBits.seed(seed);
+  }
+
+  void restore_flash_power() {
+    cutArmed = false;
+    powerCut = false;
+    unlocked = false;
+  }
+
+  bool flash_power_cut() {
+    return powerCut;
+  }
+}
+
+void FLASH_Unlock() {
+  unlocked = true;
+}
+
+void FLASH_Lock() {
+  unlocked = false;
+}
+
+FLASH_Status FLASH_ErasePage(uint32_t address) {
+  initialize();
+  if(powerCut) {
+    return FLASH_TIMEOUT;
+  }
+  if(!valid(address)) {
+    return FLASH_BAD_ADDRESS;
+  }
+  if(!unlocked) {
+    return FLASH_ERROR_WRP;
+  }
+  uint32_t page = (address - FLASH_BASE_ADDRESS) / FLASH_PAGE_SIZE;
+  uint16_t *first = &halfword(FLASH_BASE_ADDRESS + page * FLASH_PAGE_SIZE);
+  bool cut = cut_now();
+  for(uint16_t *value = first; value < first + FLASH_PAGE_SIZE / 2; value++) {
+    // Erasing sets bits: an interrupted erase only set some of them
+    *value = cut ? *value | static_cast<uint16_t>(tornBits()) : 0xFFFF;
+  }
+  pageErases[page]++;
+  stats.erases++;
+  host::Clock::instance().advance(FLASH_ERASE_US);
+  return cut ? FLASH_TIMEOUT : FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t address, uint16_t data) {
+  initialize();
+  if(powerCut) {
+    return FLASH_TIMEOUT;
+  }
+  if(!valid(address) || (address & 1)) {
+    return FLASH_BAD_ADDRESS;
+  }
+  if(!unlocked) {
+    return FLASH_ERROR_WRP;
+  }
+  uint16_t &value = halfword(address);
+  if(value != 0xFFFF && data != 0) {
+    return FLASH_ERROR_PG;
+  }
+  // Programming clears bits: an interrupted program only cleared some of them
+  value &= cut_now() ? data | static_cast<uint16_t>(tornBits()) : data;
+  stats.programs++;
+  host::Clock::instance().advance(FLASH_PROGRAM_US);
+  return powerCut ? FLASH_TIMEOUT : FLASH_COMPLETE;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,27 @@
+#pragma once
+// Flash programming API of the STM32 EEPROM library (flash_stm32.h in the Arduino_STM32 core).
+// The emulated flash is 64 KB of 1 KB pages (STM32F103C8): see host.h to read it back,
+// count erases and cut the power in the middle of an operation.
+#include <stdint.h>
+
+#define FLASH_BASE_ADDRESS 0x08000000
+#define FLASH_SIZE 0x10000
+#define FLASH_PAGE_SIZE 0x400
+
+typedef enum {
+  FLASH_BUSY = 1,
+  FLASH_ERROR_PG,
+  FLASH_ERROR_WRP,
+  FLASH_ERROR_OPT,
+  FLASH_COMPLETE,
+  FLASH_TIMEOUT,
+  FLASH_BAD_ADDRESS,
+} FLASH_Status;
+
+void FLASH_Unlock();
+void FLASH_Lock();
+FLASH_Status FLASH_ErasePage(uint32_t address);
+// Programming a halfword that isn't erased (0xFFFF) fails, unless clearing it to 0
+FLASH_Status FLASH_ProgramHalfWord(uint32_t address, uint16_t data);
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+// Control interface of the host build: the firmware only sees the Arduino API,
+// simulations and tests drive the virtual clock and the peripherals through this.
+namespace host {
+
+// Something that needs to wake up the CPU at a given time (timers, incoming serial data)
+class EventSource {
+public:
+  virtual ~EventSource();
+  // Absolute time of the next event in microseconds, UINT64_MAX if none is scheduled
+  virtual uint64_t next_event_us() const = 0;
+  // Called when the clock reaches next_event_us()
+  virtual void fire(uint64_t now_us) {}
+};
+
+// Virtual clock behind millis() and micros(): time only moves when advanced, either by the
+// firmware (delay(), blocking serial writes, sleeping) or by the host.
+class Clock {
+public:
+  static Clock &instance();
+  inline uint64_t now_us() const { return _now_us; }
+  // Moves the clock forward, firing events scheduled in between in order
+  void advance_to(uint64_t time_us);
+  inline void advance(uint64_t duration_us) { advance_to(_now_us + duration_us); }
+  uint64_t next_event_us() const;
+  void add_source(EventSource *source);
+  void remove_source(EventSource *source);
+  void reset();
+private:
+  uint64_t _now_us = 0;
+  bool _advancing = false;
+  std::vector<EventSource*> _sources;
+};
+
+// Who the running code works for, to attribute heap allocations (nexstargps-soak):
+// the firmware, or the host (models, listeners, shim buffers). Scopes nest, and the
+// shim switches to Firmware for interrupt handlers, and to Host for everything else
+// it does on behalf of the firmware.
+class OwnerScope {
+public:
+  enum Owner {
+    Host,
+    Firmware,
+  };
+  explicit OwnerScope(Owner owner) : _previous(_current) { _current = owner; }
+  ~OwnerScope() { _current = _previous; }
+  static inline Owner current() { return _current; }
+private:
+  Owner _previous;
+  static Owner _current;
+};
+
+// What the CPU does on WFI: sleep until the next event, or the next SysTick
+void wait_for_interrupt();
+// 1 ms on the board; longer periods make simulations faster, at the expense of timing accuracy.
+// 0 disables SysTick wake ups altogether.
+void set_systick_period_us(uint64_t period_us);
+
+// GPIO
+typedef std::function<void(uint8_t pin, uint16_t value)> PinListener;
+void set_pin_listener(PinListener listener);
+uint16_t pin_value(uint8_t pin);
+void set_pin_value(uint8_t pin, uint16_t value);
+// Runs the handler attached with attachInterrupt(), as if the pin triggered it
+void trigger_pin_interrupt(uint8_t pin);
+
+// RTC counter (seconds), kept across resets like the battery powered backup domain
+void set_rtc_time(uint32_t time);
+
+// Clears the backup registers
+void reset_backup_domain();
+
+// Flash (flash_stm32.h): the firmware reads it through flash_read(), which counts reads.
+// Erasing takes 20 ms and programming a halfword 52 us of virtual time, as on the board.
+uint16_t flash_read(uint32_t address);
+void erase_flash();
+struct FlashStats {
+  uint64_t reads; // halfwords
+  uint64_t programs;
+  uint64_t erases;
+};
+const FlashStats &flash_stats();
+uint32_t flash_page_erases(uint32_t address);
+// Power fails during the flash operation (program or erase) following the next
+// `operations` ones: it's left half done, with random bits of it applied, and
+// later operations are ignored until restore_flash_power(), as if the firmware was
+// dead. Random bits come from seed.
+void cut_flash_power_after(uint32_t operations, uint32_t seed);
+void restore_flash_power();
+bool flash_power_cut();
+
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,13 @@
+#pragma once
+// libmaple backup registers (BKP_DR1..BKP_DR10 on the STM32F103C8)
+#include <stdint.h>
+
+#define BKP_NR_DATA_REGS 10
+
+void bkp_init();
+void bkp_enable_writes();
+void bkp_disable_writes();
+uint16_t bkp_read(uint8_t reg);
+void bkp_write(uint8_t reg, uint16_t value);
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
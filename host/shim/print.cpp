@@ -0,0 +1,62 @@
+#include "Arduino.h"
+
+String::String(int value) : std::string(std::to_string(value)) {
+}
+
+String::String(unsigned int value) : std::string(std::to_string(value)) {
+}
+
+String::String(long value) : std::string(std::to_string(value)) {
+}
+
+String::String(unsigned long value) : std::string(std::to_string(value)) {
+}
+
+void String::trim() {
+  static const char *whitespace = " \t\r\n\f\v";
+  size_t end = find_last_not_of(whitespace);
+  if(end == npos) {
+    clear();
+    return;
+  }
+  erase(end + 1);
+  erase(0, find_first_not_of(whitespace));
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  for(size_t i = 0; i < size; i++) {
+    written += write(buffer[i]);
+  }
+  return written;
+}
+
+size_t Print::print(long value, int base) {
+  if(base == DEC && value < 0) {
+    return print('-') + print(static_cast<unsigned long>(-value), base);
+  }
+  return print(static_cast<unsigned long>(value), base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char buffer[8 * sizeof(value) + 1];
+  char *digit = buffer + sizeof(buffer) - 1;
+  *digit = 0;
+  if(base < 2) {
+    base = DEC;
+  }
+  do {
+    uint8_t remainder = value % base;
+    *--digit = remainder < 10 ? '0' + remainder : 'A' + remainder - 10;
+    value /= base;
+  } while(value > 0);
+  return write(digit);
+}
+
+size_t Print::print(double value, int digits) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return write(buffer);
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
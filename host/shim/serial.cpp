@@ -0,0 +1,158 @@
+#include "Arduino.h"
+#include <algorithm>
+
+// libmaple's USART_RX_BUF_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+
+USBSerial Serial;
+HardwareSerial Serial1("Serial1");
+HardwareSerial Serial2("Serial2");
+HardwareSerial Serial3("Serial3");
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while(count < length && available()) {
+    buffer[count++] = read();
+  }
+  return count;
+}
+
+HardwareSerial::HardwareSerial(const char *name) : _name(name) {
+  host::Clock::instance().add_source(this);
+}
+
+HardwareSerial::~HardwareSerial() {
+  host::Clock::instance().remove_source(this);
+}
+
+void HardwareSerial::begin(uint32_t baud) {
+  _baud = baud;
+  _rx_buffer.clear();
+}
+
+void HardwareSerial::end() {
+  _baud = 0;
+  _line.clear();
+  _rx_buffer.clear();
+}
+
+void HardwareSerial::inject(const uint8_t *data, size_t size) {
+  if(!is_open()) {
+    return;
+  }
+  uint64_t arrival = std::max(host::Clock::instance().now_us(), _rx_line_free_at);
+  for(size_t i = 0; i < size; i++) {
+    arrival += byte_time_us();
+    _line.push_back(std::make_pair(arrival, data[i]));
+  }
+  _rx_line_free_at = arrival;
+}
+
+void HardwareSerial::replay(const uint8_t *data, size_t size) {
+  if(!is_open() || size == 0) {
+    return;
+  }
+  uint64_t arrival = std::max(host::Clock::instance().now_us(), _rx_line_free_at);
+  for(size_t i = 0; i < size; i++) {
+    _line.push_back(std::make_pair(arrival, data[i]));
+    arrival += byte_time_us();
+  }
+  _rx_line_free_at = arrival - byte_time_us();
+}
+
+void HardwareSerial::receive() {
+  host::OwnerScope scope(host::OwnerScope::Host);
+  uint64_t now = host::Clock::instance().now_us();
+  while(!_line.empty() && _line.front().first <= now) {
+    if(_rx_buffer.size() < SERIAL_RX_BUFFER_SIZE) {
+      _rx_buffer.push_back(_line.front().second);
+      _bytes_received++;
+    } else {
+      _overruns++;
+    }
+    _line.pop_front();
+  }
+}
+
+uint64_t HardwareSerial::next_event_us() const {
+  return _line.empty() ? UINT64_MAX : _line.front().first;
+}
+
+int HardwareSerial::available() {
+  receive();
+  return _rx_buffer.size();
+}
+
+int HardwareSerial::read() {
+  receive();
+  if(_rx_buffer.empty()) {
+    return -1;
+  }
+  uint8_t c = _rx_buffer.front();
+  _rx_buffer.pop_front();
+  return c;
+}
+
+int HardwareSerial::peek() {
+  receive();
+  return _rx_buffer.empty() ? -1 : _rx_buffer.front();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if(!is_open()) {
+    return 0;
+  }
+  host::Clock &clock = host::Clock::instance();
+  // Busy wait for the transmitter
+  if(clock.now_us() < _tx_free_at) {
+    clock.advance_to(_tx_free_at);
+  }
+  _tx_free_at = clock.now_us() + byte_time_us();
+  _bytes_sent++;
+  if(_listener) {
+    host::OwnerScope scope(host::OwnerScope::Host);
+    _listener(c, _tx_free_at);
+  }
+  return 1;
+}
+
+void HardwareSerial::flush() {
+  host::Clock &clock = host::Clock::instance();
+  if(clock.now_us() < _tx_free_at) {
+    clock.advance_to(_tx_free_at);
+  }
+}
+
+int USBSerial::available() {
+  return _rx_buffer.size();
+}
+
+int USBSerial::read() {
+  if(_rx_buffer.empty()) {
+    return -1;
+  }
+  uint8_t c = _rx_buffer.front();
+  _rx_buffer.pop_front();
+  return c;
+}
+
+int USBSerial::peek() {
+  return _rx_buffer.empty() ? -1 : _rx_buffer.front();
+}
+
+size_t USBSerial::write(uint8_t c) {
+  if(!_connected) {
+    return 0;
+  }
+  if(_listener) {
+    host::OwnerScope scope(host::OwnerScope::Host);
+    _listener(c, host::Clock::instance().now_us());
+  }
+  return 1;
+}
+
+void USBSerial::inject(const uint8_t *data, size_t size) {
+  _rx_buffer.insert(_rx_buffer.end(), data, data + size);
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,128 @@
+#include "Arduino.h"
+
+namespace {
+  uint16_t pinValues[BOARD_NR_GPIO_PINS] = {0};
+  voidFuncPtr pinHandlers[BOARD_NR_GPIO_PINS] = {nullptr};
+  host::PinListener pinListener;
+
+  void set_pin(uint8_t pin, uint16_t value) {
+    if(pin >= BOARD_NR_GPIO_PINS) {
+      return;
+    }
+    pinValues[pin] = value;
+    if(pinListener) {
+      host::OwnerScope scope(host::OwnerScope::Host);
+      pinListener(pin, value);
+    }
+  }
+}
+
+namespace host {
+  void set_pin_listener(PinListener listener) {
+    pinListener = listener;
+  }
+
+  uint16_t pin_value(uint8_t pin) {
+    return pin < BOARD_NR_GPIO_PINS ? pinValues[pin] : 0;
+  }
+
+  void set_pin_value(uint8_t pin, uint16_t value) {
+    if(pin < BOARD_NR_GPIO_PINS) {
+      pinValues[pin] = value;
+    }
+  }
+
+  void trigger_pin_interrupt(uint8_t pin) {
+    if(pin < BOARD_NR_GPIO_PINS && pinHandlers[pin]) {
+      OwnerScope scope(OwnerScope::Firmware);
+      pinHandlers[pin]();
+    }
+  }
+}
+
+void pinMode(uint8_t pin, WiringPinMode mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  set_pin(pin, value ? HIGH : LOW);
+}
+
+uint32_t digitalRead(uint8_t pin) {
+  return host::pin_value(pin) ? HIGH : LOW;
+}
+
+void pwmWrite(uint8_t pin, uint16_t duty_cycle) {
+  set_pin(pin, duty_cycle);
+}
+
+void analogWrite(uint8_t pin, int duty_cycle) {
+  set_pin(pin, duty_cycle);
+}
+
+void attachInterrupt(uint8_t pin, voidFuncPtr handler, ExtIntTriggerMode mode) {
+  if(pin < BOARD_NR_GPIO_PINS) {
+    pinHandlers[pin] = handler;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if(pin < BOARD_NR_GPIO_PINS) {
+    pinHandlers[pin] = nullptr;
+  }
+}
+
+HardwareTimer Timer1(1);
+HardwareTimer Timer2(2);
+HardwareTimer Timer3(3);
+HardwareTimer Timer4(4);
+
+HardwareTimer::HardwareTimer(uint8_t timer) {
+  host::Clock::instance().add_source(this);
+}
+
+HardwareTimer::~HardwareTimer() {
+  host::Clock::instance().remove_source(this);
+}
+
+void HardwareTimer::pause() {
+  _running = false;
+}
+
+void HardwareTimer::resume() {
+  if(!_running) {
+    _running = true;
+    _next_us = host::Clock::instance().now_us() + _period_us;
+  }
+}
+
+void HardwareTimer::refresh() {
+  _next_us = host::Clock::instance().now_us() + _period_us;
+}
+
+uint32_t HardwareTimer::setPeriod(uint32_t microseconds) {
+  _period_us = microseconds > 0 ? microseconds : 1;
+  return _period_us;
+}
+
+uint64_t HardwareTimer::next_event_us() const {
+  if(!_running || (!_overflow_handler && !_compare_handler)) {
+    return UINT64_MAX;
+  }
+  return _next_us;
+}
+
+void HardwareTimer::fire(uint64_t now_us) {
+  _next_us += _period_us;
+  if(_next_us <= now_us) {
+    _next_us = now_us + _period_us;
+  }
+  host::OwnerScope scope(host::OwnerScope::Firmware);
+  if(_overflow_handler) {
+    _overflow_handler();
+  }
+  if(_compare_handler) {
+    _compare_handler();
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
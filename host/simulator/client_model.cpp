@@ -0,0 +1,60 @@
+#include "client_model.h"
+
+#define CLIENT_TIMEOUT_US 2000000ULL
+
+ClientModel::ClientModel(const char *name, Timeline &timeline, uint32_t poll_ms) : Model(name, timeline), _poll_ms(poll_ms) {
+}
+
+void ClientModel::connect() {
+  if(_connected) {
+    return;
+  }
+  _connected = true;
+  _waiting = false;
+  _timeline.record(_name, "connected");
+  uint32_t generation = ++_generation;
+  after(_poll_ms * 1000ULL, [this, generation]() { poll(generation); });
+}
+
+void ClientModel::disconnect() {
+  if(!_connected) {
+    return;
+  }
+  _connected = false;
+  _generation++;
+  _timeline.record(_name, "disconnected");
+}
+
+void ClientModel::poll(uint32_t generation) {
+  if(generation != _generation) {
+    return;
+  }
+  after(_poll_ms * 1000ULL, [this, generation]() { poll(generation); });
+  if(_waiting) {
+    if(now_us() - _sent_at < CLIENT_TIMEOUT_US) {
+      return;
+    }
+    _timeouts++;
+    _timeline.record(_name, "timeout");
+  }
+  _waiting = true;
+  _sent_at = now_us();
+  _requests++;
+  static const uint8_t command[] = {'e'};
+  _sender(command, sizeof(command));
+}
+
+void ClientModel::on_byte(uint8_t c) {
+  if(!_connected || !_waiting || c != '#') {
+    return;
+  }
+  _waiting = false;
+  uint64_t rtt = now_us() - _sent_at;
+  _replies++;
+  _rtt_total_us += rtt;
+  if(rtt > _rtt_max_us) {
+    _rtt_max_us = rtt;
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,37 @@
+#pragma once
+#include "model.h"
+#include <string>
+
+// Planetarium software polling the telescope position ('e' command) through the firmware.
+class ClientModel : public Model {
+public:
+  typedef std::function<void(const uint8_t *data, size_t size)> Sender;
+  ClientModel(const char *name, Timeline &timeline, uint32_t poll_ms);
+  // Where commands are sent (USB Serial, or the Bluetooth link)
+  inline void set_sender(Sender sender) { _sender = sender; }
+  void connect();
+  void disconnect();
+  void on_byte(uint8_t c);
+
+  inline uint64_t requests() const { return _requests; }
+  inline uint64_t replies() const { return _replies; }
+  inline uint64_t timeouts() const { return _timeouts; }
+  inline uint64_t rtt_max_us() const { return _rtt_max_us; }
+  inline uint64_t rtt_mean_us() const { return _replies > 0 ? _rtt_total_us / _replies : 0; }
+
+private:
+  uint32_t _poll_ms;
+  Sender _sender;
+  bool _connected = false;
+  uint32_t _generation = 0;
+  bool _waiting = false;
+  uint64_t _sent_at = 0;
+  uint64_t _requests = 0;
+  uint64_t _replies = 0;
+  uint64_t _timeouts = 0;
+  uint64_t _rtt_total_us = 0;
+  uint64_t _rtt_max_us = 0;
+  void poll(uint32_t generation);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,128 @@
+#include "gps_model.h"
+#include <TimeLib.h>
+#include <math.h>
+
+#define GPS_MODEL_BAUD_RATE 9600
+// Sentences start after the fix epoch, once the receiver computed the solution
+#define GPS_MODEL_OUTPUT_DELAY_US 60000
+#define GPS_MODEL_WAKE_UP_US 1000000
+#define METERS_PER_DEGREE 111319.49
+// Header, class, id, length, 8 bytes payload, checksum
+#define UBX_BACKUP_REQUEST_SIZE 16
+
+namespace {
+  const uint8_t ubxBackupRequest[] = {0xB5, 0x62, 0x02, 0x41};
+
+  std::string coordinate(double value, int degrees_digits, char positive, char negative) {
+    char hemisphere = value < 0 ? negative : positive;
+    value = fabs(value);
+    int degrees = static_cast<int>(value);
+    double minutes = (value - degrees) * 60;
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%0*d%08.5f,%c", degrees_digits, degrees, minutes, hemisphere);
+    return buffer;
+  }
+}
+
+GPSModel::GPSModel(HardwareSerial &port, Timeline &timeline, const Config &config)
+  : Model("gps", timeline), _port(port), _config(config), _random(config.seed) {
+  _port.set_listener([this](uint8_t c, uint64_t time_us) {
+    schedule(time_us, [this, c]() { on_byte(c); });
+  });
+}
+
+void GPSModel::start() {
+  _time_at_us = _config.time_fix_ms * 1000ULL;
+  _fix_at_us = _config.position_fix_ms * 1000ULL;
+  schedule_epoch((_config.boot_ms / 1000 + 1) * 1000000ULL);
+}
+
+void GPSModel::schedule_epoch(uint64_t epoch_us) {
+  uint32_t generation = _generation;
+  schedule(epoch_us, [this, epoch_us, generation]() {
+    // Epochs scheduled before going to sleep are discarded
+    if(generation == _generation) {
+      epoch(epoch_us);
+    }
+  });
+}
+
+void GPSModel::epoch(uint64_t epoch_us) {
+  schedule_epoch(epoch_us + 1000000);
+  if(_port.baud() != GPS_MODEL_BAUD_RATE) {
+    return;
+  }
+  _epochs++;
+  if(!_has_time && epoch_us >= _time_at_us) {
+    _has_time = true;
+    _timeline.record(_name, "time fix");
+  }
+  if(!_has_fix && epoch_us >= _fix_at_us) {
+    _has_fix = true;
+    _timeline.record(_name, "position fix");
+  }
+
+  std::string time;
+  std::string date;
+  if(_has_time) {
+    tmElements_t tm;
+    breakTime(_config.start_utc + epoch_us / 1000000, tm);
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%02d%02d%02d.00", tm.Hour, tm.Minute, tm.Second);
+    time = buffer;
+    snprintf(buffer, sizeof(buffer), "%02d%02d%02d", tm.Day, tm.Month, tmYearToCalendar(tm.Year) % 100);
+    date = buffer;
+  }
+  std::string position = ",,,";
+  if(_has_fix) {
+    double lat = _config.lat + _noise(_random) * _config.noise_meters / METERS_PER_DEGREE;
+    double lng = _config.lng + _noise(_random) * _config.noise_meters / (METERS_PER_DEGREE * cos(_config.lat * M_PI / 180));
+    position = coordinate(lat, 2, 'N', 'S') + "," + coordinate(lng, 3, 'E', 'W');
+  }
+  after(GPS_MODEL_OUTPUT_DELAY_US, [=]() {
+    send("GPRMC," + time + (_has_fix ? ",A," : ",V,") + position + ",0.01,," + date + ",,,"  + (_has_fix ? "A" : "N"));
+    send("GPGGA," + time + "," + position + (_has_fix ? ",1,08,0.95,102.3,M,47.0,M,," : ",0,00,99.99,,,,,,"));
+    send(_has_fix ? "GPGSA,A,3,02,05,12,13,15,18,24,25,,,,,1.65,0.95,1.35" : "GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+    send("GPGSV,3,1,12,02,45,120,38,05,30,060,35,12,70,300,42,13,15,200,30");
+    send("GPGSV,3,2,12,15,50,250,40,18,20,080,33,24,60,010,41,25,35,150,36");
+    send("GPGSV,3,3,12,29,05,330,,31,10,280,,20,02,100,,10,08,040,");
+  });
+}
+
+void GPSModel::send(const std::string &body) {
+  uint8_t checksum = 0;
+  for(char c : body) {
+    checksum ^= static_cast<uint8_t>(c);
+  }
+  char trailer[8];
+  snprintf(trailer, sizeof(trailer), "*%02X\r\n", checksum);
+  std::string sentence = "$" + body + trailer;
+  _port.inject(sentence.c_str());
+  _sentences++;
+}
+
+void GPSModel::on_byte(uint8_t c) {
+  if(_ignore > 0) {
+    _ignore--;
+    return;
+  }
+  if(_asleep) {
+    _asleep = false;
+    _timeline.record(_name, "wake up");
+    schedule_epoch((now_us() + GPS_MODEL_WAKE_UP_US) / 1000000 * 1000000 + 1000000);
+    return;
+  }
+  _received.push_back(static_cast<char>(c));
+  if(_received.size() > sizeof(ubxBackupRequest)) {
+    _received.erase(0, 1);
+  }
+  if(_received == std::string(reinterpret_cast<const char*>(ubxBackupRequest), sizeof(ubxBackupRequest))) {
+    _asleep = true;
+    _generation++;
+    _ignore = UBX_BACKUP_REQUEST_SIZE - sizeof(ubxBackupRequest);
+    _received.clear();
+    _timeline.record(_name, "backup mode");
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,48 @@
+#pragma once
+#include "Arduino.h"
+#include "model.h"
+#include <random>
+#include <string>
+
+// u-blox NEO-6M like receiver: 1 Hz NMEA output (RMC, GGA, GSA, GSV) at 9600 baud.
+// Time and position fixes come after the configured acquisition times; UBX-RXM-PMREQ
+// puts it in backup mode until any byte is received.
+class GPSModel : public Model {
+public:
+  struct Config {
+    uint32_t start_utc; // UTC at simulation start
+    double lat;
+    double lng;
+    double noise_meters; // 1-sigma position noise
+    uint32_t boot_ms;
+    uint32_t time_fix_ms;
+    uint32_t position_fix_ms;
+    uint32_t seed;
+  };
+  GPSModel(HardwareSerial &port, Timeline &timeline, const Config &config);
+  void start();
+  inline uint64_t epochs() const { return _epochs; }
+  inline uint64_t sentences() const { return _sentences; }
+
+private:
+  HardwareSerial &_port;
+  Config _config;
+  std::mt19937 _random;
+  std::normal_distribution<double> _noise{0, 1};
+  bool _asleep = false;
+  bool _has_time = false;
+  bool _has_fix = false;
+  uint64_t _fix_at_us;
+  uint64_t _time_at_us;
+  uint64_t _epochs = 0;
+  uint64_t _sentences = 0;
+  uint32_t _generation = 0;
+  uint8_t _ignore = 0;
+  void schedule_epoch(uint64_t epoch_us);
+  std::string _received;
+  void epoch(uint64_t epoch_us);
+  void send(const std::string &sentence);
+  void on_byte(uint8_t c);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
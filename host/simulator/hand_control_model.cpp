@@ -0,0 +1,120 @@
+#include "hand_control_model.h"
+
+#define HAND_CONTROL_BAUD_RATE 9600
+
+namespace {
+  // Argument bytes following each opcode
+  size_t arguments(char opcode) {
+    switch(opcode) {
+      case 'K':
+      case 'T':
+        return 1;
+      case 'P':
+        return 7;
+      case 'H':
+      case 'W':
+        return 8;
+      case 'R':
+      case 'B':
+      case 'S':
+        return 9;
+      case 'r':
+      case 'b':
+      case 's':
+        return 17;
+      default:
+        return 0;
+    }
+  }
+}
+
+HandControlModel::HandControlModel(HardwareSerial &port, Timeline &timeline, const Config &config)
+  : Model("hand_control", timeline), _port(port), _config(config) {
+  _port.set_listener([this](uint8_t c, uint64_t time_us) {
+    schedule(time_us, [this, c]() { on_byte(c); });
+  });
+}
+
+void HandControlModel::start() {
+  schedule(_config.connect_ms * 1000ULL, [this]() {
+    _connected = true;
+    _timeline.record(_name, "connected");
+  });
+  if(_config.disconnect_ms > 0) {
+    schedule(_config.disconnect_ms * 1000ULL, [this]() {
+      _connected = false;
+      _command.clear();
+      _timeline.record(_name, "disconnected");
+    });
+  }
+}
+
+void HandControlModel::on_byte(uint8_t c) {
+  if(!_connected || _port.baud() != HAND_CONTROL_BAUD_RATE) {
+    return;
+  }
+  _command.push_back(static_cast<char>(c));
+  if(_command.size() < 1 + arguments(_command[0])) {
+    return;
+  }
+  std::string command = _command;
+  _command.clear();
+  _commands++;
+  switch(command[0]) {
+    case 'H':
+      _timeline.record(_name, "time set: %02d:%02d:%02d %02d/%02d/%02d", command[1], command[2], command[3], command[4], command[5], command[6]);
+      break;
+    case 'W':
+      _timeline.record(_name, "location set: %dd%02dm%02ds %c %dd%02dm%02ds %c",
+        command[1], command[2], command[3], command[4] ? 'S' : 'N',
+        command[5], command[6], command[7], command[8] ? 'W' : 'E');
+      break;
+    default:
+      break;
+  }
+  after(_config.latency_ms * 1000ULL, [this, command]() { reply(command); });
+}
+
+void HandControlModel::reply(const std::string &command) {
+  if(!_connected) {
+    return;
+  }
+  std::string reply;
+  switch(command[0]) {
+    case 'K':
+      reply = command.substr(1);
+      break;
+    case 'V':
+      reply = std::string("\x05\x16", 2);
+      break;
+    case 'e':
+    case 'z':
+      reply = "34AB0500,12CE0500";
+      break;
+    case 'E':
+    case 'Z':
+      reply = "34AB,12CE";
+      break;
+    case 'h':
+    case 'w':
+      reply = std::string(8, '\0');
+      break;
+    case 'J':
+    case 't':
+    case 'm':
+      reply = std::string(1, '\x01');
+      break;
+    case 'L':
+      reply = "0";
+      break;
+    case 'P':
+      reply = std::string(static_cast<uint8_t>(command[7]), '\0');
+      break;
+    default:
+      break;
+  }
+  _port.inject(reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+  _port.inject("#");
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,29 @@
+#pragma once
+#include "Arduino.h"
+#include "model.h"
+#include <string>
+
+// NexStar hand control on its AUX/PC port: answers the serial protocol commands
+// after a processing latency, while plugged in.
+class HandControlModel : public Model {
+public:
+  struct Config {
+    uint32_t connect_ms;
+    uint32_t disconnect_ms; // 0: never
+    uint32_t latency_ms;
+  };
+  HandControlModel(HardwareSerial &port, Timeline &timeline, const Config &config);
+  void start();
+  inline uint64_t commands() const { return _commands; }
+
+private:
+  HardwareSerial &_port;
+  Config _config;
+  bool _connected = false;
+  std::string _command;
+  uint64_t _commands = 0;
+  void on_byte(uint8_t c);
+  void reply(const std::string &command);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
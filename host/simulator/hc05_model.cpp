@@ -0,0 +1,154 @@
+#include "hc05_model.h"
+
+#define HC05_AT_BAUD_RATE 38400
+#define HC05_BOOT_US 100000
+#define HC05_AT_REPLY_US 10000
+
+namespace {
+  const char *modeNames[] = {"off", "booting", "AT mode", "data mode"};
+
+  std::string quoted(const std::string &value) {
+    if(value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+      return value.substr(1, value.size() - 2);
+    }
+    return value;
+  }
+}
+
+HC05Model::HC05Model(HardwareSerial &port, Timeline &timeline, ClientModel &phone, const Config &config)
+  : Model("hc05", timeline), _port(port), _phone(phone), _config(config) {
+  _port.set_listener([this](uint8_t c, uint64_t time_us) {
+    schedule(time_us, [this, c]() { on_byte(c); });
+  });
+  _phone.set_sender([this](const uint8_t *data, size_t size) {
+    std::string bytes(reinterpret_cast<const char*>(data), size);
+    after(_config.latency_ms * 1000ULL, [this, bytes]() {
+      if(_mode == DataMode) {
+        _port.inject(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+      }
+    });
+  });
+}
+
+void HC05Model::start() {
+  if(_config.phone_connect_ms > 0) {
+    schedule(_config.phone_connect_ms * 1000ULL, [this]() {
+      _phone_in_range = true;
+      if(_mode == DataMode) {
+        _phone.connect();
+      }
+    });
+  }
+}
+
+void HC05Model::set_stored_settings(const std::string &name, const std::string &pin, uint32_t baud_rate) {
+  _device_name = name;
+  _device_pin = pin;
+  _baud_rate = baud_rate;
+}
+
+void HC05Model::on_pin(uint8_t pin, uint16_t value) {
+  if(pin == _config.at_mode_pin) {
+    _at_pin = value;
+    return;
+  }
+  if(pin != _config.power_pin) {
+    return;
+  }
+  if(value && _mode == Off) {
+    boot();
+  } else if(!value && _mode != Off) {
+    set_mode(Off);
+  }
+}
+
+void HC05Model::boot() {
+  set_mode(Booting);
+  uint32_t generation = _generation;
+  after(HC05_BOOT_US, [this, generation]() {
+    if(generation == _generation) {
+      set_mode(_at_pin ? ATMode : DataMode);
+    }
+  });
+}
+
+void HC05Model::set_mode(Mode mode) {
+  _mode = mode;
+  _generation++;
+  _line.clear();
+  _timeline.record(_name, "%s", modeNames[mode]);
+  if(mode == DataMode && _phone_in_range) {
+    _phone.connect();
+  } else if(mode != DataMode) {
+    _phone.disconnect();
+  }
+}
+
+void HC05Model::on_byte(uint8_t c) {
+  if(_mode != ATMode && _mode != DataMode) {
+    return;
+  }
+  if(_port.baud() != (_mode == ATMode ? HC05_AT_BAUD_RATE : _baud_rate)) {
+    _baud_mismatches++;
+    return;
+  }
+  if(_mode == DataMode) {
+    after(_config.latency_ms * 1000ULL, [this, c]() { _phone.on_byte(c); });
+    return;
+  }
+  if(c == '\n') {
+    if(!_line.empty() && _line.back() == '\r') {
+      _line.pop_back();
+    }
+    std::string command = _line;
+    _line.clear();
+    uint32_t generation = _generation;
+    after(HC05_AT_REPLY_US, [this, command, generation]() {
+      if(generation == _generation) {
+        at_command(command);
+      }
+    });
+    return;
+  }
+  _line.push_back(static_cast<char>(c));
+}
+
+void HC05Model::at_command(const std::string &command) {
+  _at_commands++;
+  if(command.compare(0, 8, "AT+NAME=") == 0 || command.compare(0, 8, "AT+PSWD=") == 0 || command.compare(0, 8, "AT+UART=") == 0) {
+    _settings_writes++;
+  }
+  if(command == "AT") {
+    reply("OK");
+  } else if(command == "AT+NAME?") {
+    reply("+NAME:" + _device_name + "\r\nOK");
+  } else if(command == "AT+PSWD?") {
+    reply("+PSWD:" + _device_pin + "\r\nOK");
+  } else if(command == "AT+UART?") {
+    reply("+UART:" + std::to_string(_baud_rate) + ",0,0\r\nOK");
+  } else if(command.compare(0, 8, "AT+NAME=") == 0) {
+    _device_name = quoted(command.substr(8));
+    _timeline.record(_name, "name set to %s", _device_name.c_str());
+    reply("OK");
+  } else if(command.compare(0, 8, "AT+PSWD=") == 0) {
+    _device_pin = quoted(command.substr(8));
+    reply("OK");
+  } else if(command.compare(0, 8, "AT+UART=") == 0) {
+    _baud_rate = strtoul(command.c_str() + 8, nullptr, 10);
+    _timeline.record(_name, "UART set to %u", _baud_rate);
+    reply("OK");
+  } else if(command == "AT+RESET") {
+    reply("OK");
+    // Restarts in the mode selected by the KEY pin
+    after(HC05_AT_REPLY_US, [this]() { boot(); });
+  } else {
+    reply("ERROR:(0)");
+  }
+}
+
+void HC05Model::reply(const std::string &text) {
+  std::string line = text + "\r\n";
+  _port.inject(line.c_str());
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
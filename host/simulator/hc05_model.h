@@ -0,0 +1,60 @@
+#pragma once
+#include "Arduino.h"
+#include "model.h"
+#include "client_model.h"
+#include <string>
+
+// HC-05 Bluetooth module: powered through a pin, boots in AT command mode (38400 baud)
+// when the KEY pin is high, otherwise in data mode, bridging the paired client.
+class HC05Model : public Model {
+public:
+  struct Config {
+    uint8_t power_pin;
+    uint8_t at_mode_pin;
+    uint32_t phone_connect_ms; // 0: never
+    uint32_t latency_ms; // Bluetooth link latency
+  };
+  HC05Model(HardwareSerial &port, Timeline &timeline, ClientModel &phone, const Config &config);
+  void start();
+  void on_pin(uint8_t pin, uint16_t value);
+  // Settings in the module flash, as left by an earlier configuration
+  void set_stored_settings(const std::string &name, const std::string &pin, uint32_t baud_rate);
+  inline uint64_t baud_mismatches() const { return _baud_mismatches; }
+  inline bool in_data_mode() const { return _mode == DataMode; }
+  inline const std::string &device_name() const { return _device_name; }
+  inline const std::string &device_pin() const { return _device_pin; }
+  inline uint32_t baud_rate() const { return _baud_rate; }
+  // AT commands received, and those changing the module settings
+  inline uint64_t at_commands() const { return _at_commands; }
+  inline uint64_t settings_writes() const { return _settings_writes; }
+
+private:
+  enum Mode {
+    Off,
+    Booting,
+    ATMode,
+    DataMode,
+  };
+  HardwareSerial &_port;
+  ClientModel &_phone;
+  Config _config;
+  Mode _mode = Off;
+  uint32_t _generation = 0;
+  bool _at_pin = false;
+  bool _phone_in_range = false;
+  // Settings in the module flash
+  std::string _device_name = "HC-05";
+  std::string _device_pin = "1234";
+  uint32_t _baud_rate = 9600;
+  std::string _line;
+  uint64_t _baud_mismatches = 0;
+  uint64_t _at_commands = 0;
+  uint64_t _settings_writes = 0;
+  void boot();
+  void set_mode(Mode mode);
+  void on_byte(uint8_t c);
+  void at_command(const std::string &command);
+  void reply(const std::string &text);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,26 @@
+#include "model.h"
+
+Model::Model(const char *name, Timeline &timeline) : _name(name), _timeline(timeline) {
+  host::Clock::instance().add_source(this);
+}
+
+Model::~Model() {
+  host::Clock::instance().remove_source(this);
+}
+
+uint64_t Model::next_event_us() const {
+  return _queue.empty() ? UINT64_MAX : _queue.top().time_us;
+}
+
+void Model::fire(uint64_t now_us) {
+  // Actions may schedule more actions: take this one out first
+  Action action = _queue.top().action;
+  _queue.pop();
+  action();
+}
+
+void Model::schedule(uint64_t time_us, Action action) {
+  _queue.push(Scheduled{time_us, _sequence++, action});
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,38 @@
+#pragma once
+#include "host.h"
+#include "timeline.h"
+#include <functional>
+#include <queue>
+#include <vector>
+
+// Simulated device: actions are scheduled on the virtual clock, which wakes up
+// the firmware (as an interrupt would) when they're due.
+class Model : public host::EventSource {
+public:
+  typedef std::function<void()> Action;
+  Model(const char *name, Timeline &timeline);
+  ~Model();
+  uint64_t next_event_us() const override;
+  void fire(uint64_t now_us) override;
+
+protected:
+  const char *_name;
+  Timeline &_timeline;
+  void schedule(uint64_t time_us, Action action);
+  inline void after(uint64_t delay_us, Action action) { schedule(now_us() + delay_us, action); }
+  inline uint64_t now_us() const { return host::Clock::instance().now_us(); }
+
+private:
+  struct Scheduled {
+    uint64_t time_us;
+    uint64_t sequence;
+    Action action;
+    bool operator>(const Scheduled &other) const {
+      return time_us != other.time_us ? time_us > other.time_us : sequence > other.sequence;
+    }
+  };
+  std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> _queue;
+  uint64_t _sequence = 0;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,302 @@
+// Discrete-event simulation of the whole device: the real setup()/loop() run against
+// models of the GPS receiver, hand control, HC-05 module and USB host, on a virtual
+// clock jumping from one event to the next.
+#include "Arduino.h"
+#include "sketch.h"
+#include "events.h"
+#include "gps.h"
+#include "nexstar.h"
+#include "scheduler.h"
+#include "power.h"
+#include "timeline.h"
+#include "gps_model.h"
+#include "hand_control_model.h"
+#include "hc05_model.h"
+#include "client_model.h"
+#include <chrono>
+#include <map>
+#include <string>
+
+// Same wiring as NexstarGPSLite.ino
+#define BT_POWER_PIN PB1
+#define BT_AT_MODE_PIN PB0
+
+extern EventBus events;
+extern GPS gps;
+extern Nexstar nexstar;
+extern Scheduler scheduler;
+extern PowerManager power;
+
+namespace {
+  const char *eventNames[] = {
+    "GPSTimeAcquired",
+    "GPSFixAcquired",
+    "GPSFixLost",
+    "GPSPositionStable",
+    "GPSNoData",
+    "GPSDataResumed",
+    "RTCSet",
+    "RTCDisciplined",
+    "NexstarStatusChanged",
+    "NexstarSyncStarted",
+    "NexstarSyncFailed",
+    "USBConnected",
+    "USBDisconnected",
+  };
+
+  struct Options {
+    double duration = 8 * 3600;
+    uint32_t start_utc = 1704139200; // 2024-01-01 20:00:00
+    uint32_t rtc_time = 0; // 0: RTC lost power
+    double lat = 45.4642;
+    double lng = 9.19;
+    double gps_noise = 2.5;
+    uint32_t gps_time_fix_ms = 25000;
+    uint32_t gps_position_fix_ms = 40000;
+    uint32_t hand_control_connect_ms = 3000;
+    uint32_t hand_control_disconnect_ms = 0;
+    uint32_t hand_control_latency_ms = 30;
+    uint32_t phone_connect_ms = 60000;
+    uint32_t bluetooth_latency_ms = 20;
+    uint32_t usb_connect_ms = 0;
+    uint32_t usb_disconnect_ms = 0;
+    uint32_t poll_ms = 1000;
+    uint32_t systick_us = 10000;
+    uint32_t stall_ms = 0;
+    uint32_t stall_every_ms = 1000;
+    uint32_t window_s = 60;
+    uint32_t seed = 1;
+    std::string timeline = "-";
+    std::string utilisation;
+    std::string capture;
+  };
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options]\n"
+      "  --duration S            simulated time, seconds (default: 28800)\n"
+      "  --start-utc T           UTC at start, unix time (default: 1704139200)\n"
+      "  --rtc-time T            RTC time at start, 0 if it lost power (default: 0)\n"
+      "  --lat D --lng D         receiver position (default: 45.4642 9.19)\n"
+      "  --gps-noise M           1-sigma position noise, meters (default: 2.5)\n"
+      "  --gps-time-fix MS       time to time fix (default: 25000)\n"
+      "  --gps-position-fix MS   time to position fix (default: 40000)\n"
+      "  --hc-connect MS         hand control plugged in (default: 3000)\n"
+      "  --hc-disconnect MS      hand control unplugged, 0: never (default: 0)\n"
+      "  --hc-latency MS         hand control reply latency (default: 30)\n"
+      "  --phone-connect MS      Bluetooth client in range, 0: never (default: 60000)\n"
+      "  --bt-latency MS         Bluetooth link latency, each way (default: 20)\n"
+      "  --usb-connect MS        USB client connects, 0: never (default: 0)\n"
+      "  --usb-disconnect MS     USB client disconnects, 0: never (default: 0)\n"
+      "  --poll MS               client position polling period (default: 1000)\n"
+      "  --systick US            idle wake up period, 1000 as the real SysTick, 0: only wake up on events (default: 10000)\n"
+      "  --stall MS              block the main loop for this long, 0: never (default: 0)\n"
+      "  --stall-every MS        period of the main loop stalls (default: 1000)\n"
+      "  --timeline FILE         state transitions CSV, - for stdout (default: -)\n"
+      "  --utilisation FILE      serial buses utilisation CSV\n"
+      "  --window S              utilisation window (default: 60)\n"
+#ifdef SERIAL_CAPTURE
+      "  --capture FILE          USB connected from boot, saving the serial capture to FILE\n"
+#endif
+      "  --seed N                random seed (default: 1)\n",
+      name);
+  }
+
+  bool parse(int argc, char **argv, Options &options) {
+    std::map<std::string, std::function<void(const char*)>> setters = {
+      {"--duration", [&](const char *v) { options.duration = atof(v); }},
+      {"--start-utc", [&](const char *v) { options.start_utc = strtoul(v, nullptr, 10); }},
+      {"--rtc-time", [&](const char *v) { options.rtc_time = strtoul(v, nullptr, 10); }},
+      {"--lat", [&](const char *v) { options.lat = atof(v); }},
+      {"--lng", [&](const char *v) { options.lng = atof(v); }},
+      {"--gps-noise", [&](const char *v) { options.gps_noise = atof(v); }},
+      {"--gps-time-fix", [&](const char *v) { options.gps_time_fix_ms = strtoul(v, nullptr, 10); }},
+      {"--gps-position-fix", [&](const char *v) { options.gps_position_fix_ms = strtoul(v, nullptr, 10); }},
+      {"--hc-connect", [&](const char *v) { options.hand_control_connect_ms = strtoul(v, nullptr, 10); }},
+      {"--hc-disconnect", [&](const char *v) { options.hand_control_disconnect_ms = strtoul(v, nullptr, 10); }},
+      {"--hc-latency", [&](const char *v) { options.hand_control_latency_ms = strtoul(v, nullptr, 10); }},
+      {"--phone-connect", [&](const char *v) { options.phone_connect_ms = strtoul(v, nullptr, 10); }},
+      {"--bt-latency", [&](const char *v) { options.bluetooth_latency_ms = strtoul(v, nullptr, 10); }},
+      {"--usb-connect", [&](const char *v) { options.usb_connect_ms = strtoul(v, nullptr, 10); }},
+      {"--usb-disconnect", [&](const char *v) { options.usb_disconnect_ms = strtoul(v, nullptr, 10); }},
+      {"--poll", [&](const char *v) { options.poll_ms = strtoul(v, nullptr, 10); }},
+      {"--systick", [&](const char *v) { options.systick_us = strtoul(v, nullptr, 10); }},
+      {"--stall", [&](const char *v) { options.stall_ms = strtoul(v, nullptr, 10); }},
+      {"--stall-every", [&](const char *v) { options.stall_every_ms = strtoul(v, nullptr, 10); }},
+      {"--timeline", [&](const char *v) { options.timeline = v; }},
+      {"--utilisation", [&](const char *v) { options.utilisation = v; }},
+#ifdef SERIAL_CAPTURE
+      {"--capture", [&](const char *v) { options.capture = v; }},
+#endif
+      {"--window", [&](const char *v) { options.window_s = strtoul(v, nullptr, 10); }},
+      {"--seed", [&](const char *v) { options.seed = strtoul(v, nullptr, 10); }},
+    };
+    for(int i = 1; i < argc; i++) {
+      auto setter = setters.find(argv[i]);
+      if(setter == setters.end() || i + 1 >= argc) {
+        return false;
+      }
+      setter->second(argv[++i]);
+    }
+    return options.window_s > 0 && options.stall_every_ms > 0 && (options.capture.empty() || options.usb_connect_ms == 0);
+  }
+
+  FILE *open_output(const std::string &path) {
+    if(path == "-") {
+      return stdout;
+    }
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file) {
+      perror(path.c_str());
+      exit(1);
+    }
+    return file;
+  }
+
+  // Serial bus utilisation over fixed windows
+  class UtilisationRecorder {
+  public:
+    UtilisationRecorder(FILE *output, uint32_t window_s) : _output(output), _window_us(window_s * 1000000ULL), _next_us(_window_us) {
+      if(_output) {
+        fprintf(_output, "time,port,baud,tx_bytes,rx_bytes,tx_utilisation,rx_utilisation\n");
+      }
+    }
+    void add(HardwareSerial &port) {
+      _ports.push_back(Port{&port, 0, 0});
+    }
+    void update() {
+      while(host::Clock::instance().now_us() >= _next_us) {
+        sample();
+        _next_us += _window_us;
+      }
+    }
+  private:
+    struct Port {
+      HardwareSerial *port;
+      uint64_t sent;
+      uint64_t received;
+    };
+    FILE *_output;
+    uint64_t _window_us;
+    uint64_t _next_us;
+    std::vector<Port> _ports;
+    void sample() {
+      for(Port &port : _ports) {
+        uint64_t sent = port.port->bytes_sent() - port.sent;
+        uint64_t received = port.port->bytes_received() - port.received;
+        port.sent = port.port->bytes_sent();
+        port.received = port.port->bytes_received();
+        if(!_output) {
+          continue;
+        }
+        // 10 bits per byte (8N1)
+        double capacity = port.port->baud() / 10.0 * _window_us / 1000000.0;
+        fprintf(_output, "%.0f,%s,%u,%llu,%llu,%.4f,%.4f\n", _next_us / 1000000.0, port.port->name(), port.port->baud(),
+          static_cast<unsigned long long>(sent), static_cast<unsigned long long>(received),
+          capacity > 0 ? sent / capacity : 0, capacity > 0 ? received / capacity : 0);
+      }
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if(!parse(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+  host::set_systick_period_us(options.systick_us);
+  if(options.rtc_time > 0) {
+    host::set_rtc_time(options.rtc_time);
+  }
+  Timeline timeline(open_output(options.timeline));
+  UtilisationRecorder utilisation(options.utilisation.empty() ? nullptr : open_output(options.utilisation), options.window_s);
+  utilisation.add(Serial1);
+  utilisation.add(Serial2);
+  utilisation.add(Serial3);
+
+  GPSModel gps_model(Serial2, timeline, GPSModel::Config{
+    options.start_utc, options.lat, options.lng, options.gps_noise, 1000, options.gps_time_fix_ms, options.gps_position_fix_ms, options.seed,
+  });
+  HandControlModel hand_control(Serial1, timeline, HandControlModel::Config{
+    options.hand_control_connect_ms, options.hand_control_disconnect_ms, options.hand_control_latency_ms,
+  });
+  ClientModel phone("phone", timeline, options.poll_ms);
+  HC05Model hc05(Serial3, timeline, phone, HC05Model::Config{BT_POWER_PIN, BT_AT_MODE_PIN, options.phone_connect_ms, options.bluetooth_latency_ms});
+  host::set_pin_listener([&](uint8_t pin, uint16_t value) { hc05.on_pin(pin, value); });
+
+  ClientModel usb("usb", timeline, options.poll_ms);
+  usb.set_sender([](const uint8_t *data, size_t size) { Serial.inject(data, size); });
+  Serial.set_listener([&](uint8_t c, uint64_t) { usb.on_byte(c); });
+  if(!options.capture.empty()) {
+    // The firmware never uses USB for clients while capturing
+    FILE *capture = open_output(options.capture);
+    Serial.set_listener([capture](uint8_t c, uint64_t) { fputc(c, capture); });
+    Serial.set_connected(true);
+  }
+  Timeline *firmware_timeline = &timeline;
+  struct USBHost : public Model {
+    USBHost(Timeline &timeline, ClientModel &client, const Options &options) : Model("usb_host", timeline) {
+      if(options.usb_connect_ms > 0) {
+        schedule(options.usb_connect_ms * 1000ULL, [&client]() { Serial.set_connected(true); client.connect(); });
+      }
+      if(options.usb_disconnect_ms > 0) {
+        schedule(options.usb_disconnect_ms * 1000ULL, [&client]() { Serial.set_connected(false); client.disconnect(); });
+      }
+    }
+  } usb_host(timeline, usb, options);
+
+  events.subscribe(0xFFFF, [](void *context, EventBus::Event event, int value) {
+    reinterpret_cast<Timeline*>(context)->record("firmware", "%s %d", eventNames[event], value);
+  }, firmware_timeline);
+
+  gps_model.start();
+  hand_control.start();
+  hc05.start();
+
+  auto started = std::chrono::steady_clock::now();
+  uint64_t end_us = static_cast<uint64_t>(options.duration * 1000000);
+  uint64_t iterations = 0;
+  uint64_t next_stall_us = options.stall_every_ms * 1000ULL;
+  setup();
+  while(host::Clock::instance().now_us() < end_us) {
+    loop();
+    iterations++;
+    if(options.stall_ms > 0 && host::Clock::instance().now_us() >= next_stall_us) {
+      // A slow task hogging the loop: the ports and timers keep running meanwhile
+      delay(options.stall_ms);
+      next_stall_us += options.stall_every_ms * 1000ULL;
+    }
+    utilisation.update();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  const Nexstar::Stats &stats = nexstar.stats();
+  fprintf(stderr, "Simulated %.0f s in %.2f s (%.0fx), %llu loop iterations (%.0f/s simulated, %.0f/s host), %.1f%% asleep\n",
+    options.duration, elapsed, options.duration / elapsed, static_cast<unsigned long long>(iterations),
+    iterations / options.duration, iterations / elapsed, power.sleep_fraction() * 100);
+  fprintf(stderr, "GPS: %llu epochs sent, %u sentences with fix, %u checksum failures, %llu overruns\n",
+    static_cast<unsigned long long>(gps_model.epochs()), gps.counters().sentencesWithFix, gps.counters().failedChecksum,
+    static_cast<unsigned long long>(Serial2.overruns()));
+  fprintf(stderr, "GPS: first data %u ms after boot, date/time fix %u ms after start (0: none)\n", gps.firstDataTime(), gps.timeToTimeFix());
+  // Sentences still queued or in transit at the end also count as lost
+  fprintf(stderr, "GPS: %llu sentences sent, %u parsed, %lld lost\n",
+    static_cast<unsigned long long>(gps_model.sentences()), gps.counters().passedChecksum,
+    static_cast<long long>(gps_model.sentences()) - gps.counters().passedChecksum);
+  fprintf(stderr, "Hand control: %llu commands, firmware: %u commands, %u timeouts, rtt %u/%u/%u ms (min/mean/max)\n",
+    static_cast<unsigned long long>(hand_control.commands()), stats.commands, stats.timeouts,
+    stats.replies > 0 ? stats.rtt_min : 0, stats.rtt_mean(), stats.rtt_max);
+  ClientModel *clients[] = {&phone, &usb};
+  for(ClientModel *client : clients) {
+    fprintf(stderr, "Client %s: %llu requests, %llu replies, %llu timeouts, rtt %.1f/%.1f ms (mean/max)\n",
+      client == &phone ? "phone" : "usb",
+      static_cast<unsigned long long>(client->requests()), static_cast<unsigned long long>(client->replies()),
+      static_cast<unsigned long long>(client->timeouts()), client->rtt_mean_us() / 1000.0, client->rtt_max_us() / 1000.0);
+  }
+  if(hc05.baud_mismatches() > 0) {
+    fprintf(stderr, "HC-05: %llu bytes sent at the wrong baud rate\n", static_cast<unsigned long long>(hc05.baud_mismatches()));
+  }
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
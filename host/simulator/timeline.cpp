@@ -0,0 +1,19 @@
+#include "timeline.h"
+#include "host.h"
+#include <stdarg.h>
+
+Timeline::Timeline(FILE *output) : _output(output) {
+  fprintf(_output, "time,source,event\n");
+}
+
+void Timeline::record(const char *source, const char *format, ...) {
+  fprintf(_output, "%.6f,%s,", host::Clock::instance().now_us() / 1000000.0, source);
+  va_list args;
+  va_start(args, format);
+  vfprintf(_output, format, args);
+  va_end(args);
+  fputc('\n', _output);
+  _records++;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// CSV log of state transitions: time (s), source, event
+class Timeline {
+public:
+  explicit Timeline(FILE *output);
+  void record(const char *source, const char *format, ...) __attribute__((format(printf, 3, 4)));
+  inline uint64_t records() const { return _records; }
+private:
+  FILE *_output;
+  uint64_t _records = 0;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,5 @@
+// The sketch, built unmodified: Arduino.h comes first, as the Arduino builder does
+#include "Arduino.h"
+#include "NexstarGPSLite.ino"
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,7 @@
+#pragma once
+
+// Entry points of NexstarGPSLite.ino
+void setup();
+void loop();
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,188 @@
+// Long simulated session counting the heap allocations made by the firmware: the
+// firmware is expected not to allocate at all after setup(). The simulator models
+// drive it, with the USB client plugged and unplugged every hour to also exercise
+// the client port switches. Exits with 1 if the firmware allocated after setup().
+//
+// malloc(), calloc() and realloc() are replaced to count calls (operator new goes
+// through them); host::OwnerScope tells the firmware allocations apart from the
+// host ones (models, shim buffers).
+#include "Arduino.h"
+#include "sketch.h"
+#include "gps_model.h"
+#include "hand_control_model.h"
+#include "hc05_model.h"
+#include "client_model.h"
+#include <execinfo.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+// Same wiring as NexstarGPSLite.ino
+#define BT_POWER_PIN PB1
+#define BT_AT_MODE_PIN PB0
+// Frames printed for the first allocation after setup()
+#define SOAK_BACKTRACE_SIZE 32
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *pointer, size_t size);
+}
+
+namespace {
+  struct Counters {
+    uint64_t allocations;
+    uint64_t bytes;
+  };
+  bool setupDone = false;
+  Counters setupAllocations = {0, 0};
+  Counters loopAllocations = {0, 0};
+  bool tracing = false;
+
+  void count(size_t size) {
+    if(tracing || host::OwnerScope::current() != host::OwnerScope::Firmware) {
+      return;
+    }
+    Counters &counters = setupDone ? loopAllocations : setupAllocations;
+    counters.allocations++;
+    counters.bytes += size;
+    if(setupDone && counters.allocations == 1) {
+      // backtrace() may allocate itself the first time
+      tracing = true;
+      void *frames[SOAK_BACKTRACE_SIZE];
+      int size = backtrace(frames, SOAK_BACKTRACE_SIZE);
+      fprintf(stderr, "First allocation after setup(), at %.3f s:\n", host::Clock::instance().now_us() / 1000000.0);
+      backtrace_symbols_fd(frames, size, STDERR_FILENO);
+      tracing = false;
+    }
+  }
+
+  struct Options {
+    double hours = 24;
+    uint32_t seed = 1;
+    std::string timeline = "/dev/null";
+  };
+
+  void usage(const char *name) {
+    fprintf(stderr,
+      "Usage: %s [options]\n"
+      "  --hours H               simulated time, hours (default: 24)\n"
+      "  --timeline FILE         state transitions CSV (default: none)\n"
+      "  --seed N                random seed (default: 1)\n",
+      name);
+  }
+
+  bool parse(int argc, char **argv, Options &options) {
+    std::map<std::string, std::function<void(const char*)>> setters = {
+      {"--hours", [&](const char *v) { options.hours = atof(v); }},
+      {"--timeline", [&](const char *v) { options.timeline = v; }},
+      {"--seed", [&](const char *v) { options.seed = strtoul(v, nullptr, 10); }},
+    };
+    for(int i = 1; i < argc; i++) {
+      auto setter = setters.find(argv[i]);
+      if(setter == setters.end() || i + 1 >= argc) {
+        return false;
+      }
+      setter->second(argv[++i]);
+    }
+    return options.hours > 0;
+  }
+
+  // Plugs in the USB client for the second half of every hour
+  class USBHost : public Model {
+  public:
+    USBHost(Timeline &timeline, ClientModel &client) : Model("usb_host", timeline), _client(client) {}
+    void start() {
+      schedule(1800 * 1000000ULL, [this]() { toggle(true); });
+    }
+  private:
+    ClientModel &_client;
+    void toggle(bool connected) {
+      Serial.set_connected(connected);
+      if(connected) {
+        _client.connect();
+      } else {
+        _client.disconnect();
+      }
+      after(1800 * 1000000ULL, [this, connected]() { toggle(!connected); });
+    }
+  };
+}
+
+extern "C" {
+  void *malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t count_, size_t size) {
+    count(count_ * size);
+    return __libc_calloc(count_, size);
+  }
+
+  void *realloc(void *pointer, size_t size) {
+    count(size);
+    return __libc_realloc(pointer, size);
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if(!parse(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+  FILE *timeline_file = fopen(options.timeline.c_str(), "w");
+  if(!timeline_file) {
+    perror(options.timeline.c_str());
+    return 1;
+  }
+  Timeline timeline(timeline_file);
+  // As the simulator default: wake up from idle every 10 ms
+  host::set_systick_period_us(10000);
+
+  GPSModel gps_model(Serial2, timeline, GPSModel::Config{1704139200, 45.4642, 9.19, 2.5, 1000, 25000, 40000, options.seed});
+  HandControlModel hand_control(Serial1, timeline, HandControlModel::Config{3000, 0, 30});
+  ClientModel phone("phone", timeline, 1000);
+  HC05Model hc05(Serial3, timeline, phone, HC05Model::Config{BT_POWER_PIN, BT_AT_MODE_PIN, 60000, 20});
+  host::set_pin_listener([&](uint8_t pin, uint16_t value) { hc05.on_pin(pin, value); });
+  ClientModel usb("usb", timeline, 1000);
+  usb.set_sender([](const uint8_t *data, size_t size) { Serial.inject(data, size); });
+  Serial.set_listener([&](uint8_t c, uint64_t) { usb.on_byte(c); });
+  USBHost usb_host(timeline, usb);
+
+  gps_model.start();
+  hand_control.start();
+  hc05.start();
+  usb_host.start();
+
+  uint64_t end_us = static_cast<uint64_t>(options.hours * 3600 * 1000000);
+  {
+    host::OwnerScope scope(host::OwnerScope::Firmware);
+    setup();
+  }
+  setupDone = true;
+  uint64_t next_report_us = 3600 * 1000000ULL;
+  while(host::Clock::instance().now_us() < end_us) {
+    {
+      host::OwnerScope scope(host::OwnerScope::Firmware);
+      loop();
+    }
+    if(host::Clock::instance().now_us() >= next_report_us) {
+      fprintf(stderr, "%3.0f h: %llu allocations (%llu bytes)\n", next_report_us / 3600000000.0,
+        static_cast<unsigned long long>(loopAllocations.allocations), static_cast<unsigned long long>(loopAllocations.bytes));
+      next_report_us += 3600 * 1000000ULL;
+    }
+  }
+
+  fprintf(stderr, "setup(): %llu allocations (%llu bytes)\n",
+    static_cast<unsigned long long>(setupAllocations.allocations), static_cast<unsigned long long>(setupAllocations.bytes));
+  fprintf(stderr, "After setup(): %llu allocations (%llu bytes)\n",
+    static_cast<unsigned long long>(loopAllocations.allocations), static_cast<unsigned long long>(loopAllocations.bytes));
+  fprintf(stderr, "Client requests: %llu phone, %llu usb; GPS epochs: %llu, hand control commands: %llu\n",
+    static_cast<unsigned long long>(phone.requests()), static_cast<unsigned long long>(usb.requests()),
+    static_cast<unsigned long long>(gps_model.epochs()), static_cast<unsigned long long>(hand_control.commands()));
+  return loopAllocations.allocations > 0 ? 1 : 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
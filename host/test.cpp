@@ -0,0 +1,24 @@
+#include "test.h"
+#include <stdio.h>
+
+namespace {
+  int failures = 0;
+}
+
+void check(bool condition, const char *test, const char *description) {
+  if(!condition) {
+    fprintf(stderr, "%s: %s\n", test, description);
+    failures++;
+  }
+}
+
+int checks_result(const char *what) {
+  if(failures > 0) {
+    fprintf(stderr, "%d %s checks failed\n", failures, what);
+    return 1;
+  }
+  fprintf(stderr, "All %s checks passed\n", what);
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
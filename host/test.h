@@ -0,0 +1,9 @@
+#pragma once
+
+// Checks of the host test programs: a failed check is printed and counted, and the
+// program keeps going to report all of them.
+void check(bool condition, const char *test, const char *description);
+// Exit code of the test program, after printing how many of the `what` checks failed
+int checks_result(const char *what);
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,178 @@
+// TinyGPSCustomFields (declared at compile time) against the TinyGPSCustom list
+// (registered at runtime): two parsers with the same fields are fed the same NMEA
+// stream, valid sentences first, then random mutations of them, and after every
+// character each field must have the same validity, update flag and value.
+// Exits with 1 on the first difference.
+#include "Arduino.h"
+#include "TinyGPS++.h"
+#include <random>
+#include <string>
+#include <vector>
+
+#define MUTATED_INPUTS 5000
+
+namespace {
+  // Same sentence and term twice, terms around the checksum, past the end of the
+  // sentence, and a talker ID that must not match the GP one
+  const struct {
+    const char *sentence;
+    int term;
+  } fields[] = {
+    {"GPRMC", 1}, {"GPRMC", 2}, {"GPRMC", 9}, {"GPRMC", 12},
+    {"GPGGA", 7}, {"GPGGA", 7}, {"GPGGA", 14}, {"GPGGA", 20},
+    {"GNGSA", 2}, {"GNGSA", 17}, {"GPGSV", 3}, {"GPGSV", 19},
+    {"GPZDA", 4}, {"GPTXT", 4}, {"GNRMC", 1}, {"GPXXX", 1},
+  };
+  TINYGPS_CUSTOM_FIELD(F0, "GPRMC", 1);
+  TINYGPS_CUSTOM_FIELD(F1, "GPRMC", 2);
+  TINYGPS_CUSTOM_FIELD(F2, "GPRMC", 9);
+  TINYGPS_CUSTOM_FIELD(F3, "GPRMC", 12);
+  TINYGPS_CUSTOM_FIELD(F4, "GPGGA", 7);
+  TINYGPS_CUSTOM_FIELD(F5, "GPGGA", 7);
+  TINYGPS_CUSTOM_FIELD(F6, "GPGGA", 14);
+  TINYGPS_CUSTOM_FIELD(F7, "GPGGA", 20);
+  TINYGPS_CUSTOM_FIELD(F8, "GNGSA", 2);
+  TINYGPS_CUSTOM_FIELD(F9, "GNGSA", 17);
+  TINYGPS_CUSTOM_FIELD(F10, "GPGSV", 3);
+  TINYGPS_CUSTOM_FIELD(F11, "GPGSV", 19);
+  TINYGPS_CUSTOM_FIELD(F12, "GPZDA", 4);
+  TINYGPS_CUSTOM_FIELD(F13, "GPTXT", 4);
+  TINYGPS_CUSTOM_FIELD(F14, "GNRMC", 1);
+  TINYGPS_CUSTOM_FIELD(F15, "GPXXX", 1);
+  typedef TinyGPSCustomFields<F0, F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12, F13, F14, F15> CompiledFields;
+  const size_t fieldsCount = sizeof(fields) / sizeof(fields[0]);
+
+  const char *const sentences[] = {
+    "$GPRMC,123519.00,A,4807.03812,N,01131.00012,E,0.022,,230394,,,A*70\r\n",
+    "$GPGGA,123519.00,4807.03812,N,01131.00012,E,1,08,0.91,545.4,M,46.9,M,,*58\r\n",
+    "$GNGSA,A,3,21,05,29,25,12,10,26,02,,,,,1.72,1.03,1.38*1E\r\n",
+    "$GPGSV,3,1,11,02,48,298,24,05,25,061,41,10,12,275,,12,32,079,42*78\r\n",
+    "$GPZDA,123519.00,23,03,1994,00,00*6C\r\n",
+    "$GPTXT,01,01,02,u-blox AG - www.u-blox.com*50\r\n",
+    "$GNRMC,123520.00,A,4807.03812,N,01131.00012,E,0.022,,230394,,,A*64\r\n",
+    // Bad checksum: nothing is committed
+    "$GPRMC,123521.00,A,4807.03812,N,01131.00012,E,0.022,,230394,,,A*00\r\n",
+    // Empty terms, and one longer than the field buffers
+    "$GPRMC,,V,,,,,,,,,,N*53\r\n",
+    "$GPTXT,01,01,02,this term is longer than the field size*6F\r\n",
+  };
+
+  // The values read through each interface, at one point of the stream
+  struct Field {
+    bool valid;
+    bool updated;
+    std::string value;
+    bool operator!=(const Field &other) const { return valid != other.valid || updated != other.updated || value != other.value; }
+  };
+
+  Field read_field(TinyGPSCustom &field) {
+    return Field{field.isValid(), field.isUpdated(), field.value()};
+  }
+
+  template<typename... Fields> std::vector<Field> read(TinyGPSCustomFields<Fields...> &compiled) {
+    return {read_field(compiled.template get<Fields>())...};
+  }
+
+  std::vector<Field> read(std::vector<TinyGPSCustom> &runtime) {
+    std::vector<Field> result;
+    for(TinyGPSCustom &field : runtime) {
+      result.push_back(read_field(field));
+    }
+    return result;
+  }
+
+  class Parsers {
+  public:
+    Parsers() : _compiled(_compiled_gps), _runtime(fieldsCount) {
+      for(size_t i = 0; i < fieldsCount; i++) {
+        _runtime[i].begin(_runtime_gps, fields[i].sentence, fields[i].term);
+      }
+    }
+    // False, after printing the first difference, if the fields differ after any character
+    bool encode(const std::string &input, const char *what) {
+      for(size_t offset = 0; offset < input.size(); offset++) {
+        _compiled_gps.encode(input[offset]);
+        _runtime_gps.encode(input[offset]);
+        std::vector<Field> compiled = read(_compiled);
+        std::vector<Field> runtime = read(_runtime);
+        for(size_t i = 0; i < fieldsCount; i++) {
+          if(compiled[i] != runtime[i]) {
+            fprintf(stderr, "%s, offset %zu: field %s,%d: compiled %s%s\"%s\", runtime %s%s\"%s\"\n", what, offset, fields[i].sentence, fields[i].term,
+              compiled[i].valid ? "valid " : "", compiled[i].updated ? "updated " : "", compiled[i].value.c_str(),
+              runtime[i].valid ? "valid " : "", runtime[i].updated ? "updated " : "", runtime[i].value.c_str());
+            return false;
+          }
+          if(compiled[i].updated) {
+            _updates++;
+          }
+        }
+      }
+      return true;
+    }
+    inline uint64_t updates() const { return _updates; }
+  private:
+    TinyGPSPlus _compiled_gps;
+    TinyGPSPlus _runtime_gps;
+    CompiledFields _compiled;
+    std::vector<TinyGPSCustom> _runtime;
+    uint64_t _updates = 0;
+  };
+
+  // Random byte changes, insertions and deletions, and splices of other sentences
+  void mutate(std::string &input, std::mt19937 &generator) {
+    auto pick = [&](size_t n) { return static_cast<size_t>(generator() % n); };
+    const char special[] = "$,*\r\n0123456789ABCDEFGNPRSTVZ";
+    int mutations = 1 + pick(4);
+    for(int i = 0; i < mutations; i++) {
+      size_t position = pick(input.size() + 1);
+      switch(pick(4)) {
+      case 0:
+        if(position < input.size()) {
+          input[position] = static_cast<char>(generator());
+        }
+        break;
+      case 1:
+        input.insert(position, 1, special[pick(sizeof(special) - 1)]);
+        break;
+      case 2:
+        input.erase(position, pick(8) + 1);
+        break;
+      default: {
+        std::string other = sentences[pick(sizeof(sentences) / sizeof(sentences[0]))];
+        size_t start = pick(other.size());
+        input.insert(position, other.substr(start, pick(other.size() - start) + 1));
+        break;
+      }
+      }
+    }
+  }
+}
+
+int main() {
+  Parsers parsers;
+  for(const char *sentence : sentences) {
+    if(!parsers.encode(sentence, sentence)) {
+      return 1;
+    }
+  }
+  uint64_t valid_updates = parsers.updates();
+  if(valid_updates == 0) {
+    fprintf(stderr, "No field was updated by the valid sentences\n");
+    return 1;
+  }
+  std::mt19937 generator(1);
+  for(uint32_t i = 0; i < MUTATED_INPUTS; i++) {
+    std::string input = sentences[generator() % (sizeof(sentences) / sizeof(sentences[0]))];
+    mutate(input, generator);
+    char what[32];
+    snprintf(what, sizeof(what), "mutated input %u", i);
+    if(!parsers.encode(input, what)) {
+      return 1;
+    }
+  }
+  fprintf(stderr, "Compiled and runtime custom fields match: %llu updates from the valid sentences, %llu from %u mutated ones\n",
+    static_cast<unsigned long long>(valid_updates), static_cast<unsigned long long>(parsers.updates() - valid_updates), MUTATED_INPUTS);
+  return 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,47 @@
+#include "leds.h"
+
+// analogWrite range (0-255) to pwmWrite range (0-65535)
+#define LEDS_DUTY (LEDS_PWM * 257)
+
+Leds *_leds_instance = nullptr;
+
+Leds::Leds(HardwareTimer &timer, uint8_t gps_pin, uint8_t nexstar_pin) : _timer(timer), _gps_pin(gps_pin), _nexstar_pin(nexstar_pin) {
+  _leds_instance = this;
+}
+
+void Leds::setup() {
+  pinMode(_gps_pin, OUTPUT);
+  pinMode(_nexstar_pin, OUTPUT);
+  digitalWrite(_nexstar_pin, 1);
+  digitalWrite(_gps_pin, 1);
+  delay(500);
+  digitalWrite(_nexstar_pin, 0);
+  digitalWrite(_gps_pin, 0);
+  pinMode(_gps_pin, PWM);
+  pinMode(_nexstar_pin, PWM);
+
+  _timer.pause();
+  _timer.setPeriod(LEDS_INTERVAL * 1000UL);
+  _timer.setChannel1Mode(TIMER_OUTPUT_COMPARE);
+  _timer.setCompare(TIMER_CH1, 1);
+  _timer.attachCompare1Interrupt(on_timer);
+  _timer.refresh();
+  _timer.resume();
+}
+
+void Leds::on_timer() {
+  if(_leds_instance) {
+    _leds_instance->step();
+  }
+}
+
+void Leds::step() {
+  uint16_t step_mask = 1 << _step;
+  pwmWrite(_gps_pin, (_gps_pattern & step_mask) ? LEDS_DUTY : 0);
+  pwmWrite(_nexstar_pin, (_nexstar_pattern & step_mask) ? LEDS_DUTY : 0);
+  if(++_step >= LEDS_PATTERN_SIZE) {
+    _step = 0;
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
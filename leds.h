@@ -0,0 +1,38 @@
+#pragma once
+#include "Arduino.h"
+
+#define LEDS_INTERVAL 200
+#define LEDS_PATTERN_SIZE 12
+#define LEDS_PWM 5
+
+// Blink patterns: one bit per LEDS_INTERVAL step, least significant bit first
+namespace LedPattern {
+  constexpr uint16_t Off = 0x000;
+  constexpr uint16_t OneBlink = 0x001;
+  constexpr uint16_t TwoBlinks = 0x005;
+  constexpr uint16_t ThreeBlinks = 0x015;
+  constexpr uint16_t FastBlink = 0x555;
+  constexpr uint16_t Error = 0x03F;
+}
+
+// Drives both status leds from a hardware timer interrupt, so that blinking
+// doesn't depend on loop() timing.
+class Leds {
+public:
+  Leds(HardwareTimer &timer, uint8_t gps_pin, uint8_t nexstar_pin);
+  void setup();
+  inline void set_gps(uint16_t pattern) { _gps_pattern = pattern; }
+  inline void set_nexstar(uint16_t pattern) { _nexstar_pattern = pattern; }
+
+private:
+  HardwareTimer &_timer;
+  uint8_t _gps_pin;
+  uint8_t _nexstar_pin;
+  volatile uint16_t _gps_pattern = LedPattern::Off;
+  volatile uint16_t _nexstar_pattern = LedPattern::Off;
+  uint8_t _step = 0;
+  static void on_timer();
+  void step();
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
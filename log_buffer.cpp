@@ -0,0 +1,105 @@
+#include "log_buffer.h"
+#include <string.h>
+
+// sync, level, payload size, token, timestamp
+#define LOG_HEADER_SIZE 11
+#define LOG_RECORD_SIZE(payload_size) (LOG_HEADER_SIZE + (payload_size) + 1)
+
+LogBuffer logBuffer;
+
+namespace {
+  // Keeps the compiler from moving buffer accesses across index updates
+  inline void barrier() {
+    asm volatile("" ::: "memory");
+  }
+}
+
+bool LogBuffer::Record::reserve(uint8_t tag, uint8_t size) {
+  if(_size + 1 + size > LOG_MAX_PAYLOAD) {
+    return false;
+  }
+  _payload[_size++] = tag;
+  return true;
+}
+
+void LogBuffer::Record::add_number(uint8_t tag, uint32_t value) {
+  if(!reserve(tag, sizeof(value))) {
+    return;
+  }
+  for(uint8_t i = 0; i < sizeof(value); i++) {
+    _payload[_size++] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+void LogBuffer::Record::add(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  add_number('f', bits);
+}
+
+void LogBuffer::Record::add(const char *value) {
+  size_t length = value ? strnlen(value, LOG_MAX_STRING) : 0;
+  if(_size + 2 + length > LOG_MAX_PAYLOAD) {
+    length = _size + 2 < LOG_MAX_PAYLOAD ? LOG_MAX_PAYLOAD - _size - 2 : 0;
+  }
+  if(!reserve('s', 1 + length)) {
+    return;
+  }
+  _payload[_size++] = length;
+  memcpy(_payload + _size, value, length);
+  _size += length;
+}
+
+void LogBuffer::write(uint8_t level, const char *format, const Record &record) {
+  if(level > _level) {
+    return;
+  }
+  uint32_t size = LOG_RECORD_SIZE(record._size);
+  uint32_t head = _head;
+  if(LOG_BUFFER_SIZE - (head - _tail) < size) {
+    _dropped++;
+    return;
+  }
+  uint32_t token = reinterpret_cast<uintptr_t>(format);
+  uint32_t timestamp = millis();
+  uint8_t header[LOG_HEADER_SIZE] = {
+    LOG_RECORD_SYNC, level, record._size,
+    static_cast<uint8_t>(token), static_cast<uint8_t>(token >> 8), static_cast<uint8_t>(token >> 16), static_cast<uint8_t>(token >> 24),
+    static_cast<uint8_t>(timestamp), static_cast<uint8_t>(timestamp >> 8), static_cast<uint8_t>(timestamp >> 16), static_cast<uint8_t>(timestamp >> 24),
+  };
+  uint8_t checksum = 0;
+  for(uint8_t i = 0; i < LOG_HEADER_SIZE; i++) {
+    _buffer[head++ & (LOG_BUFFER_SIZE - 1)] = header[i];
+    checksum += i > 0 ? header[i] : 0;
+  }
+  for(uint8_t i = 0; i < record._size; i++) {
+    _buffer[head++ & (LOG_BUFFER_SIZE - 1)] = record._payload[i];
+    checksum += record._payload[i];
+  }
+  _buffer[head++ & (LOG_BUFFER_SIZE - 1)] = checksum;
+  barrier();
+  _head = head;
+}
+
+size_t LogBuffer::drain(Print &port, size_t max_bytes) {
+  size_t written = 0;
+  uint32_t tail = _tail;
+  uint32_t head = _head;
+  barrier();
+  while(tail != head) {
+    uint32_t size = LOG_RECORD_SIZE(at(tail + 2));
+    if(written + size > max_bytes) {
+      break;
+    }
+    for(uint32_t i = 0; i < size; i++) {
+      port.write(at(tail + i));
+    }
+    tail += size;
+    written += size;
+  }
+  barrier();
+  _tail = tail;
+  return written;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
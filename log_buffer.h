@@ -0,0 +1,83 @@
+#pragma once
+#include "Arduino.h"
+
+// Must be a power of two
+#define LOG_BUFFER_SIZE 1024
+#define LOG_MAX_PAYLOAD 64
+// Longer string arguments are truncated
+#define LOG_MAX_STRING 32
+#define LOG_RECORD_SYNC 0xA5
+
+// Tokenized log records, buffered in RAM and written out later when idle.
+// Instead of formatting text, call sites store the address of their format string
+// (the token), a timestamp and the raw arguments; tools/log_decoder.py turns
+// them back into text using the format strings table extracted from the firmware ELF.
+//
+// Record layout (little endian):
+//   sync (0xA5), level, payload size, token (4 bytes), millis (4 bytes), payload, checksum
+// Each payload argument is a type tag ('i', 'u', 'f', 's') followed by its value:
+// 4 bytes for numbers, a length byte and the characters for strings.
+// The checksum is the 8 bit sum of every byte after sync.
+//
+// The ring buffer is lock-free for a single producer (the main loop) and a single
+// consumer (drain): don't log from interrupt handlers.
+class LogBuffer {
+public:
+  class Record {
+  public:
+    void add(bool value) { add_number('u', value ? 1 : 0); }
+    void add(char value) { add_number('i', value); }
+    void add(signed char value) { add_number('i', value); }
+    void add(unsigned char value) { add_number('u', value); }
+    void add(short value) { add_number('i', value); }
+    void add(unsigned short value) { add_number('u', value); }
+    void add(int value) { add_number('i', value); }
+    void add(unsigned int value) { add_number('u', value); }
+    void add(long value) { add_number('i', value); }
+    void add(unsigned long value) { add_number('u', value); }
+    void add(float value);
+    void add(double value) { add(static_cast<float>(value)); }
+    void add(const char *value);
+    void add(const __FlashStringHelper *value) { add(reinterpret_cast<const char*>(value)); }
+
+  private:
+    uint8_t _payload[LOG_MAX_PAYLOAD];
+    uint8_t _size = 0;
+    bool reserve(uint8_t tag, uint8_t size);
+    void add_number(uint8_t tag, uint32_t value);
+    friend class LogBuffer;
+  };
+
+  template<typename... Args> void write(uint8_t level, const char *format, Args... args) {
+    Record record;
+    int expand[] = {0, (record.add(args), 0)...};
+    (void) expand;
+    write(level, format, record);
+  }
+  void write(uint8_t level, const char *format, const Record &record);
+  void write(uint8_t level, const char *format) { write(level, format, Record()); }
+
+  // Writes whole records to the port, up to max_bytes.
+  // Returns the number of bytes written.
+  size_t drain(Print &port, size_t max_bytes);
+
+  // Records above level are discarded: call sites filter on LOG_LEVEL at compile time already
+  inline void set_level(uint8_t level) { _level = level; }
+
+  inline size_t pending() const { return _head - _tail; }
+  // Records discarded because the buffer was full
+  inline uint32_t dropped() const { return _dropped; }
+
+private:
+  uint8_t _buffer[LOG_BUFFER_SIZE];
+  // Free running indexes: head is only written by the producer, tail by the consumer
+  volatile uint32_t _head = 0;
+  volatile uint32_t _tail = 0;
+  uint32_t _dropped = 0;
+  uint8_t _level = UINT8_MAX;
+  inline uint8_t at(uint32_t index) const { return _buffer[index & (LOG_BUFFER_SIZE - 1)]; }
+};
+
+extern LogBuffer logBuffer;
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -14,6 +14,26 @@
 #define LoggingPort Serial
 #define TO_LF(s) F(s "\n")
 
+#ifdef LOG_TOKENIZED
+#include "log_buffer.h"
+
+#ifdef DISABLE_LOGGING
+#define LOG_ENABLED(level) false
+#else
+#define LOG_ENABLED(level) (level <= LOG_LEVEL)
+#endif
+// Each format string gets its own symbol, so that tools/log_decoder.py can find it in the ELF file
+#define LOG_FORMAT(s) ({ static const char _log_format[] = s; _log_format; })
+
+#define LOG(level, s) do { if(LOG_ENABLED(level)) logBuffer.write(level, LOG_FORMAT(s)); } while(0)
+#define LOG_F(level, s, ...) do { if(LOG_ENABLED(level)) logBuffer.write(level, LOG_FORMAT(s), __VA_ARGS__); } while(0)
+
+#define TRACE(s) LOG(LOG_LEVEL_TRACE, s)
+#define TRACE_F(s, ...) LOG_F(LOG_LEVEL_TRACE, s, __VA_ARGS__)
+
+#define VERBOSE(s) LOG(LOG_LEVEL_VERBOSE, s)
+#define VERBOSE_F(s, ...) LOG_F(LOG_LEVEL_VERBOSE, s, __VA_ARGS__)
+#else
 #define LOG(method, s) Log.method(TO_LF(s))
 #define LOG_F(method, s, ...) Log.method(TO_LF(s), __VA_ARGS__)
 
@@ -22,6 +42,7 @@
 
 #define VERBOSE(s) LOG(verbose, s)
 #define VERBOSE_F(s, ...) LOG_F(verbose, s, __VA_ARGS__)
+#endif
 
 class DebugLog {
 public:
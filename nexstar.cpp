@@ -2,14 +2,43 @@
 #include "logging.h"
 #include <TimeLib.h>
 #include "nexstar_data.h"
+#include "serial_capture.h"
+#include "settings.h"
 
 
 #define PING_DELAY 5000
 #define COMMAND_IDLE 5000
-#define RESPONSE_TIMEOUT 3500
 #define NOT_CONNECTED_DELAY 4000
 
-Nexstar::Nexstar(HardwareSerial &port, GPS &gps, RTCProvider &rtc) : _port(port), _gps(gps), _rtc(rtc) {
+Nexstar::Nexstar(HardwareSerial &port, GPS &gps, RTCProvider &rtc, EventBus &events, const Settings &settings)
+  : _port(port), _gps(gps), _rtc(rtc), _events(events), _settings(settings) {
+  _events.subscribe(
+    EventBus::mask(EventBus::RTCSet) | EventBus::mask(EventBus::GPSPositionStable) | EventBus::mask(EventBus::GPSFixLost),
+    &Nexstar::on_event, this
+  );
+}
+
+void Nexstar::on_event(void *context, EventBus::Event event, int) {
+  Nexstar *nexstar = reinterpret_cast<Nexstar*>(context);
+  if(event == EventBus::RTCSet) {
+    nexstar->_time_available = true;
+  } else if(event == EventBus::GPSPositionStable) {
+    nexstar->_location_available = true;
+  } else if(event == EventBus::GPSFixLost) {
+    // The GPS starts over the position estimate: wait until it's stable again
+    nexstar->_location_available = false;
+  }
+}
+
+void Nexstar::set_status(Status status) {
+  if(status != _status) {
+    _status = status;
+    if(status == NotConnected) {
+      // Replies to client commands won't come anymore
+      _passthrough_pending = false;
+    }
+    _events.publish(EventBus::NexstarStatusChanged, status);
+  }
 }
 
 void Nexstar::set_comm_port(Stream *comm_port) {
@@ -18,34 +47,117 @@ void Nexstar::set_comm_port(Stream *comm_port) {
 #ifndef DISABLE_LOGGING
     TRACE_F("[Nexstar] Serial port: %s", _comm_port == &Serial ? "USB Serial" : "Bluetooth");
 #endif
+    _escape_pending = false;
   }
 }
 
+void Nexstar::set_escape_handler(EscapeHandler handler, void *context) {
+  _escape_handler = handler;
+  _escape_handler_context = context;
+}
+
 void Nexstar::process() {
   DEBUG_F
+  PROFILE_ZONE(NexstarProcess);
   check_status();
   comms();
 }
 
 void Nexstar::comms() {
   DEBUG_F
-  if(! _comm_port || _status == NotConnected || _waiting_reply) {
+  if(! _comm_port) {
+    return;
+  }
+  // No reply to the client command: the hand control was unplugged, or the command doesn't get one
+  if(_passthrough_pending && millis() - _last_command_sent >= _settings.values().nexstar_timeout) {
+    TRACE("[Nexstar] Passthrough reply timed out");
+    _passthrough_pending = false;
+  }
+  // Escape commands are only recognised at command boundaries, and work even without a hand control
+  if(_escape_handler && !_passthrough_pending && _comm_port->available() && (_escape_pending || _comm_port->peek() == NEXSTAR_ESCAPE)) {
+    process_escape();
+    return;
+  }
+  if(_status == NotConnected) {
+    // Nobody to forward client commands to: drop them, so that they don't hold back escape commands
+    while(_comm_port->available() && _comm_port->peek() != NEXSTAR_ESCAPE) {
+      uint8_t dropped = _comm_port->read();
+      CAPTURE_RX(*_comm_port, dropped);
+      (void) dropped;
+    }
+    return;
+  }
+  if(_waiting_reply) {
     return;
   }
   if(_comm_port->available()) {
     _last_command_sent = millis();
-    _port.write(_comm_port->read());
+    if(!_passthrough_pending) {
+      _passthrough_pending = true;
+      _passthrough_started = _last_command_sent;
+      _stats.passthrough_transactions++;
+    }
+    _stats.passthrough_sent++;
+    uint8_t c = _comm_port->read();
+    CAPTURE_RX(*_comm_port, c);
+    _port.write(c);
+    CAPTURE_TX(_port, c);
   }
   if(_port.available()) {
-    _comm_port->write(_port.read());
+    char c = _port.read();
+    CAPTURE_RX(_port, c);
+    // Every reply from the hand control ends with '#'
+    if(c == '#' && _passthrough_pending) {
+      _passthrough_pending = false;
+      add_rtt(millis() - _passthrough_started);
+    }
+    _stats.passthrough_received++;
+    _comm_port->write(c);
+    CAPTURE_TX(*_comm_port, c);
   }
 }
 
+void Nexstar::process_escape() {
+  if(!_escape_pending) {
+    uint8_t escape = _comm_port->read();
+    CAPTURE_RX(*_comm_port, escape);
+    (void) escape;
+    _escape_pending = true;
+    if(!_comm_port->available()) {
+      return;
+    }
+  }
+  _escape_pending = false;
+  uint8_t command = _comm_port->read();
+  CAPTURE_RX(*_comm_port, command);
+  _escape_handler(_escape_handler_context, command, *_comm_port);
+}
+
+void Nexstar::add_rtt(uint32_t rtt) {
+  _stats.replies++;
+  _stats.rtt_total += rtt;
+  if(rtt < _stats.rtt_min) {
+    _stats.rtt_min = rtt;
+  }
+  if(rtt > _stats.rtt_max) {
+    _stats.rtt_max = rtt;
+  }
+}
+
+bool Nexstar::is_transaction_pending() const {
+  if(_waiting_reply || _escape_pending || _port.available() || (_comm_port && _comm_port->available())) {
+    return true;
+  }
+  return _passthrough_pending && millis() - _last_command_sent < _settings.values().nexstar_timeout;
+}
+
 void Nexstar::ping(Nexstar::Status next_status) {
   DEBUG_F
   _last_ping = millis();
   TRACE_F("[Nexstar] PING [status=%d]", _status);
   _port.print("Kx");
+  CAPTURE_TX(_port, "Kx");
+  _stats.commands++;
   _waiting_reply = CheckReply{
     millis(),
     "x#",
@@ -53,6 +165,7 @@ void Nexstar::ping(Nexstar::Status next_status) {
     next_status,
     NotConnected,
     true,
+    false,
 #ifndef DISABLE_LOGGING
     "PONG",
     "Disconnected",
@@ -63,11 +176,15 @@ void Nexstar::ping(Nexstar::Status next_status) {
 
 void Nexstar::check_reply() {
   DEBUG_F
-//  TRACE_F("[Nexstar] Port available: %d", _port.available());
-  if(!_port.available()) {
-    if(millis() - _waiting_reply.time > RESPONSE_TIMEOUT) {
+  NexstarReply::State state = _reply.read(_port);
+  if(state == NexstarReply::Pending) {
+    if(millis() - _waiting_reply.time > _settings.values().nexstar_timeout) {
       TRACE("[Nexstar] Response timeout");
-      _status = _waiting_reply.on_failed;
+      _stats.timeouts++;
+      if(_waiting_reply.is_sync) {
+        _events.publish(EventBus::NexstarSyncFailed);
+      }
+      set_status(_waiting_reply.on_failed);
       if(_waiting_reply.close_on_failed) {
         TRACE("[Nexstar] closing port");
         _port.end();
@@ -75,27 +192,41 @@ void Nexstar::check_reply() {
 #ifndef DISABLE_LOGGING
       TRACE("[Nexstar] Communication timeout");
 #endif
+      _reply.reset();
       _waiting_reply.reset();
     }
     return;
   }
-//  TRACE("[Nexstar] Fetching reply");
-  NexstarReply reply(_port);
-  bool is_success = reply.equals(_waiting_reply.message, _waiting_reply.size);
+  add_rtt(millis() - _waiting_reply.time);
+  // Overlong replies are rejected as soon as they don't fit
+  bool is_success = state == NexstarReply::Complete && _reply.equals(_waiting_reply.message, _waiting_reply.size);
 //  TRACE_F("[Nexstar] Is success: %T", is_success);
-  _status = is_success ? _waiting_reply.on_success : _waiting_reply.on_failed;
-#ifndef DISABLE_LOGGING
+  if(!is_success && _waiting_reply.is_sync) {
+    _events.publish(EventBus::NexstarSyncFailed);
+  }
+  set_status(is_success ? _waiting_reply.on_success : _waiting_reply.on_failed);
+#if defined(LOG_TOKENIZED) && !defined(DISABLE_LOGGING)
+  // The decoder shows non printable characters as hex
+  TRACE_F(
+    "[Nexstar] %s [status=%d]: %s",
+    is_success ? _waiting_reply.on_success_trace : _waiting_reply.on_failed_trace,
+    _status,
+    _reply.c_str()
+  );
+#elif !defined(DISABLE_LOGGING)
+  char hex[NEXSTAR_REPLY_HEX_SIZE];
   TRACE_F(
     "[Nexstar] %s [status=%d]: %s [%s]",
     is_success ? _waiting_reply.on_success_trace : _waiting_reply.on_failed_trace,
     _status,
-    reply.to_hex().c_str(),
-    reply.to_string().c_str()
+    _reply.to_hex(hex),
+    _reply.c_str()
   );
 #endif
   if(!is_success && _waiting_reply.close_on_failed) {
     _port.end();
   }
+  _reply.reset();
   _waiting_reply.reset();
 }
 
@@ -122,17 +253,18 @@ void Nexstar::check_connection() {
 
 template<typename T> size_t write_struct(T &s, HardwareSerial &port) {
   VERBOSE_F("[Nexstar] Writing %d bytes to port", sizeof(s));
+  CAPTURE_TX(port, reinterpret_cast<uint8_t*>(&s), sizeof(s));
   return port.write(reinterpret_cast<char*>(&s), sizeof(s));
 }
 
 void Nexstar::sync_time() {
-  if(_rtc.is_valid() && is_idle()) {
+  if(_time_available && is_idle()) {
     NexstarTime time(_rtc.utc(), 0, 0);
-    Log.trace("[Nexstar] Syncing time ");
-#if LOG_LEVEL >= LOG_LEVEL_TRACE
+    TRACE("[Nexstar] Syncing time");
     time.debug();
-#endif
     write_struct(time, _port);
+    _events.publish(EventBus::NexstarSyncStarted, TimeSync);
+    _stats.commands++;
     _waiting_reply = CheckReply{
       millis(),
       "#",
@@ -140,6 +272,7 @@ void Nexstar::sync_time() {
       TimeSync,
       _status,
       false,
+      true,
 #ifndef DISABLE_LOGGING
       "Time successfully synced",
       "Error synchronising time",
@@ -149,13 +282,13 @@ void Nexstar::sync_time() {
 }
 
 void Nexstar::sync_location() {
-  if(_gps.hasFix() && is_idle()) {
-    NexstarLocation location(_gps.location().lat(), _gps.location().lng());
-    Log.trace("[Nexstar] syncing location ");
-#if LOG_LEVEL >= LOG_LEVEL_TRACE
+  if(_location_available && is_idle()) {
+    NexstarLocation location(_gps.position().lat(), _gps.position().lng());
+    TRACE("[Nexstar] Syncing location");
     location.debug();
-#endif
     write_struct(location, _port);
+    _events.publish(EventBus::NexstarSyncStarted, LocationSync);
+    _stats.commands++;
     _waiting_reply = CheckReply{
       millis(),
       "#",
@@ -163,6 +296,7 @@ void Nexstar::sync_location() {
       LocationSync,
       _status,
       false,
+      true,
 #ifndef DISABLE_LOGGING
       "Location successfully synced",
       "Error synchronising location",
@@ -4,12 +4,35 @@
 #include "gps.h"
 #include "logging.h"
 #include "rtc.h"
+#include "events.h"
+#include "nexstar_data.h"
+
+// First byte of a command handled by the firmware instead of the hand control.
+// Nexstar commands always start with a printable ASCII opcode, so it can't collide with them.
+#define NEXSTAR_ESCAPE 0xFE
 
 class Settings;
 class Nexstar {
 public:
-  Nexstar(HardwareSerial &port, GPS &gps, RTCProvider &rtc);
+  // Handles an escape command from the client: command is the byte following NEXSTAR_ESCAPE.
+  typedef void (*EscapeHandler)(void *context, uint8_t command, Stream &port);
+
+  struct Stats {
+    uint32_t commands; // sent by the firmware
+    uint32_t timeouts;
+    uint32_t replies; // to both firmware and client commands
+    uint32_t rtt_min; // ms
+    uint32_t rtt_max; // ms
+    uint32_t rtt_total; // ms
+    uint32_t passthrough_transactions;
+    uint32_t passthrough_sent; // bytes from the client to the hand control
+    uint32_t passthrough_received; // bytes from the hand control to the client
+    inline uint32_t rtt_mean() const { return replies > 0 ? rtt_total / replies : 0; }
+  };
+
+  Nexstar(HardwareSerial &port, GPS &gps, RTCProvider &rtc, EventBus &events, const Settings &settings);
   void set_comm_port(Stream *comm_port);
+  void set_escape_handler(EscapeHandler handler, void *context = nullptr);
   void process();
   enum Status {
       NotConnected = 0,
@@ -19,16 +42,33 @@ public:
   };
 
   inline Status status() const { return _status; }
+  // True while a reply is expected from the hand control, either for our own commands or for a client command
+  bool is_transaction_pending() const;
+  inline const Stats &stats() const { return _stats; }
 
 private:
   HardwareSerial &_port;
   Stream *_comm_port = nullptr;
   GPS &_gps;
   RTCProvider &_rtc;
+  EventBus &_events;
+  const Settings &_settings;
+  bool _time_available = false;
+  bool _location_available = false;
+  static void on_event(void *context, EventBus::Event event, int value);
+  void set_status(Status status);
   void ping(Status next_status);
   void check_reply();
-  int _last_ping = 0;
-  int _last_command_sent = 0;
+  uint32_t _last_ping = 0;
+  uint32_t _last_command_sent = 0;
+  bool _passthrough_pending = false;
+  uint32_t _passthrough_started = 0;
+  bool _escape_pending = false;
+  EscapeHandler _escape_handler = nullptr;
+  void *_escape_handler_context = nullptr;
+  Stats _stats{0, 0, 0, UINT32_MAX, 0, 0, 0, 0, 0};
+  void add_rtt(uint32_t rtt);
+  void process_escape();
 
   struct CheckReply {
     uint32_t time;
@@ -37,6 +77,7 @@ private:
     Status on_success;
     Status on_failed;
     bool close_on_failed;
+    bool is_sync;
 #ifndef DISABLE_LOGGING
     char on_success_trace[256];
     char on_failed_trace[256];
@@ -46,6 +87,7 @@ private:
   };
 
   CheckReply _waiting_reply;
+  NexstarReply _reply;
 
   Status _status = NotConnected;
 
@@ -2,55 +2,75 @@
 #include <TimeLib.h>
 #include "Arduino.h"
 #include "logging.h"
+#include "profiler.h"
+#include "serial_capture.h"
 #include <stdlib.h>
 
+// Replies to our own commands are short: anything longer is garbage
+#define NEXSTAR_REPLY_SIZE 16
+// Buffer size for NexstarReply::to_hex()
+#define NEXSTAR_REPLY_HEX_SIZE (NEXSTAR_REPLY_SIZE * 2 + 1)
+
+// Reply from the hand control, up to the terminating '#'.
+// Received incrementally, without blocking: each read() call only consumes the bytes
+// already available, and stops as soon as the reply is complete or too long.
 class NexstarReply {
 public:
-  NexstarReply(HardwareSerial &port) {
-    uint32_t started = millis();
-    while(millis() - started < 2000) {
-      if(port.available()) {
-        _buffer[len] = port.read();
-        if(_buffer[len++] == '#')
-          break;
+  enum State {
+    Pending,
+    Complete,
+    Overflow,
+  };
+
+  State read(Stream &port) {
+    while(_state == Pending && port.available()) {
+      char c = port.read();
+      CAPTURE_RX(port, c);
+      if(len == NEXSTAR_REPLY_SIZE) {
+        _state = Overflow;
+        break;
+      }
+      _buffer[len++] = c;
+      _buffer[len] = 0;
+      if(c == '#') {
+        _state = Complete;
       }
     }
-    _buffer[len] = 0;
+    return _state;
   }
 
-  void debug(bool endline=true) {
-#ifndef DISABLE_LOGGING
-    char log_buffer[10] = {0};
-    for(size_t i=0; i<len; i++) {
-      if(_buffer[i] < 31) {
-        sprintf(log_buffer, "%02x []", _buffer[i]);
-      } else {
-        sprintf(log_buffer, "%02x [%c]", _buffer[i], _buffer[i]);
-      }
-      LoggingPort.print(log_buffer);
-    }
-    if(endline) {
-      LoggingPort.write('\n');
-    }
-#endif 
+  void reset() {
+    len = 0;
+    _buffer[0] = 0;
+    _state = Pending;
   }
 
-  String to_string() {
-    return String(_buffer);
+  inline State state() const {
+    return _state;
   }
-  
-  String to_hex() {
-    String result;
-    char buf[3] = {0,0,0};
-    for(uint8_t i = 0; i<len; i++) {
-      sprintf(buf, "%02X", _buffer[i]);
-      result += buf;
-    }
-    return result;
+
+  void debug() const {
+#ifndef DISABLE_LOGGING
+    char hex[NEXSTAR_REPLY_HEX_SIZE];
+    TRACE_F("[Nexstar] Reply: %s", to_hex(hex));
+#endif
   }
 
-  bool operator==(const String &s) {
-    return to_string() == s;
+  inline const char *c_str() const {
+    return _buffer;
+  }
+
+  // Writes the reply as hex digits to hex (NEXSTAR_REPLY_HEX_SIZE bytes), and returns it
+  const char *to_hex(char *hex) const {
+    static const char digits[] = "0123456789ABCDEF";
+    size_t size = 0;
+    for(; size < len && size < NEXSTAR_REPLY_SIZE; size++) {
+      uint8_t c = _buffer[size];
+      hex[size * 2] = digits[c >> 4];
+      hex[size * 2 + 1] = digits[c & 0xF];
+    }
+    hex[size * 2] = 0;
+    return hex;
   }
 
   bool equals(const char *s, size_t len) {
@@ -67,8 +87,9 @@ public:
   }
 
 private:
-  char _buffer[256] = {0};
+  char _buffer[NEXSTAR_REPLY_SIZE + 1] = {0};
   size_t len = 0;
+  State _state = Pending;
 };
 
 struct __attribute__ ((packed)) NexstarTime {
@@ -85,15 +106,8 @@ struct __attribute__ ((packed)) NexstarTime {
     this->dst = dst;
   }
 
-  void debug(bool endline=true) {
-#ifndef DISABLE_LOGGING
-    char buffer[100];
-    sprintf(buffer, "h:%02d,m:%02d,s:%02d,M:%02d,D:%02d,Y:%02d,tz:%02d,dst:%d", hour, minute, second, month, day, year, tz, dst);
-    LoggingPort.print(buffer);
-    if(endline) {
-      LoggingPort.write('\n');
-    }
-#endif
+  void debug() const {
+    TRACE_F("[Nexstar] Time: h:%d,m:%d,s:%d,M:%d,D:%d,Y:%d,tz:%d,dst:%d", hour, minute, second, month, day, year, tz, dst);
   }
 
   const uint8_t ctrl = 'H';
@@ -113,6 +127,7 @@ struct __attribute__ ((packed)) LatLng {
   uint8_t seconds;
   uint8_t sign;
   LatLng(double number, uint8_t positive_value=0, uint8_t negative_value=1) {
+    PROFILE_ZONE(LatLngConversion);
     sign = positive_value;
     if(number < 0) {
       sign = negative_value;
@@ -134,12 +149,9 @@ struct __attribute__ ((packed)) NexstarLocation {
   NexstarLocation(double latitude, double longitude) : latitude(latitude), longitude(longitude) {
   }
 
-  void debug(bool endline=true) {
-#ifndef DISABLE_LOGGING
-    char buffer[100];
-    sprintf(
-      buffer,
-      "lat: d:%02d,m:%02d,s:%02d sign=%d; lng: d:%02d,m:%02d,s:%02d %d",
+  void debug() const {
+    TRACE_F(
+      "[Nexstar] Location: lat: d:%d,m:%d,s:%d sign=%d; lng: d:%d,m:%d,s:%d %d",
       latitude.degrees,
       latitude.minutes,
       latitude.seconds,
@@ -149,10 +161,5 @@ struct __attribute__ ((packed)) NexstarLocation {
       longitude.seconds,
       longitude.sign
     );
-    LoggingPort.print(buffer);
-    if(endline) {
-      LoggingPort.write('\n');
-    }
-#endif
   }
 };
@@ -0,0 +1,133 @@
+#include "position_filter.h"
+#include <math.h>
+
+#define METERS_PER_DEGREE 111319.49f
+#define DEFAULT_HDOP 5.0f
+#define MIN_HDOP 0.5f
+#define MIN_SATELLITES 4
+#define FULL_WEIGHT_SATELLITES 12
+
+// Outliers are only rejected once the estimate is somewhat settled
+#define OUTLIER_MIN_SAMPLES 5
+#define OUTLIER_SIGMAS 3.0f
+#define OUTLIER_MIN_GATE_METERS 10.0f
+// Too many rejections in a row means we moved (or started from a bad fix): start over
+#define OUTLIER_MAX_CONSECUTIVE 10
+
+#define CONFIDENCE_MIN_SAMPLES 10
+#define CONFIDENCE_MAX_ERROR_METERS 3.0f
+
+PositionFilter::PositionFilter() {
+  reset();
+}
+
+void PositionFilter::reset() {
+  _origin_lat = 0;
+  _origin_lng = 0;
+  _meters_per_lng_degree = METERS_PER_DEGREE;
+  _mean_x = 0;
+  _mean_y = 0;
+  _m2 = 0;
+  _weight_sum = 0;
+  _weight_squares_sum = 0;
+  _samples = 0;
+  _rejected = 0;
+  _consecutive_rejected = 0;
+}
+
+bool PositionFilter::add(double lat, double lng, uint32_t hdop_hundredths, uint32_t satellites) {
+  // Zero satellites means unknown (no GGA sentences received yet)
+  if(satellites > 0 && satellites < MIN_SATELLITES) {
+    return false;
+  }
+  float satellites_factor = satellites == 0 || satellites >= FULL_WEIGHT_SATELLITES ? 1.0f : static_cast<float>(satellites) / FULL_WEIGHT_SATELLITES;
+  float hdop = hdop_hundredths > 0 ? hdop_hundredths / 100.0f : DEFAULT_HDOP;
+  if(hdop < MIN_HDOP) {
+    hdop = MIN_HDOP;
+  }
+  float weight = satellites_factor / (hdop * hdop);
+
+  if(_samples == 0) {
+    _origin_lat = lat;
+    _origin_lng = lng;
+    _meters_per_lng_degree = METERS_PER_DEGREE * cosf(static_cast<float>(lat) * static_cast<float>(M_PI) / 180.0f);
+    if(_meters_per_lng_degree < 1.0f) {
+      _meters_per_lng_degree = 1.0f;
+    }
+  }
+
+  double delta_lng = lng - _origin_lng;
+  if(delta_lng > 180) {
+    delta_lng -= 360;
+  } else if(delta_lng < -180) {
+    delta_lng += 360;
+  }
+  float x = static_cast<float>(delta_lng) * _meters_per_lng_degree;
+  float y = static_cast<float>(lat - _origin_lat) * METERS_PER_DEGREE;
+
+  float delta_x = x - _mean_x;
+  float delta_y = y - _mean_y;
+
+  if(_samples >= OUTLIER_MIN_SAMPLES) {
+    float gate = OUTLIER_SIGMAS * spread_meters();
+    if(gate < OUTLIER_MIN_GATE_METERS) {
+      gate = OUTLIER_MIN_GATE_METERS;
+    }
+    if(delta_x * delta_x + delta_y * delta_y > gate * gate) {
+      _rejected++;
+      if(++_consecutive_rejected >= OUTLIER_MAX_CONSECUTIVE) {
+        reset();
+      }
+      return false;
+    }
+  }
+  _consecutive_rejected = 0;
+
+  _weight_sum += weight;
+  _weight_squares_sum += weight * weight;
+  float ratio = weight / _weight_sum;
+  _mean_x += ratio * delta_x;
+  _mean_y += ratio * delta_y;
+  // Radial (x+y) weighted sum of squared deviations
+  _m2 += weight * (delta_x * (x - _mean_x) + delta_y * (y - _mean_y));
+  if(_samples < UINT16_MAX) {
+    _samples++;
+  }
+  return true;
+}
+
+float PositionFilter::spread_meters() const {
+  if(_weight_sum <= 0) {
+    return 0;
+  }
+  return sqrtf(_m2 / _weight_sum);
+}
+
+float PositionFilter::error_meters() const {
+  if(_weight_squares_sum <= 0) {
+    return INFINITY;
+  }
+  // Standard error of the weighted mean, using Kish's effective sample size
+  float effective_samples = _weight_sum * _weight_sum / _weight_squares_sum;
+  return spread_meters() / sqrtf(effective_samples);
+}
+
+bool PositionFilter::is_confident() const {
+  return _samples >= CONFIDENCE_MIN_SAMPLES && error_meters() <= CONFIDENCE_MAX_ERROR_METERS;
+}
+
+double PositionFilter::lat() const {
+  return _origin_lat + _mean_y / METERS_PER_DEGREE;
+}
+
+double PositionFilter::lng() const {
+  double lng = _origin_lng + _mean_x / _meters_per_lng_degree;
+  if(lng > 180) {
+    lng -= 360;
+  } else if(lng < -180) {
+    lng += 360;
+  }
+  return lng;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+// Streaming position estimator.
+// Fixes are projected on a local plane around the first accepted sample, and
+// accumulated in a weighted running mean/variance (West's incremental algorithm),
+// so memory usage is constant regardless of how many fixes are fed.
+// Weights favour low HDOP and a high number of satellites; samples too far
+// away from the current estimate are rejected as outliers.
+class PositionFilter {
+public:
+  PositionFilter();
+  void reset();
+  // Returns false if the sample was rejected.
+  bool add(double lat, double lng, uint32_t hdop_hundredths, uint32_t satellites);
+
+  bool is_confident() const;
+  double lat() const;
+  double lng() const;
+  // Estimated 1-sigma error of the filtered position, in meters.
+  float error_meters() const;
+  // Weighted 1-sigma spread of the accepted samples, in meters.
+  float spread_meters() const;
+
+  inline uint16_t samples() const { return _samples; }
+  inline uint16_t rejected() const { return _rejected; }
+
+private:
+  double _origin_lat;
+  double _origin_lng;
+  float _meters_per_lng_degree;
+
+  float _mean_x;
+  float _mean_y;
+  float _m2;
+  float _weight_sum;
+  float _weight_squares_sum;
+
+  uint16_t _samples;
+  uint16_t _rejected;
+  uint8_t _consecutive_rejected;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
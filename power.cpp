@@ -0,0 +1,56 @@
+#include "power.h"
+
+#ifdef HOST_BUILD
+#define WAIT_FOR_INTERRUPT() host::wait_for_interrupt()
+#elif defined(__arm__)
+#define WAIT_FOR_INTERRUPT() asm volatile("wfi")
+#else
+#define WAIT_FOR_INTERRUPT()
+#endif
+
+PowerManager::PowerManager(Scheduler &scheduler) : _scheduler(scheduler) {
+}
+
+bool PowerManager::add_wake_source(Stream *stream) {
+  if(_wake_sources_count >= POWER_MAX_WAKE_SOURCES) {
+    return false;
+  }
+  _wake_sources[_wake_sources_count++] = stream;
+  return true;
+}
+
+bool PowerManager::has_pending_input() {
+  for(uint8_t i = 0; i < _wake_sources_count; i++) {
+    if(_wake_sources[i]->available()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PowerManager::idle() {
+  if(_scheduler.next_due_in() == 0 || has_pending_input()) {
+    return;
+  }
+  // An interrupt firing between the checks above and WFI delays processing until the next SysTick (1ms) at most
+  uint32_t started = micros();
+  WAIT_FOR_INTERRUPT();
+  _asleep_us += micros() - started;
+  _sleeps++;
+}
+
+float PowerManager::sleep_fraction() const {
+  uint32_t elapsed_ms = millis() - _stats_since_ms;
+  if(elapsed_ms == 0) {
+    return 0;
+  }
+  return static_cast<float>(_asleep_us / 1000) / elapsed_ms;
+}
+
+void PowerManager::reset_stats() {
+  _asleep_us = 0;
+  _sleeps = 0;
+  _stats_since_ms = millis();
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,32 @@
+#pragma once
+#include "Arduino.h"
+#include "scheduler.h"
+
+#define POWER_MAX_WAKE_SOURCES 4
+
+// Puts the CPU to sleep (WFI) between events, when no periodic task is due and no input is pending.
+// The core wakes up on any interrupt: UART RX, USB, GPS PPS, or the 1ms SysTick driving millis(),
+// which also bounds the latency of anything polled by the tasks.
+class PowerManager {
+public:
+  PowerManager(Scheduler &scheduler);
+  // Streams whose pending input must be processed before sleeping
+  bool add_wake_source(Stream *stream);
+  void idle();
+
+  // Fraction of time spent asleep since the last stats reset
+  float sleep_fraction() const;
+  inline uint32_t sleeps() const { return _sleeps; }
+  void reset_stats();
+
+private:
+  Scheduler &_scheduler;
+  Stream *_wake_sources[POWER_MAX_WAKE_SOURCES];
+  uint8_t _wake_sources_count = 0;
+  uint64_t _asleep_us = 0;
+  uint32_t _stats_since_ms = 0;
+  uint32_t _sleeps = 0;
+  bool has_pending_input();
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,92 @@
+#include "profiler.h"
+#include "logging.h"
+
+#if defined(__arm__) && !defined(HOST_BUILD)
+#define PROFILER_DWT
+#endif
+
+#ifdef PROFILER_DWT
+#define DEMCR (*reinterpret_cast<volatile uint32_t*>(0xE000EDFC))
+#define DEMCR_TRCENA (1 << 24)
+#define DWT_CTRL (*reinterpret_cast<volatile uint32_t*>(0xE0001000))
+#define DWT_CTRL_CYCCNTENA (1 << 0)
+#define DWT_CYCCNT (*reinterpret_cast<volatile uint32_t*>(0xE0001004))
+#ifndef F_CPU
+#define F_CPU 72000000UL
+#endif
+#else
+#include <chrono>
+#endif
+
+Profiler profiler;
+
+namespace {
+  const char *zoneNames[Profiler::ZonesCount] = {
+    "gps.process",
+    "gps.encode",
+    "nexstar.process",
+    "latlng",
+  };
+}
+
+Profiler::Profiler() {
+  reset();
+}
+
+void Profiler::begin() {
+#ifdef PROFILER_DWT
+  DEMCR |= DEMCR_TRCENA;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+uint32_t Profiler::ticks() {
+#ifdef PROFILER_DWT
+  return DWT_CYCCNT;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint32_t Profiler::ticks_per_us() {
+#ifdef PROFILER_DWT
+  return F_CPU / 1000000UL;
+#else
+  return 1000;
+#endif
+}
+
+void Profiler::record(Zone zone, uint32_t ticks) {
+  Stats &stats = _stats[zone];
+  stats.count++;
+  stats.total += ticks;
+  if(ticks < stats.min) {
+    stats.min = ticks;
+  }
+  if(ticks > stats.max) {
+    stats.max = ticks;
+  }
+}
+
+void Profiler::reset() {
+  for(uint8_t i = 0; i < ZonesCount; i++) {
+    _stats[i] = Stats{0, UINT32_MAX, 0, 0};
+  }
+}
+
+const char *Profiler::name(Zone zone) {
+  return zoneNames[zone];
+}
+
+void Profiler::dump() const {
+  for(uint8_t i = 0; i < ZonesCount; i++) {
+    const Stats &stats = _stats[i];
+    if(stats.count == 0) {
+      continue;
+    }
+    VERBOSE_F("[Profiler] %s: count=%d, min=%d, max=%d, mean=%d ticks (%d ticks/us)", zoneNames[i], stats.count, stats.min, stats.max, stats.mean(), ticks_per_us());
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
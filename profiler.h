@@ -0,0 +1,65 @@
+#pragma once
+#include "Arduino.h"
+#include "defines.h"
+
+// Execution time statistics for hot code paths.
+// On the board, durations are measured with the Cortex-M3 DWT cycle counter, which costs
+// a couple of cycles per read; host builds use std::chrono instead.
+// Zones are only compiled in when PROFILING is defined, PROFILE_ZONE is a no-op otherwise.
+class Profiler {
+public:
+  enum Zone {
+    GPSProcess = 0,
+    GPSEncode,
+    NexstarProcess,
+    LatLngConversion,
+    ZonesCount,
+  };
+
+  struct Stats {
+    uint32_t count;
+    uint32_t min; // ticks
+    uint32_t max; // ticks
+    uint64_t total; // ticks
+    inline uint32_t mean() const { return count > 0 ? total / count : 0; }
+  };
+
+  class Scope {
+  public:
+    inline Scope(Zone zone) : _zone(zone), _started(Profiler::ticks()) {}
+    inline ~Scope();
+  private:
+    Zone _zone;
+    uint32_t _started;
+  };
+
+  Profiler();
+  void begin();
+  void record(Zone zone, uint32_t ticks);
+  void reset();
+  // Logs every zone that was entered at least once
+  void dump() const;
+
+  inline const Stats &stats(Zone zone) const { return _stats[zone]; }
+  static const char *name(Zone zone);
+  static uint32_t ticks();
+  // Conversion from ticks: CPU cycles on the board, nanoseconds on the host
+  static uint32_t ticks_per_us();
+
+private:
+  Stats _stats[ZonesCount];
+};
+
+extern Profiler profiler;
+
+Profiler::Scope::~Scope() {
+  profiler.record(_zone, Profiler::ticks() - _started);
+}
+
+#ifdef PROFILING
+#define PROFILE_ZONE(zone) Profiler::Scope _profile_scope(Profiler::zone)
+#else
+#define PROFILE_ZONE(zone)
+#endif
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
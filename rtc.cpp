@@ -7,13 +7,18 @@ time_t syncProvider();
 
 RTCProvider *_rtc_provider_instance = nullptr;
 
-RTCProvider::RTCProvider() : rtclock(RTCSEL_LSE) {
+RTCProvider::RTCProvider(EventBus &events) : rtclock(RTCSEL_LSE), events(events) {
     _rtc_provider_instance = this;
 }
 
 void RTCProvider::setup() {
   setSyncProvider(syncProvider);
   setSyncInterval(2);
+  // Validity can only change through set_time from now on, no need to read the RTC again
+  _valid = utc() > REFERENCE_UNIX_TIMESTAMP;
+  if(_valid) {
+    events.publish(EventBus::RTCSet);
+  }
 }
 
 time_t RTCProvider::utc() const {
@@ -22,14 +27,26 @@ time_t RTCProvider::utc() const {
 
 void RTCProvider::set_time(time_t time) {
   rtclock.setTime(time);
+  _valid = time > REFERENCE_UNIX_TIMESTAMP;
+  if(_valid) {
+    events.publish(EventBus::RTCSet);
+  }
 }
 
+void RTCProvider::discipline(time_t time) {
+  set_time(time);
+  if(_valid && !_disciplined) {
+    _disciplined = true;
+    events.publish(EventBus::RTCDisciplined);
+  }
+}
 
-void RTCProvider::set_time(uint8_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+
+void RTCProvider::set_time(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
   tmElements_t _time{
     second, minute, hour,
     0,
-    day, month, CalendarYrToTm(year),
+    day, month, static_cast<uint8_t>(CalendarYrToTm(year)),
   };
   this->set_time(makeTime(_time));
 }
@@ -41,8 +58,4 @@ time_t syncProvider() {
   return 0;
 }
 
-bool RTCProvider::is_valid() const {
-    return utc() > REFERENCE_UNIX_TIMESTAMP;
-}
-
 // vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -1,17 +1,24 @@
 #include <Arduino.h>
 #include <RTClock.h>
 #pragma once
+#include "events.h"
 
 class RTCProvider {
 public:
-  RTCProvider();
+  RTCProvider(EventBus &events);
   void setup();
   time_t utc() const;
   void set_time(time_t time);
-  void set_time(uint8_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
-  bool is_valid() const;
+  void set_time(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+  // Set time from a reference clock (GPS)
+  void discipline(time_t time);
+  inline bool is_valid() const { return _valid; }
+  inline bool is_disciplined() const { return _disciplined; }
 private:
   mutable RTClock rtclock;
+  EventBus &events;
+  bool _valid = false;
+  bool _disciplined = false;
 };
 
 // vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
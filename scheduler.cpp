@@ -0,0 +1,90 @@
+#include "scheduler.h"
+
+namespace {
+  inline bool is_due(uint32_t now, uint32_t deadline) {
+    return static_cast<int32_t>(now - deadline) >= 0;
+  }
+}
+
+uint32_t Scheduler::board_ms() {
+  return millis();
+}
+
+uint32_t Scheduler::board_us() {
+  return micros();
+}
+
+Scheduler::Scheduler(Clock clock_ms, Clock clock_us) : _clock_ms(clock_ms), _clock_us(clock_us) {
+}
+
+bool Scheduler::add(const char *name, TaskFunction function, uint32_t period, uint8_t priority) {
+  if(_tasks_count >= SCHEDULER_MAX_TASKS) {
+    return false;
+  }
+  // Keep tasks sorted by descending priority, preserving insertion order for equal priorities
+  uint8_t index = _tasks_count++;
+  while(index > 0 && _tasks[index - 1].priority < priority) {
+    _tasks[index] = _tasks[index - 1];
+    index--;
+  }
+  _tasks[index] = Task{name, function, period, priority, _clock_ms(), 0, 0, 0, 0};
+  return true;
+}
+
+void Scheduler::run() {
+  _iterations++;
+  for(uint8_t i = 0; i < _tasks_count; i++) {
+    Task &task = _tasks[i];
+    uint32_t now = _clock_ms();
+    if(task.period > 0) {
+      if(!is_due(now, task.next_run)) {
+        continue;
+      }
+      // Starting later than a whole period means at least one run was skipped
+      if(now - task.next_run >= task.period) {
+        task.missed_deadlines++;
+        task.next_run = now + task.period;
+      } else {
+        task.next_run += task.period;
+      }
+    }
+    uint32_t started = _clock_us();
+    task.function();
+    uint32_t runtime = _clock_us() - started;
+    task.runs++;
+    task.total_runtime += runtime;
+    if(runtime > task.max_runtime) {
+      task.max_runtime = runtime;
+    }
+  }
+}
+
+uint32_t Scheduler::next_due_in() const {
+  uint32_t now = _clock_ms();
+  uint32_t next = UINT32_MAX;
+  for(uint8_t i = 0; i < _tasks_count; i++) {
+    const Task &task = _tasks[i];
+    if(task.period == 0) {
+      continue;
+    }
+    if(is_due(now, task.next_run)) {
+      return 0;
+    }
+    if(task.next_run - now < next) {
+      next = task.next_run - now;
+    }
+  }
+  return next;
+}
+
+void Scheduler::reset_stats() {
+  for(uint8_t i = 0; i < _tasks_count; i++) {
+    _tasks[i].runs = 0;
+    _tasks[i].missed_deadlines = 0;
+    _tasks[i].max_runtime = 0;
+    _tasks[i].total_runtime = 0;
+  }
+  _iterations = 0;
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
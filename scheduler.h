@@ -0,0 +1,56 @@
+#pragma once
+#include "Arduino.h"
+
+#define SCHEDULER_MAX_TASKS 8
+
+// Cooperative scheduler: runs registered tasks from loop() when their period is due.
+// Tasks with higher priority run first within an iteration.
+// Timing is based on unsigned differences, so it's safe across millis() wraparound.
+class Scheduler {
+public:
+  typedef void (*TaskFunction)();
+  typedef uint32_t (*Clock)();
+
+  struct Task {
+    const char *name;
+    TaskFunction function;
+    uint32_t period; // ms, 0 to run on every iteration
+    uint8_t priority;
+    uint32_t next_run;
+    // statistics
+    uint32_t runs;
+    uint32_t missed_deadlines;
+    uint32_t max_runtime; // us
+    uint64_t total_runtime; // us
+    inline uint32_t avg_runtime() const { return runs > 0 ? total_runtime / runs : 0; }
+  };
+
+  // millis() and micros(), as Clock: the board core declares them returning uint32,
+  // which is not the same type as uint32_t on arm-none-eabi
+  static uint32_t board_ms();
+  static uint32_t board_us();
+
+  // Clocks can be replaced, for instance to run against a virtual clock
+  Scheduler(Clock clock_ms = &board_ms, Clock clock_us = &board_us);
+  // Returns false if there's no room left for the task.
+  bool add(const char *name, TaskFunction function, uint32_t period, uint8_t priority = 0);
+  // Runs every task that is due, once.
+  void run();
+  // Milliseconds until the next periodic task is due, UINT32_MAX if there are none.
+  // Tasks running on every iteration are not considered.
+  uint32_t next_due_in() const;
+
+  inline uint8_t tasks_count() const { return _tasks_count; }
+  inline const Task &task(uint8_t index) const { return _tasks[index]; }
+  inline uint32_t iterations() const { return _iterations; }
+  void reset_stats();
+
+private:
+  Clock _clock_ms;
+  Clock _clock_us;
+  Task _tasks[SCHEDULER_MAX_TASKS];
+  uint8_t _tasks_count = 0;
+  uint32_t _iterations = 0;
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
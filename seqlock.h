@@ -0,0 +1,41 @@
+#pragma once
+#include "Arduino.h"
+
+// Values published by a single writer (an interrupt handler) to readers it can
+// preempt, without disabling interrupts: the writer fills the slot readers are not
+// using and then bumps the sequence number; readers copy the published slot, and
+// start over if the sequence changed meanwhile. The writer never waits.
+template<typename T> class SeqLock {
+public:
+  void write(const T &value) {
+    uint32_t sequence = _sequence + 1;
+    _slots[sequence & 1] = value;
+    barrier();
+    _sequence = sequence;
+  }
+
+  T read() const {
+    T value;
+    uint32_t sequence;
+    do {
+      sequence = _sequence;
+      barrier();
+      value = _slots[sequence & 1];
+      barrier();
+    } while(sequence != _sequence);
+    return value;
+  }
+
+  // Number of writes so far
+  inline uint32_t sequence() const { return _sequence; }
+
+private:
+  T _slots[2] = {};
+  volatile uint32_t _sequence = 0;
+  // Keeps the compiler from moving slot accesses across sequence updates
+  static inline void barrier() {
+    asm volatile("" ::: "memory");
+  }
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,117 @@
+#include "serial_capture.h"
+
+#ifdef SERIAL_CAPTURE
+// Largest record header: tag and a 32 bit varint
+#define CAPTURE_HEADER_SIZE 6
+#define CAPTURE_OVERFLOW_SIZE 3
+
+SerialCapture serialCapture;
+
+void SerialCapture::set_port(Port id, const Print &port) {
+  _ports[id] = &port;
+}
+
+void SerialCapture::add(const Print &port, Direction direction, const uint8_t *data, size_t size) {
+  for(size_t i = 0; i < size; i++) {
+    add(port, direction, data[i]);
+  }
+}
+
+void SerialCapture::add(const Print &port, Direction direction, uint8_t c) {
+  uint8_t id = 0;
+  while(id < PortsCount && _ports[id] != &port) {
+    id++;
+  }
+  if(id == PortsCount) {
+    return;
+  }
+  uint32_t now = micros();
+  uint8_t tag = id << 6 | direction << 5;
+  if(_open && (at(_open_tag) & 0xE0) == tag && (at(_open_tag) & 0x1F) < SERIAL_CAPTURE_MAX_RECORD - 1 && now - _open_last_byte < SERIAL_CAPTURE_MERGE_US && room() > 0) {
+    _buffer[_open_tag & (SERIAL_CAPTURE_BUFFER_SIZE - 1)]++;
+    put(c);
+    _open_last_byte = now;
+    return;
+  }
+  _open = false;
+  if(room() < CAPTURE_HEADER_SIZE + 1 + (_lost > 0 ? CAPTURE_OVERFLOW_SIZE : 0)) {
+    if(_lost < UINT16_MAX) {
+      _lost++;
+    }
+    _total_lost++;
+    return;
+  }
+  if(_lost > 0) {
+    put(SERIAL_CAPTURE_OVERFLOW);
+    put(_lost & 0xFF);
+    put(_lost >> 8);
+    _lost = 0;
+  }
+  uint32_t delta = now - _last_time;
+  _last_time = now;
+  _open_tag = _head;
+  put(tag);
+  while(delta >= 0x80) {
+    put(delta | 0x80);
+    delta >>= 7;
+  }
+  put(delta);
+  put(c);
+  _open = true;
+  _open_last_byte = now;
+}
+
+uint32_t SerialCapture::record_size(uint32_t index, uint32_t &delta) const {
+  uint8_t tag = at(index);
+  delta = 0;
+  if((tag & 0x1F) == SERIAL_CAPTURE_MAX_RECORD) {
+    return CAPTURE_OVERFLOW_SIZE;
+  }
+  uint32_t size = 1;
+  uint8_t shift = 0;
+  uint8_t c;
+  do {
+    c = at(index + size++);
+    delta |= static_cast<uint32_t>(c & 0x7F) << shift;
+    shift += 7;
+  } while(c & 0x80);
+  return size + (tag & 0x1F) + 1;
+}
+
+size_t SerialCapture::drain(Print &output, bool connected, size_t max_bytes) {
+  if(!connected) {
+    _connected = false;
+    return 0;
+  }
+  // The last record may still grow, unless it's been idle for long enough
+  if(_open && micros() - _open_last_byte >= SERIAL_CAPTURE_MERGE_US) {
+    _open = false;
+  }
+  size_t written = 0;
+  if(!_connected) {
+    _connected = true;
+    uint8_t header[] = {
+      SERIAL_CAPTURE_MAGIC[0], SERIAL_CAPTURE_MAGIC[1], SERIAL_CAPTURE_MAGIC[2], SERIAL_CAPTURE_MAGIC[3], SERIAL_CAPTURE_VERSION,
+      SERIAL_CAPTURE_START,
+      static_cast<uint8_t>(_drained_time), static_cast<uint8_t>(_drained_time >> 8), static_cast<uint8_t>(_drained_time >> 16), static_cast<uint8_t>(_drained_time >> 24),
+    };
+    written += output.write(header, sizeof(header));
+  }
+  while(_tail != _head && !(_open && _tail == _open_tag)) {
+    uint32_t delta;
+    uint32_t size = record_size(_tail, delta);
+    if(written + size > max_bytes) {
+      break;
+    }
+    for(uint32_t i = 0; i < size; i++) {
+      output.write(at(_tail + i));
+    }
+    _tail += size;
+    _drained_time += delta;
+    written += size;
+  }
+  return written;
+}
+#endif
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,90 @@
+#pragma once
+#include "Arduino.h"
+#include "defines.h"
+
+// Must be a power of two
+#define SERIAL_CAPTURE_BUFFER_SIZE 2048
+// Bytes on the same port and direction closer than this share a record
+#define SERIAL_CAPTURE_MERGE_US 2000
+#define SERIAL_CAPTURE_MAGIC "NXTR"
+#define SERIAL_CAPTURE_VERSION 1
+
+// Control records: the byte count bits of the tag are all set
+#define SERIAL_CAPTURE_MAX_RECORD 31
+#define SERIAL_CAPTURE_START 0x1F
+#define SERIAL_CAPTURE_OVERFLOW 0x3F
+
+// Capture of every byte received and sent on the serial ports, streamed to USB
+// Serial to be replayed on the host (host/replay).
+//
+// Trace layout (little endian): "NXTR", version, then records.
+// Data records: tag, microseconds since the previous data record (LEB128 varint), bytes.
+//   The tag holds the port (bits 7-6), the direction (bit 5: 0 received by the board,
+//   1 sent by it) and the number of bytes minus one (bits 4-0, up to 31 bytes).
+//   Timestamps are taken when the firmware reads or writes the bytes.
+// Control records, with the low 5 bits of the tag set:
+//   0x1F start: micros() (4 bytes) the first data record delta is relative to
+//   0x3F overflow: bytes lost (2 bytes) because the buffer was full
+//
+// A trace starts at each USB connection. Records are buffered from boot, so
+// connecting early enough (within a couple of seconds) captures everything.
+class SerialCapture {
+public:
+  enum Port {
+    GPSPort = 0,
+    NexstarPort = 1,
+    USBPort = 2,
+    BluetoothPort = 3,
+    PortsCount,
+  };
+  enum Direction {
+    Received = 0,
+    Sent = 1,
+  };
+
+  void set_port(Port id, const Print &port);
+  void add(const Print &port, Direction direction, uint8_t c);
+  void add(const Print &port, Direction direction, const uint8_t *data, size_t size);
+  void add(const Print &port, Direction direction, const char *data) { add(port, direction, reinterpret_cast<const uint8_t*>(data), strlen(data)); }
+
+  // Writes whole records, up to max_bytes, while connected.
+  // Returns the number of bytes written.
+  size_t drain(Print &output, bool connected, size_t max_bytes);
+
+  inline size_t pending() const { return _head - _tail; }
+  inline uint32_t lost() const { return _total_lost; }
+
+private:
+  const Print *_ports[PortsCount] = {};
+  uint8_t _buffer[SERIAL_CAPTURE_BUFFER_SIZE];
+  uint32_t _head = 0;
+  uint32_t _tail = 0;
+  // Time of the last record written to the buffer, and of the last one drained
+  uint32_t _last_time = 0;
+  uint32_t _drained_time = 0;
+  bool _connected = false;
+  // Record still being appended to
+  bool _open = false;
+  uint32_t _open_tag = 0;
+  uint32_t _open_last_byte = 0;
+  uint16_t _lost = 0;
+  uint32_t _total_lost = 0;
+
+  inline uint8_t at(uint32_t index) const { return _buffer[index & (SERIAL_CAPTURE_BUFFER_SIZE - 1)]; }
+  inline void put(uint8_t c) { _buffer[_head++ & (SERIAL_CAPTURE_BUFFER_SIZE - 1)] = c; }
+  inline size_t room() const { return SERIAL_CAPTURE_BUFFER_SIZE - (_head - _tail); }
+  // Size of the record at index, and the delta it adds to the time
+  uint32_t record_size(uint32_t index, uint32_t &delta) const;
+};
+
+extern SerialCapture serialCapture;
+
+#ifdef SERIAL_CAPTURE
+#define CAPTURE_RX(port, ...) serialCapture.add(port, SerialCapture::Received, __VA_ARGS__)
+#define CAPTURE_TX(port, ...) serialCapture.add(port, SerialCapture::Sent, __VA_ARGS__)
+#else
+#define CAPTURE_RX(port, ...)
+#define CAPTURE_TX(port, ...)
+#endif
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
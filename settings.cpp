@@ -0,0 +1,273 @@
+#include "settings.h"
+#include "logging.h"
+#include <flash_stm32.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SETTINGS_MAGIC 0x5E77
+#define SETTINGS_ERASED 0xFFFF
+// magic, generation, ~generation
+#define SETTINGS_HEADER_SIZE 6
+// Longest value: the Bluetooth name, without terminator
+#define SETTINGS_MAX_VALUE (SETTINGS_BLUETOOTH_NAME_SIZE - 1)
+// key | size << 8, value padded to halfwords, CRC
+#define SETTINGS_RECORD_SIZE(size) (2 + ((size) + 1) / 2 * 2 + 2)
+
+#ifdef HOST_BUILD
+#define FLASH_READ(address) host::flash_read(address)
+#else
+#define FLASH_READ(address) (*reinterpret_cast<volatile const uint16_t*>(address))
+#endif
+
+static_assert(sizeof(BLUETOOTH_DEVICE_NAME) <= SETTINGS_BLUETOOTH_NAME_SIZE, "BLUETOOTH_DEVICE_NAME is too long");
+static_assert(sizeof(BLUETOOTH_DEVICE_PIN) <= SETTINGS_BLUETOOTH_PIN_SIZE, "BLUETOOTH_DEVICE_PIN is too long");
+
+namespace {
+  struct Field {
+    uint8_t offset;
+    uint8_t size;
+    bool string;
+  };
+
+  const Field fields[Settings::KeysCount] = {
+    {offsetof(Settings::Values, bluetooth_name), SETTINGS_BLUETOOTH_NAME_SIZE, true},
+    {offsetof(Settings::Values, bluetooth_pin), SETTINGS_BLUETOOTH_PIN_SIZE, true},
+    {offsetof(Settings::Values, log_level), sizeof(uint8_t), false},
+    {offsetof(Settings::Values, nexstar_timeout), sizeof(uint16_t), false},
+    {offsetof(Settings::Values, commport_debounce), sizeof(uint16_t), false},
+  };
+
+  const Settings::Values defaultValues = {
+    BLUETOOTH_DEVICE_NAME,
+    BLUETOOTH_DEVICE_PIN,
+    LOG_LEVEL,
+    NEXSTAR_RESPONSE_TIMEOUT,
+    COMMPORT_DEBOUNCE,
+  };
+
+  // CRC-16/CCITT, with the top bit cleared: a record whose CRC was never written (0xFFFF) is never valid
+  uint16_t crc16(uint16_t crc, uint8_t byte) {
+    crc ^= static_cast<uint16_t>(byte) << 8;
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+  }
+
+  uint16_t record_crc(uint16_t header, const uint8_t *value, uint8_t size) {
+    uint16_t crc = crc16(crc16(0xFFFF, header & 0xFF), header >> 8);
+    for(uint8_t i = 0; i < size; i++) {
+      crc = crc16(crc, value[i]);
+    }
+    return crc & 0x7FFF;
+  }
+
+  const uint8_t *field_value(const Settings::Values &values, uint8_t key, uint8_t &size) {
+    const uint8_t *value = reinterpret_cast<const uint8_t*>(&values) + fields[key].offset;
+    size = fields[key].string ? strlen(reinterpret_cast<const char*>(value)) : fields[key].size;
+    return value;
+  }
+
+  bool valid(uint8_t key, const uint8_t *value, uint8_t size) {
+    if(key >= Settings::KeysCount) {
+      return false;
+    }
+    const Field &field = fields[key];
+    if(field.string) {
+      if(size == 0 || size >= field.size) {
+        return false;
+      }
+      // Quoted in the AT commands
+      for(uint8_t i = 0; i < size; i++) {
+        if(value[i] < ' ' || value[i] > '~' || value[i] == '"') {
+          return false;
+        }
+      }
+      return true;
+    }
+    if(size != field.size) {
+      return false;
+    }
+    switch(key) {
+      case Settings::LogLevel:
+        return value[0] <= LOG_LEVEL_VERBOSE;
+      default:
+        return (value[0] | value[1]) != 0;
+    }
+  }
+
+  bool program(uint32_t &address, uint16_t data) {
+    if(FLASH_ProgramHalfWord(address, data) != FLASH_COMPLETE) {
+      return false;
+    }
+    address += 2;
+    return true;
+  }
+}
+
+Settings::Settings() : _values(defaultValues) {
+}
+
+void Settings::load() {
+  _values = defaultValues;
+  uint16_t generations[2];
+  bool valid_pages[] = {valid_page(0, generations[0]), valid_page(1, generations[1])};
+  _active = valid_pages[0] || valid_pages[1];
+  _needs_compaction = false;
+  if(!_active) {
+    // The first compaction writes page 0
+    _page = 1;
+    _generation = 0;
+    _end = page_address(_page);
+    TRACE("[Settings] No settings stored, using defaults");
+    return;
+  }
+  // Generations wrap around: the newest is ahead of the other by less than half the range
+  _page = !valid_pages[0] || (valid_pages[1] && static_cast<int16_t>(generations[1] - generations[0]) > 0) ? 1 : 0;
+  _generation = generations[_page];
+  scan();
+  TRACE_F("[Settings] Loaded generation %d, %d bytes used", _generation, used());
+}
+
+bool Settings::valid_page(uint8_t page, uint16_t &generation) {
+  uint32_t address = page_address(page);
+  generation = FLASH_READ(address + 2);
+  return FLASH_READ(address) == SETTINGS_MAGIC && static_cast<uint16_t>(~generation) == FLASH_READ(address + 4);
+}
+
+void Settings::scan() {
+  uint32_t address = page_address(_page) + SETTINGS_HEADER_SIZE;
+  uint32_t page_end = page_address(_page) + SETTINGS_PAGE_SIZE;
+  uint8_t value[SETTINGS_MAX_VALUE + 1];
+  while(address < page_end) {
+    uint16_t header = FLASH_READ(address);
+    if(header == SETTINGS_ERASED) {
+      break;
+    }
+    uint8_t key = header & 0xFF;
+    uint8_t size = header >> 8;
+    if(size > SETTINGS_MAX_VALUE || address + SETTINGS_RECORD_SIZE(size) > page_end) {
+      _needs_compaction = true;
+      break;
+    }
+    uint32_t value_address = address + 2;
+    for(uint8_t i = 0; i < size; i += 2, value_address += 2) {
+      uint16_t data = FLASH_READ(value_address);
+      value[i] = data & 0xFF;
+      value[i + 1] = data >> 8;
+    }
+    if(FLASH_READ(value_address) != record_crc(header, value, size)) {
+      // Torn by a power cut: nothing valid can follow
+      TRACE_F("[Settings] Invalid record at %d", address - page_address(_page));
+      _needs_compaction = true;
+      break;
+    }
+    // Unknown keys and invalid values are skipped, and dropped by the next compaction
+    if(valid(key, value, size)) {
+      apply(static_cast<Key>(key), value, size);
+    }
+    address += SETTINGS_RECORD_SIZE(size);
+  }
+  _end = address;
+}
+
+const void *Settings::get(Key key, uint8_t &size) const {
+  if(key >= KeysCount) {
+    return nullptr;
+  }
+  return field_value(_values, key, size);
+}
+
+bool Settings::set(Key key, const void *value, uint8_t size) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(value);
+  if(!valid(key, bytes, size)) {
+    return false;
+  }
+  uint8_t current_size;
+  const void *current = get(key, current_size);
+  if(current_size == size && memcmp(current, value, size) == 0) {
+    return true;
+  }
+  FLASH_Unlock();
+  bool written = (_active && !_needs_compaction && append(key, value, size)) || compact(key, value, size);
+  FLASH_Lock();
+  if(!written) {
+    TRACE_F("[Settings] Writing key %d failed", key);
+    return false;
+  }
+  apply(key, value, size);
+  return true;
+}
+
+bool Settings::write_record(uint32_t &address, Key key, const void *value, uint8_t size) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(value);
+  uint16_t header = key | static_cast<uint16_t>(size) << 8;
+  if(!program(address, header)) {
+    return false;
+  }
+  for(uint8_t i = 0; i < size; i += 2) {
+    uint16_t data = bytes[i] | (i + 1 < size ? static_cast<uint16_t>(bytes[i + 1]) << 8 : 0);
+    if(!program(address, data)) {
+      return false;
+    }
+  }
+  return program(address, record_crc(header, bytes, size));
+}
+
+bool Settings::append(Key key, const void *value, uint8_t size) {
+  if(_end + SETTINGS_RECORD_SIZE(size) > page_address(_page) + SETTINGS_PAGE_SIZE) {
+    return false;
+  }
+  uint32_t address = _end;
+  if(!write_record(address, key, value, size)) {
+    // Whatever was written ends the log
+    _needs_compaction = true;
+    return false;
+  }
+  _end = address;
+  return true;
+}
+
+bool Settings::compact(Key key, const void *value, uint8_t size) {
+  uint8_t page = 1 - _page;
+  uint32_t start = page_address(page);
+  if(FLASH_ErasePage(start) != FLASH_COMPLETE) {
+    return false;
+  }
+  // Values left to their defaults take no space
+  uint32_t address = start + SETTINGS_HEADER_SIZE;
+  for(uint8_t i = 0; i < KeysCount; i++) {
+    uint8_t current_size = size;
+    uint8_t default_size;
+    const void *current = i == key ? value : field_value(_values, i, current_size);
+    const void *default_value = field_value(defaultValues, i, default_size);
+    if(current_size == default_size && memcmp(current, default_value, current_size) == 0) {
+      continue;
+    }
+    if(!write_record(address, static_cast<Key>(i), current, current_size)) {
+      return false;
+    }
+  }
+  uint16_t generation = _generation + 1;
+  uint32_t header = start + 2;
+  if(!program(header, generation) || !program(header, ~generation) || FLASH_ProgramHalfWord(start, SETTINGS_MAGIC) != FLASH_COMPLETE) {
+    return false;
+  }
+  _page = page;
+  _generation = generation;
+  _end = address;
+  _active = true;
+  _needs_compaction = false;
+  TRACE_F("[Settings] Compacted to generation %d, %d bytes used", _generation, used());
+  return true;
+}
+
+void Settings::apply(Key key, const void *value, uint8_t size) {
+  uint8_t *field = reinterpret_cast<uint8_t*>(&_values) + fields[key].offset;
+  memcpy(field, value, size);
+  if(fields[key].string) {
+    field[size] = 0;
+  }
+}
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
@@ -0,0 +1,89 @@
+#pragma once
+#include "Arduino.h"
+#include "defines.h"
+
+// Last two 1 KB pages of the 64 KB flash (STM32F103C8): the build fails if the firmware image reaches them (tools/check_flash_size.py)
+#define SETTINGS_ADDRESS 0x0800F800
+#define SETTINGS_PAGE_SIZE 1024
+// Including the terminator
+#define SETTINGS_BLUETOOTH_NAME_SIZE 33
+#define SETTINGS_BLUETOOTH_PIN_SIZE 17
+
+// Compile time defaults, for the keys never set
+#ifndef BLUETOOTH_DEVICE_NAME
+#define BLUETOOTH_DEVICE_NAME "NexstarGPS-Lite"
+#endif
+#ifndef BLUETOOTH_DEVICE_PIN
+#define BLUETOOTH_DEVICE_PIN "1234"
+#endif
+#ifndef COMMPORT_DEBOUNCE
+#define COMMPORT_DEBOUNCE 1000
+#endif
+#define NEXSTAR_RESPONSE_TIMEOUT 3500
+
+// Settings changed at runtime (diagnostics 'S' command), kept in flash as an append-only
+// log of key/value records, loaded into RAM at boot with a single scan of the log.
+//
+// Each of the two pages starts with a header: magic, generation, ~generation (halfwords),
+// followed by records: key | size << 8, the value (size bytes, padded to halfwords), and
+// the CRC-16 of both. The first erased halfword (0xFFFF) ends the log.
+// Changing a value appends a record to the active page; when it's full, the current
+// values are compacted into the other page, erasing it first. The header is written
+// last, so that the compacted page only replaces the active one once complete: the
+// newest valid generation wins, and pages are erased in turns.
+// A power cut leaves either the old or the new value: torn records fail their CRC,
+// ending the scan, and force a compaction before appending again.
+//
+// Erasing a page stalls the CPU for about 20 ms: only change settings when idle.
+class Settings {
+public:
+  enum Key : uint8_t {
+    BluetoothName = 0, // string; applied at the next boot
+    BluetoothPin = 1, // string; applied at the next boot
+    LogLevel = 2, // uint8_t, LOG_LEVEL_*; applied at the next boot
+    NexstarTimeout = 3, // uint16_t, ms
+    CommPortDebounce = 4, // uint16_t, ms
+    KeysCount,
+  };
+  struct Values {
+    char bluetooth_name[SETTINGS_BLUETOOTH_NAME_SIZE];
+    char bluetooth_pin[SETTINGS_BLUETOOTH_PIN_SIZE];
+    uint8_t log_level;
+    uint16_t nexstar_timeout;
+    uint16_t commport_debounce;
+  };
+
+  Settings();
+  // Reads the values from flash: call first thing in setup()
+  void load();
+  inline const Values &values() const { return _values; }
+  // Strings are sized without terminator, other values must match the key size exactly.
+  // Returns false if the value is invalid or couldn't be written (nothing changes).
+  bool set(Key key, const void *value, uint8_t size);
+  // Value of key and its size, nullptr for unknown keys
+  const void *get(Key key, uint8_t &size) const;
+
+  // Generation of the active page, increased on each compaction
+  inline uint16_t generation() const { return _generation; }
+  // Bytes used in the active page, header included
+  inline uint16_t used() const { return _end - page_address(_page); }
+
+private:
+  Values _values;
+  uint8_t _page = 0;
+  uint16_t _generation = 0;
+  bool _active = false;
+  bool _needs_compaction = false;
+  // First free address in the active page
+  uint32_t _end = SETTINGS_ADDRESS;
+  static inline uint32_t page_address(uint8_t page) { return SETTINGS_ADDRESS + page * SETTINGS_PAGE_SIZE; }
+  void defaults();
+  static bool valid_page(uint8_t page, uint16_t &generation);
+  void scan();
+  bool write_record(uint32_t &address, Key key, const void *value, uint8_t size);
+  bool append(Key key, const void *value, uint8_t size);
+  bool compact(Key key, const void *value, uint8_t size);
+  void apply(Key key, const void *value, uint8_t size);
+};
+
+// vim: set shiftwidth=2 tabstop=2 expandtab:indentSize=2:tabSize=2:noTabs=true:
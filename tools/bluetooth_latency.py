@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Bluetooth client latency at each BLUETOOTH_BAUD_RATE, on the host build.
+
+For each rate, builds nexstargps-simulator in a temporary directory and simulates a
+Bluetooth client polling the position ('e', relayed to the hand control) with no
+Bluetooth or hand control latency, so that the round trip is only made of the serial
+transfers and the firmware:
+
+    tools/bluetooth_latency.py                 # all the allowed rates
+    tools/bluetooth_latency.py 9600 115200
+
+Configuring writes defines.h in the source tree: the original one is put back at the end.
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+RATES = [9600, 19200, 38400, 57600, 115200, 230400, 460800]
+SOURCE_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+CLIENT_LINE = re.compile(r'Client phone: (\d+) requests, (\d+) replies, (\d+) timeouts, rtt ([\d.]+)/([\d.]+) ms')
+
+
+def measure(rate, duration, build_dir):
+    subprocess.run(['cmake', '-S', SOURCE_DIR, '-B', build_dir, '-DHOST_BUILD=On', '-DCMAKE_BUILD_TYPE=Release',
+                    '-DBLUETOOTH_BAUD_RATE={}'.format(rate)], check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(['cmake', '--build', build_dir, '--target', 'nexstargps-simulator'], check=True, stdout=subprocess.DEVNULL)
+    # Hand control plugged in before the client connects: no timeouts at boot
+    result = subprocess.run([os.path.join(build_dir, 'host', 'nexstargps-simulator'), '--duration', str(duration),
+                             '--hc-connect', '1000', '--phone-connect', '5000', '--hc-latency', '0', '--bt-latency', '0',
+                             '--timeline', os.devnull], check=True, stderr=subprocess.PIPE, universal_newlines=True)
+    match = CLIENT_LINE.search(result.stderr)
+    if not match:
+        raise SystemExit('{}: no client statistics in the simulator output'.format(rate))
+    return match
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('rates', nargs='*', type=int, default=RATES)
+    parser.add_argument('--duration', type=int, default=600, help='simulated seconds for each rate (default: 600)')
+    args = parser.parse_args()
+    if any(rate not in RATES for rate in args.rates):
+        raise SystemExit('Allowed rates: {}'.format(', '.join(str(rate) for rate in RATES)))
+
+    defines = os.path.join(SOURCE_DIR, 'defines.h')
+    with open(defines) as f:
+        original_defines = f.read()
+    try:
+        print('{:>8} {:>9} {:>8} {:>9} {:>10} {:>9}'.format('baud', 'requests', 'replies', 'timeouts', 'mean (ms)', 'max (ms)'))
+        for rate in args.rates:
+            with tempfile.TemporaryDirectory(prefix='nexstargps-bt{}-'.format(rate)) as build_dir:
+                match = measure(rate, args.duration, build_dir)
+            print('{:>8} {:>9} {:>8} {:>9} {:>10} {:>9}'.format(rate, *match.groups()))
+            sys.stdout.flush()
+    finally:
+        with open(defines, 'w') as f:
+            f.write(original_defines)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Checks that the firmware image ends below the settings pages (SETTINGS_ADDRESS in settings.h).
+
+The settings store erases those pages, so an image growing into them would be
+corrupted by the first settings change. The build runs it after each link:
+
+    tools/check_flash_size.py build/NexstarGPSLite.elf
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+
+PT_LOAD = 1
+SETTINGS_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'settings.h')
+
+
+def image_end(elf_path):
+    with open(elf_path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit('{}: not a 32 bit little endian ELF file'.format(elf_path))
+    phoff, = struct.unpack_from('<I', elf, 0x1C)
+    phentsize, phnum = struct.unpack_from('<HH', elf, 0x2A)
+    end = 0
+    for i in range(phnum):
+        p_type, _, _, p_paddr, p_filesz = struct.unpack_from('<IIIII', elf, phoff + i * phentsize)
+        # Flash contents are the loaded segments at their load address (.data included), .bss has no file size
+        if p_type == PT_LOAD and p_filesz > 0:
+            end = max(end, p_paddr + p_filesz)
+    return end
+
+
+def settings_address(header):
+    with open(header) as f:
+        match = re.search(r'^#define SETTINGS_ADDRESS (0x[0-9A-Fa-f]+)', f.read(), re.MULTILINE)
+    if not match:
+        raise SystemExit('{}: SETTINGS_ADDRESS not found'.format(header))
+    return int(match.group(1), 16)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf')
+    parser.add_argument('--settings-header', default=SETTINGS_HEADER)
+    args = parser.parse_args()
+
+    end = image_end(args.elf)
+    limit = settings_address(args.settings_header)
+    if end > limit:
+        sys.exit('{}: the image ends at 0x{:08X}, {} bytes into the settings pages at 0x{:08X}'.format(
+            args.elf, end, end - limit, limit))
+    print('{}: the image ends at 0x{:08X}, {} bytes below the settings pages'.format(args.elf, end, limit - end))
+
+
+if __name__ == '__main__':
+    main()
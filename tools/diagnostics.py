@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Queries NexstarGPSLite diagnostics over the Nexstar client port (USB Serial or Bluetooth).
+
+    tools/diagnostics.py /dev/ttyACM0            # telemetry snapshot
+    tools/diagnostics.py /dev/rfcomm0 profile    # profiling zones (needs -DPROFILING=On)
+    tools/diagnostics.py /dev/ttyACM0 settings   # stored settings
+    tools/diagnostics.py /dev/ttyACM0 settings bluetooth_name MyScope
+
+Queries are escape commands (0xFE followed by the command letter), intercepted by
+the firmware between Nexstar commands; see diagnostics.h for the reply format.
+"""
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+
+ESCAPE = 0xFE
+SNAPSHOT = ord('D')
+PROFILE = ord('P')
+SETTINGS = ord('S')
+
+# Mirrors DiagnosticsSnapshot in diagnostics.h
+SNAPSHOT_FIELDS = [
+    ('version', 'B'),
+    ('uptime_ms', 'I'),
+    ('gps_chars', 'I'),
+    ('gps_sentences_with_fix', 'I'),
+    ('gps_passed_checksum', 'I'),
+    ('gps_failed_checksum', 'I'),
+    ('gps_status', 'B'),
+    ('gps_fix_type', 'B'),
+    ('gps_satellites_in_view', 'B'),
+    ('gps_satellites_used', 'B'),
+    ('gps_suspended', 'B'),
+    ('nexstar_status', 'B'),
+    ('nexstar_commands', 'I'),
+    ('nexstar_timeouts', 'I'),
+    ('nexstar_replies', 'I'),
+    ('nexstar_rtt_min_ms', 'H'),
+    ('nexstar_rtt_max_ms', 'H'),
+    ('nexstar_rtt_mean_ms', 'H'),
+    ('passthrough_transactions', 'I'),
+    ('passthrough_sent', 'I'),
+    ('passthrough_received', 'I'),
+    ('loop_iterations', 'I'),
+    ('loop_max_task_runtime_us', 'I'),
+    ('sleep_permille', 'H'),
+    ('rtc_valid', 'B'),
+    ('rtc_disciplined', 'B'),
+    ('rtc_utc', 'I'),
+]
+SNAPSHOT_FORMAT = '<' + ''.join(f for _, f in SNAPSHOT_FIELDS)
+SNAPSHOT_VERSION = 1
+# Mirrors Settings::Key in settings.h: strings, or struct formats
+SETTINGS_KEYS = [
+    ('bluetooth_name', 's'),
+    ('bluetooth_pin', 's'),
+    ('log_level', 'B'),
+    ('nexstar_timeout_ms', 'H'),
+    ('commport_debounce_ms', 'H'),
+]
+GPS_STATUS = ['no fix', 'time fix', 'fix']
+NEXSTAR_STATUS = ['not connected', 'connected', 'time synced', 'location synced']
+
+
+def open_port(path, baud_rate):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    if os.isatty(fd):
+        attributes = termios.tcgetattr(fd)
+        attributes[0] = attributes[1] = attributes[3] = 0  # raw input, output and local modes
+        attributes[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        speed = getattr(termios, 'B{}'.format(baud_rate))
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attributes)
+        termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def read_exactly(fd, size, deadline):
+    data = b''
+    while len(data) < size:
+        remaining = deadline - time.monotonic()
+        if remaining <= 0 or not select.select([fd], [], [], remaining)[0]:
+            raise SystemExit('timeout waiting for the reply')
+        data += os.read(fd, size - len(data))
+    return data
+
+
+def query(fd, command, timeout, arguments=b''):
+    os.write(fd, bytes([ESCAPE, command]) + arguments)
+    deadline = time.monotonic() + timeout
+    reply_command, size = struct.unpack('<BH', read_exactly(fd, 3, deadline))
+    payload = read_exactly(fd, size, deadline)
+    if read_exactly(fd, 1, deadline) != b'#':
+        raise SystemExit('malformed reply')
+    if reply_command != command:
+        raise SystemExit('command {!r} rejected by the firmware: not supported, or invalid arguments'.format(chr(command)))
+    return payload
+
+
+def print_snapshot(payload):
+    if payload[0] != SNAPSHOT_VERSION or len(payload) != struct.calcsize(SNAPSHOT_FORMAT):
+        raise SystemExit('unsupported snapshot version {} ({} bytes)'.format(payload[0], len(payload)))
+    snapshot = dict(zip([name for name, _ in SNAPSHOT_FIELDS], struct.unpack(SNAPSHOT_FORMAT, payload)))
+    descriptions = {
+        'gps_status': GPS_STATUS,
+        'nexstar_status': NEXSTAR_STATUS,
+    }
+    for name, value in snapshot.items():
+        if name in descriptions and value < len(descriptions[name]):
+            value = '{} ({})'.format(value, descriptions[name][value])
+        elif name == 'rtc_utc':
+            value = '{} ({})'.format(value, time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(value)))
+        print('{:<26} {}'.format(name, value))
+
+
+def print_profile(payload):
+    zones, ticks_per_us = struct.unpack_from('<BI', payload)
+    offset = 5
+    print('{:<20} {:>10} {:>10} {:>10} {:>10}'.format('zone', 'count', 'min us', 'max us', 'mean us'))
+    for _ in range(zones):
+        count, minimum, maximum, mean = struct.unpack_from('<IIII', payload, offset)
+        offset += 16
+        end = payload.index(b'\0', offset)
+        name = payload[offset:end].decode('ascii')
+        offset = end + 1
+        print('{:<20} {:>10} {:>10.2f} {:>10.2f} {:>10.2f}'.format(
+            name, count, minimum / ticks_per_us, maximum / ticks_per_us, mean / ticks_per_us))
+
+
+def setting(fd, name, value, timeout):
+    key = [n for n, _ in SETTINGS_KEYS].index(name)
+    value_format = SETTINGS_KEYS[key][1]
+    if value is None:
+        value = b''
+    elif value_format == 's':
+        value = value.encode('ascii')
+    else:
+        value = struct.pack('<' + value_format, int(value))
+    payload = query(fd, SETTINGS, timeout, bytes([key, len(value)]) + value)
+    if value_format == 's':
+        return payload[1:].decode('ascii')
+    return struct.unpack('<' + value_format, payload[1:])[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port')
+    parser.add_argument('command', nargs='?', choices=['snapshot', 'profile', 'settings'], default='snapshot')
+    parser.add_argument('setting', nargs='?', choices=[name for name, _ in SETTINGS_KEYS],
+                        help='settings: only read, or change, this one (name, PIN and log level apply at the next boot)')
+    parser.add_argument('value', nargs='?')
+    parser.add_argument('-b', '--baud-rate', type=int, default=9600)
+    parser.add_argument('-t', '--timeout', type=float, default=2)
+    args = parser.parse_args()
+
+    fd = open_port(args.port, args.baud_rate)
+    try:
+        if args.command == 'snapshot':
+            print_snapshot(query(fd, SNAPSHOT, args.timeout))
+        elif args.command == 'profile':
+            print_profile(query(fd, PROFILE, args.timeout))
+        elif args.setting:
+            print('{:<26} {}'.format(args.setting, setting(fd, args.setting, args.value, args.timeout)))
+        else:
+            for name, _ in SETTINGS_KEYS:
+                print('{:<26} {}'.format(name, setting(fd, name, None, args.timeout)))
+    finally:
+        os.close(fd)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
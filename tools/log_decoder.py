@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""Decoder for NexstarGPSLite tokenized log records (see log_buffer.h).
+
+The format strings table is extracted from the firmware after each link, by the
+log_strings build target:
+
+    tools/log_decoder.py extract build/NexstarGPSLite.elf -o build/log_strings.json
+
+Decode the log stream from the USB serial port (or a capture file) with it:
+
+    stty -F /dev/ttyACM0 raw
+    tools/log_decoder.py decode build/log_strings.json /dev/ttyACM0
+
+Bytes that are not part of a valid record are printed as they are, so plain text
+output still shows up.
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+
+RECORD_SYNC = 0xA5
+HEADER_SIZE = 11
+LEVELS = {1: 'F', 2: 'E', 3: 'W', 4: 'N', 5: 'T', 6: 'V'}
+FORMAT_SYMBOL = '_log_format'
+SPECIFIER = re.compile(r'%(.)')
+
+
+def extract(elf_path):
+    with open(elf_path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit('{}: not a 32 bit little endian ELF file'.format(elf_path))
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum = struct.unpack_from('<HH', elf, 0x2E)
+    sections = [struct.unpack_from('<IIIIIIIIII', elf, shoff + i * shentsize) for i in range(shnum)]
+    table = {}
+    for section in sections:
+        if section[1] != 2:  # SHT_SYMTAB
+            continue
+        strtab = sections[section[6]]
+        for offset in range(section[4], section[4] + section[5], 16):
+            name, value, size, _, _, shndx = struct.unpack_from('<IIIBBH', elf, offset)
+            start = strtab[4] + name
+            symbol = elf[start:elf.index(b'\0', start)].decode('ascii', 'replace')
+            if FORMAT_SYMBOL not in symbol or shndx == 0 or shndx >= len(sections):
+                continue
+            data_section = sections[shndx]
+            data_start = data_section[4] + value - data_section[3]
+            data = elf[data_start:data_start + size]
+            table['0x{:08x}'.format(value)] = data.split(b'\0')[0].decode('ascii', 'replace')
+    return table
+
+
+def format_string(value):
+    return ''.join(c if 32 <= ord(c) < 127 else '\\x{:02x}'.format(ord(c)) for c in value)
+
+
+def render(fmt, args):
+    args = list(args)
+
+    def replace(match):
+        spec = match.group(1)
+        if spec == '%':
+            return '%'
+        if not args:
+            return '<?>'
+        value = args.pop(0)
+        if isinstance(value, str):
+            return format_string(value)
+        if spec in 'DF':
+            return '{:.2f}'.format(value)
+        value = int(value)
+        if spec == 'x':
+            return '{:x}'.format(value & 0xFFFFFFFF)
+        if spec == 'X':
+            return '0x{:X}'.format(value & 0xFFFFFFFF)
+        if spec == 'b':
+            return '{:b}'.format(value & 0xFFFFFFFF)
+        if spec == 'B':
+            return '0b{:b}'.format(value & 0xFFFFFFFF)
+        if spec == 't':
+            return 'T' if value else 'F'
+        if spec == 'T':
+            return 'true' if value else 'false'
+        if spec == 'c':
+            return format_string(chr(value & 0xFF))
+        return str(value)
+    return SPECIFIER.sub(replace, fmt)
+
+
+def parse_payload(payload):
+    args = []
+    index = 0
+    while index < len(payload):
+        tag = chr(payload[index])
+        index += 1
+        if tag == 's':
+            length = payload[index]
+            args.append(payload[index + 1:index + 1 + length].decode('latin-1'))
+            index += 1 + length
+        elif tag in 'iuf':
+            args.append(struct.unpack_from({'i': '<i', 'u': '<I', 'f': '<f'}[tag], payload, index)[0])
+            index += 4
+        else:
+            raise ValueError('unknown argument tag {!r}'.format(tag))
+    return args
+
+
+def decode_record(table, record):
+    level, payload_size, token, timestamp = struct.unpack_from('<BBII', record, 1)
+    fmt = table.get('0x{:08x}'.format(token))
+    if fmt is None:
+        fmt = '<unknown format 0x{:08x}>'.format(token) + ' %s' * payload_size
+    text = render(fmt, parse_payload(record[HEADER_SIZE:HEADER_SIZE + payload_size]))
+    return '[{:10.3f}] {}: {}'.format(timestamp / 1000.0, LEVELS.get(level, '?'), text)
+
+
+def record_size(buffer, start):
+    """Size of the valid record at start, 0 if more data is needed, -1 if it's not a record."""
+    if len(buffer) - start < 3:
+        return 0
+    if buffer[start + 1] not in LEVELS:
+        return -1
+    size = HEADER_SIZE + buffer[start + 2] + 1
+    if len(buffer) - start < size:
+        return 0
+    if sum(buffer[start + 1:start + size - 1]) & 0xFF != buffer[start + size - 1]:
+        return -1
+    return size
+
+
+def decode(table, stream, output):
+    buffer = bytearray()
+    while True:
+        data = stream.read1(256) if hasattr(stream, 'read1') else stream.read(256)
+        if not data:
+            break
+        buffer += data
+        start = 0
+        text = bytearray()
+        while start < len(buffer):
+            if buffer[start] != RECORD_SYNC:
+                text.append(buffer[start])
+                start += 1
+                continue
+            size = record_size(buffer, start)
+            if size == 0:
+                break
+            if size < 0:
+                start += 1
+                continue
+            if text:
+                output.write(text.decode('latin-1'))
+                text = bytearray()
+            try:
+                output.write(decode_record(table, bytes(buffer[start:start + size])) + '\n')
+            except (ValueError, struct.error) as e:
+                output.write('<invalid record: {}>\n'.format(e))
+            start += size
+        output.write(text.decode('latin-1'))
+        output.flush()
+        del buffer[:start]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+    extract_parser = commands.add_parser('extract', help='extract the format strings table from the firmware ELF file')
+    extract_parser.add_argument('elf')
+    extract_parser.add_argument('-o', '--output', default='-')
+    decode_parser = commands.add_parser('decode', help='decode a log stream')
+    decode_parser.add_argument('table', help='format strings table (JSON), or the firmware ELF file')
+    decode_parser.add_argument('input', nargs='?', default='-', help='serial port or capture file (default: stdin)')
+    args = parser.parse_args()
+
+    if args.command == 'extract':
+        table = json.dumps(extract(args.elf), indent=2, sort_keys=True)
+        if args.output == '-':
+            print(table)
+        else:
+            with open(args.output, 'w') as f:
+                f.write(table + '\n')
+        return
+
+    if args.table.endswith('.json'):
+        with open(args.table) as f:
+            table = json.load(f)
+    else:
+        table = extract(args.table)
+    stream = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    try:
+        decode(table, stream, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()